@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <latch>
+#include <string>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_async.h"
+#include "sha256_profile.h"
+#include "sha256_util.h"
+
+/*
+  Per-message cost of the coroutine API against the synchronous one.
+
+  For each message length, the synchronous run hashes every message on the calling thread with init/update/final,
+  the way callers use the SHA256 class today. The async run spreads the same messages over C coroutines that each
+  co_await async_hash() in a loop, so up to C requests are in flight for the executor to batch. Lengths below
+  --stream-min are batched; longer ones go to the streaming workers. Every digest is checked.
+*/
+
+struct Detached
+{
+  struct promise_type
+  {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+static Detached client(HashExecutor &ex, const std::vector<uint8_t> &msg, const uint8_t *expected, size_t count,
+                       std::atomic<uint64_t> &errors, std::latch &done)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    std::array<uint8_t, 32> digest = co_await async_hash(msg, ex);
+    if (memcmp(digest.data(), expected, 32) != 0)
+      errors++;
+  }
+  done.count_down();
+}
+
+static std::vector<size_t> parse_list(const char *s)
+{
+  std::vector<size_t> v;
+  for (char *end; *s; s = *end ? end + 1 : end)
+  {
+    size_t x = strtoull(s, &end, 10);
+    if (x)
+      v.push_back(x);
+    if (end == s)
+      break;
+  }
+  return v;
+}
+
+int main(int argc, char **argv)
+{
+  AsyncHashOptions opt;
+  std::vector<size_t> lens = {64, 1024, 65536}, coroutines = {1, 16, 256};
+  size_t total_bytes = 16 << 20;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--max-wait-us" && i + 1 < argc)
+      opt.max_wait_us = atoi(argv[++i]);
+    else if (arg == "--max-pending" && i + 1 < argc)
+      opt.max_pending = std::max(1L, atol(argv[++i]));
+    else if (arg == "--stream-min" && i + 1 < argc)
+      opt.stream_min = atol(argv[++i]);
+    else if (arg == "--workers" && i + 1 < argc)
+      opt.stream_workers = std::max(1, atoi(argv[++i]));
+    else if (arg == "--lens" && i + 1 < argc)
+      lens = parse_list(argv[++i]);
+    else if (arg == "--coroutines" && i + 1 < argc)
+      coroutines = parse_list(argv[++i]);
+    else if (arg == "--mb" && i + 1 < argc)
+      total_bytes = std::max(1L, atol(argv[++i])) << 20;
+    else
+    {
+      fprintf(stderr,
+              "usage: %s [--lens 64,1024,...] [--coroutines 1,16,...] [--mb MB per run] [--max-wait-us N] [--max-pending N]\n"
+              "          [--stream-min BYTES] [--workers N]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  std::string backend = apply_profile_backend(load_profile());
+  uint64_t errors = 0;
+  {
+    HashExecutor ex(opt);
+    printf("Backend %s, %zu messages per batch, max wait %u us, max pending %zu, %u streaming workers for >= %zu bytes\n\n",
+           backend.c_str(), ex.batch_width(), opt.max_wait_us, opt.max_pending, opt.stream_workers, opt.stream_min);
+    printf("%8s %10s %10s %12s %12s %10s %9s %10s\n", "bytes", "messages", "coroutines", "sync ns/msg", "async ns/msg", "batch fill",
+           "timeouts", "throttled");
+
+    for (size_t len : lens)
+    {
+      std::vector<uint8_t> msg(len);
+      for (size_t i = 0; i < len; i++) msg[i] = i * 7 + 1;
+      uint8_t expected[32], digest[32];
+      libsha256(msg.data(), len, expected);
+      size_t messages = std::clamp<size_t>(total_bytes / len, 2000, 50000);
+
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < messages; i++)
+      {
+        libsha256_ctx ctx;
+        libsha256_init(&ctx);
+        libsha256_update(&ctx, msg.data(), len);
+        libsha256_final(&ctx, digest);
+      }
+      double sync_ns = seconds_since(start) * 1e9 / messages;
+      errors += memcmp(digest, expected, 32) != 0;
+
+      for (size_t c : coroutines)
+      {
+        size_t per = (messages + c - 1) / c;
+        std::atomic<uint64_t> bad{0};
+        std::latch done(c);
+        HashExecutor::Stats before = ex.stats();
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < c; i++) client(ex, msg, expected, per, bad, done);
+        done.wait();
+        double async_ns = seconds_since(start) * 1e9 / (per * c);
+        HashExecutor::Stats after = ex.stats();
+
+        uint64_t batches = after.batches - before.batches;
+        double fill = batches ? 100.0 * (after.batched - before.batched) / batches / ex.batch_width() : 0;
+        printf("%8zu %10zu %10zu %12.1f %12.1f", len, per * c, c, sync_ns, async_ns);
+        if (batches)
+          printf(" %9.0f%%", fill);
+        else
+          printf(" %10s", "streamed");
+        printf(" %9llu %10llu\n", (unsigned long long)(after.timeouts - before.timeouts),
+               (unsigned long long)(after.throttled - before.throttled));
+        errors += bad;
+      }
+    }
+  }
+  if (errors)
+    printf("\n%llu wrong digests\n", (unsigned long long)errors);
+  return errors ? 1 : 0;
+}
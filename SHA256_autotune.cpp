@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_profile.h"
+
+/*
+  Per-host autotuner.
+
+  Sweeps the libsha256 backend (every one this CPU supports), thread count, SMT use, batch depth and streaming chunk size on
+  this machine, then writes the winner to the profile that SHA256_multithread, SHA256_simd and SHA256_check load at
+  startup (see sha256_profile.h). The sweep is coordinate-wise: placement first, then batch depth, then chunk size.
+  Finally the tuned profile is measured against the hard-coded defaults.
+*/
+
+
+struct Config
+{
+  std::string backend;
+  unsigned threads;
+  bool smt;
+  unsigned batch;
+  size_t chunk;
+};
+
+static std::string describe(const Config &c)
+{
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%-11s threads=%-3u smt=%d batch=%-3u chunk=%zuK", c.backend.c_str(), c.threads, c.smt, c.batch, c.chunk >> 10);
+  return buf;
+}
+
+// Runs fn(worker index, stop flag) on c.threads placed workers for ms milliseconds; returns units per second.
+template <typename Fn>
+static double run_trial(const Config &c, int ms, Fn fn)
+{
+  HashProfile placement;
+  placement.smt = c.smt;
+  libsha256_set_backend(c.backend.c_str());
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> total{0};
+  std::vector<std::thread> threads;
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < c.threads; ++i)
+    threads.emplace_back(
+        [&, i]()
+        {
+          apply_profile_placement(placement, i, c.backend);
+          total += fn(i, stop);
+        });
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  stop = true;
+  for (auto &t : threads) t.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return total / seconds;
+}
+
+// Short messages, as in SHA256_multithread.cpp and SHA256_simd.cpp, a batch of the backend's width per call. The
+// messages come from a bounded shared pool of POOL_UNITS units (one batch call each), and workers claim `batch` units
+// at a time from a shared cursor, which is how the batch depth trades claiming overhead against load balance.
+static const size_t POOL_UNITS = 1024;
+
+static double short_messages(const Config &c, int ms)
+{
+  const size_t width = std::max<size_t>(8, libsha256_batch_lanes());
+  std::vector<uint8_t> pool(POOL_UNITS * width * 64);
+  for (size_t m = 0; m < POOL_UNITS * width; m++) memset(&pool[m * 64], 'a' + m % 26, 14);
+  std::atomic<uint64_t> cursor{0};
+  return run_trial(c, ms,
+                   [&](unsigned, std::atomic<bool> &stop) -> uint64_t
+                   {
+                     uint8_t out[16][32];
+                     const void *msg[16];
+                     size_t lens[16];
+                     uint64_t hashes = 0;
+                     std::fill(lens, lens + 16, 14);
+                     while (!stop.load(std::memory_order_relaxed))
+                     {
+                       uint64_t first = cursor.fetch_add(c.batch, std::memory_order_relaxed);
+                       for (uint64_t u = first; u < first + c.batch; u++)
+                       {
+                         const uint8_t *unit = &pool[u % POOL_UNITS * width * 64];
+                         for (size_t i = 0; i < width; i++) msg[i] = unit + i * 64;
+                         libsha256_batch(msg, lens, width, out);
+                       }
+                       hashes += width * c.batch;
+                     }
+                     return hashes;
+                   });
+}
+
+// Bulk streaming, as in the check tool: copy chunk-sized pieces of a large source buffer (standing in for read())
+// and feed them to a single-stream hasher. Reports bytes per second.
+static double bulk_stream(const Config &c, int ms, const std::vector<uint8_t> &source)
+{
+  return run_trial(c, ms,
+                   [&](unsigned i, std::atomic<bool> &stop) -> uint64_t
+                   {
+                     std::vector<uint8_t> chunk(c.chunk);
+                     size_t pos = (source.size() / c.threads * i) & ~(size_t)63;
+                     uint64_t bytes = 0;
+                     libsha256_ctx ctx;
+                     libsha256_init(&ctx);
+                     while (!stop.load(std::memory_order_relaxed))
+                     {
+                       if (pos + c.chunk > source.size())
+                         pos = 0;
+                       memcpy(chunk.data(), source.data() + pos, c.chunk);
+                       libsha256_update(&ctx, chunk.data(), c.chunk);
+                       pos += c.chunk;
+                       bytes += c.chunk;
+                     }
+                     uint8_t digest[32];
+                     libsha256_final(&ctx, digest);
+                     volatile uint8_t sink = digest[0];
+                     (void)sink;
+                     return bytes;
+                   });
+}
+
+// Best of a few repeats, which filters out most scheduler noise on a busy host.
+template <typename Fn>
+static double best_of(int repeats, Fn fn)
+{
+  double best = 0;
+  for (int i = 0; i < repeats; i++) best = std::max(best, fn());
+  return best;
+}
+
+// A candidate has to beat the incumbent by this much to replace it, so noise never moves a knob off its default.
+static const double MIN_GAIN = 1.03;
+
+int main(int argc, char **argv)
+{
+  int trial_ms = 300, repeats = 3;
+  bool save = true;
+  std::string output = profile_path();
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--trial-ms" && i + 1 < argc)
+      trial_ms = atoi(argv[++i]);
+    else if (arg == "--repeats" && i + 1 < argc)
+      repeats = std::max(1, atoi(argv[++i]));
+    else if (arg == "--output" && i + 1 < argc)
+      output = argv[++i];
+    else if (arg == "--dry-run")
+      save = false;
+    else
+    {
+      fprintf(stderr, "usage: %s [--trial-ms MS] [--repeats N] [--output PATH] [--dry-run]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  unsigned logical = std::max(1u, std::thread::hardware_concurrency());
+  unsigned physical = Topology::get().num_cores;
+  // "auto" is a candidate of its own: it can split single-stream and batch work across two backends, which no pinned
+  // backend does.
+  std::vector<std::string> backends{"auto"};
+  for (size_t i = 0; libsha256_backend_at(i); i++) backends.push_back(libsha256_backend_at(i));
+
+  // The knobs every front end hard-codes today, with the library's own backend choice.
+  HashProfile defaults;
+  Config base{"auto", logical, true, defaults.batch, defaults.chunk};
+  printf("Host %s: %u logical CPUs, %u physical cores, %d ms per trial\n\n", host_name().c_str(), logical, physical, trial_ms);
+
+  // 1. Backend, thread count and SMT use on short messages.
+  std::vector<unsigned> counts;
+  for (unsigned t = 1; t < logical; t *= 2) counts.push_back(t);
+  counts.push_back(logical);
+  if (physical != logical)
+    counts.push_back(physical);
+
+  std::vector<uint8_t> source(64 << 20);
+  for (size_t i = 0; i < source.size(); i++) source[i] = i * 2654435761u >> 24;
+  auto short_rate = [&](const Config &c) { return best_of(repeats, [&]() { return short_messages(c, trial_ms); }); };
+  auto bulk_rate = [&](const Config &c) { return best_of(repeats, [&]() { return bulk_stream(c, trial_ms, source); }); };
+
+  // Backends differ in their single-stream transform as well, so a backend only wins on short messages if it does not
+  // give up streaming throughput at the same time.
+  std::map<std::string, double> stream_rate;
+  for (const auto &backend : backends)
+  {
+    Config c = base;
+    c.backend = backend;
+    stream_rate[backend] = bulk_rate(c);
+  }
+
+  Config best = base;
+  double best_rate = short_rate(base);
+  printf("  %s  %8.2f MH/s  %8.2f MB/s streaming (defaults)\n", describe(base).c_str(), best_rate / 1e6, stream_rate[base.backend] / 1e6);
+  for (const auto &backend : backends)
+    for (unsigned t : counts)
+      for (bool smt : {true, false})
+      {
+        if (!smt && (physical == logical || t > physical))
+          continue;
+        Config c{backend, t, smt, base.batch, base.chunk};
+        if (c.backend == base.backend && c.threads == base.threads && c.smt == base.smt)
+          continue;
+        double rate = short_rate(c);
+        bool streams = stream_rate[c.backend] * MIN_GAIN >= stream_rate[best.backend];
+        printf("  %s  %8.2f MH/s  %8.2f MB/s streaming\n", describe(c).c_str(), rate / 1e6, stream_rate[c.backend] / 1e6);
+        if (rate > best_rate * MIN_GAIN && streams)
+          best = c, best_rate = rate;
+      }
+
+  // 2. Batch depth for the winner.
+  for (unsigned batch : {4u, 16u, 64u, 256u})
+  {
+    Config c = best;
+    c.batch = batch;
+    double rate = short_rate(c);
+    printf("  %s  %8.2f MH/s\n", describe(c).c_str(), rate / 1e6);
+    if (rate > best_rate * MIN_GAIN)
+      best = c, best_rate = rate;
+  }
+
+  // 3. Streaming chunk size with the chosen placement and the backend's single-stream transform.
+  double best_bulk = bulk_rate(best);
+  printf("  %s  %8.2f MB/s streaming\n", describe(best).c_str(), best_bulk / 1e6);
+  for (size_t chunk : {16u << 10, 64u << 10, 256u << 10, 4u << 20})
+  {
+    Config c = best;
+    c.chunk = chunk;
+    double rate = bulk_rate(c);
+    printf("  %s  %8.2f MB/s streaming\n", describe(c).c_str(), rate / 1e6);
+    if (rate > best_bulk * MIN_GAIN)
+      best.chunk = chunk, best_bulk = rate;
+  }
+
+  // Defaults vs the tuned profile, measured back to back.
+  double base_short = short_rate(base), tuned_short = short_rate(best);
+  double base_bulk = bulk_rate(base), tuned_bulk = bulk_rate(best);
+  printf("\nDefaults: %s\n", describe(base).c_str());
+  printf("Tuned:    %s\n", describe(best).c_str());
+  printf("Short messages: %.2f -> %.2f MH/s (%+.1f%%)\n", base_short / 1e6, tuned_short / 1e6, 100 * (tuned_short / base_short - 1));
+  printf("Streaming:      %.2f -> %.2f MB/s (%+.1f%%)\n", base_bulk / 1e6, tuned_bulk / 1e6, 100 * (tuned_bulk / base_bulk - 1));
+
+  if (save)
+  {
+    HashProfile p;
+    p.threads = best.threads;
+    p.smt = best.smt;
+    p.backend = best.backend;
+    p.batch = best.batch;
+    p.chunk = best.chunk;
+    if (!save_profile(p, "written by SHA256_autotune", output))
+    {
+      fprintf(stderr, "could not write %s\n", output.c_str());
+      return 1;
+    }
+    printf("Profile written to %s\n", output.c_str());
+  }
+  return 0;
+}
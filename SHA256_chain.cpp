@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_chain.h"
+#include "sha256_profile.h"
+#include "sha256_util.h"
+
+/*
+  Hash-chain generator, verifier and benchmark.
+
+  generate walks a chain of --steps links from SHA-256(--seed) and saves its checkpoints; verify recomputes every
+  segment of a saved chain in parallel and reports the first one that does not link.
+
+  bench times generation in ns per step, once with libsha256() called on the previous digest (the obvious loop) and
+  once with libsha256_chain(), then times verify() in steps per second on one thread and on all of them, for every
+  backend. All runs must end at the same head, and a chain with one corrupted checkpoint must fail at that segment.
+*/
+
+static HashChain::Digest seed_digest(const std::string &seed)
+{
+  HashChain::Digest h;
+  libsha256(seed.data(), seed.size(), h.data());
+  return h;
+}
+
+static int bench(const std::string &seed, uint64_t steps, uint64_t interval, unsigned threads)
+{
+  HashChain::Digest start = seed_digest(seed), reference = {};
+  int failures = 0;
+  printf("Chain of %llu steps from SHA-256(\"%s\"), checkpoint every %llu\n\n", (unsigned long long)steps, seed.c_str(),
+         (unsigned long long)interval);
+  printf("%-12s %14s %14s %16s %16s\n", "backend", "loop ns/step", "chain ns/step", "verify Msteps/s", "x threads");
+
+  std::vector<std::string> backends;
+  for (size_t i = 0; const char *name = libsha256_backend_at(i); i++) backends.push_back(name);
+  for (const std::string &backend : backends)
+  {
+    libsha256_set_backend(backend.c_str());
+
+    auto t0 = std::chrono::steady_clock::now();
+    HashChain::Digest h = start;
+    for (uint64_t i = 0; i < steps; i++) libsha256(h.data(), h.size(), h.data());
+    double loop_secs = seconds_since(t0);
+
+    t0 = std::chrono::steady_clock::now();
+    HashChain chain = HashChain::generate(start, steps, interval);
+    double chain_secs = seconds_since(t0);
+
+    t0 = std::chrono::steady_clock::now();
+    int64_t bad1 = chain.verify(1);
+    double verify1_secs = seconds_since(t0);
+    t0 = std::chrono::steady_clock::now();
+    int64_t badn = chain.verify(threads);
+    double verifyn_secs = seconds_since(t0);
+
+    if (backend == backends.front())
+      reference = h;
+    bool ok = h == reference && chain.head() == reference && bad1 == HashChain::LINKED && badn == HashChain::LINKED;
+    printf("%-12s %14.1f %14.1f %16.2f %16.2f%s\n", backend.c_str(), loop_secs / steps * 1e9, chain_secs / steps * 1e9,
+           steps / verify1_secs / 1e6, steps / verifyn_secs / 1e6, ok ? "" : "  MISMATCH");
+    failures += !ok;
+
+    // Flipping a bit in one checkpoint must break exactly the segment that ends there.
+    if (chain.segments() > 2)
+    {
+      size_t k = chain.segments() / 2;
+      chain.checkpoints[k + 1][7] ^= 1;
+      int64_t bad = chain.verify(threads);
+      if (bad != (int64_t)k)
+      {
+        printf("%-12s corrupted checkpoint %zu reported at %lld\n", backend.c_str(), k + 1, (long long)bad);
+        failures++;
+      }
+    }
+  }
+  printf("\nHead: %s\n", to_hex(reference.data()).c_str());
+  return failures ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  std::string command = argc > 1 ? argv[1] : "", seed = "0", path;
+  uint64_t steps = 0, interval = 1000;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  bool usage = command != "generate" && command != "verify" && command != "bench";
+  for (int i = 2; i < argc && !usage; ++i)
+  {
+    std::string arg = argv[i];
+    if (command == "verify" && path.empty() && arg[0] != '-')
+      path = arg;
+    else if (i + 1 >= argc)
+      usage = true;
+    else if (arg == "--seed")
+      seed = argv[++i];
+    else if (arg == "--steps")
+      steps = strtoull(argv[++i], nullptr, 10);
+    else if (arg == "--interval")
+      interval = std::max(1ULL, strtoull(argv[++i], nullptr, 10));
+    else if (arg == "-j" || arg == "--threads")
+      threads = std::max(1, atoi(argv[++i]));
+    else if (arg == "-o")
+      path = argv[++i];
+    else
+      usage = true;
+  }
+  if (usage || (command == "verify" && path.empty()) || (command == "generate" && (path.empty() || !steps)))
+  {
+    fprintf(stderr,
+            "usage: %s generate [--seed TEXT] --steps N [--interval N] -o FILE|-\n"
+            "       %s verify FILE [-j THREADS]\n"
+            "       %s bench [--seed TEXT] [--steps N] [--interval N] [-j THREADS]\n",
+            argv[0], argv[0], argv[0]);
+    return 1;
+  }
+
+  apply_profile_backend(load_profile());
+  if (command == "bench")
+    return bench(seed, steps ? steps : 2000000, interval, threads);
+
+  if (command == "generate")
+  {
+    auto t0 = std::chrono::steady_clock::now();
+    HashChain chain = HashChain::generate(seed_digest(seed), steps, interval);
+    double secs = seconds_since(t0);
+    if (!chain.save(path))
+    {
+      fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+      return 1;
+    }
+    fprintf(stderr, "%llu steps in %.3f s (%.1f ns/step) with %s, %zu checkpoints, head %s\n", (unsigned long long)steps, secs,
+            secs / steps * 1e9, libsha256_backend_name(), chain.checkpoints.size(), to_hex(chain.head().data()).c_str());
+    return 0;
+  }
+
+  HashChain chain;
+  if (!chain.load(path))
+  {
+    fprintf(stderr, "%s: not a readable sha256-chain file\n", path.c_str());
+    return 1;
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  int64_t bad = chain.verify(threads);
+  double secs = seconds_since(t0);
+  if (bad == HashChain::MALFORMED)
+  {
+    printf("%s: %zu checkpoints do not fit a chain of %llu steps every %llu\n", path.c_str(), chain.checkpoints.size(),
+           (unsigned long long)chain.length, (unsigned long long)chain.interval);
+    return 1;
+  }
+  if (bad >= 0)
+  {
+    printf("%s: segment %lld (steps %llu..%llu) does not link\n", path.c_str(), (long long)bad, (unsigned long long)(bad * chain.interval),
+           (unsigned long long)(bad * chain.interval + chain.segment_steps(bad)));
+    return 1;
+  }
+  printf("%s: %llu steps verified in %.3f s (%.2f Msteps/s, %u threads, %s), head %s\n", path.c_str(), (unsigned long long)chain.length,
+         secs, chain.length / secs / 1e6, threads, libsha256_backend_name(), to_hex(chain.head().data()).c_str());
+  return 0;
+}
@@ -0,0 +1,581 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_pool.h"
+#include "sha256_profile.h"
+
+/*
+  sha256sum-compatible check mode.
+
+  Reads standard `sha256sum` manifests (GNU and BSD --tag lines) and verifies every entry on a pool of threads.
+  Files are stat'ed first, then scheduled largest first so the long single-stream hashes start early. Files up to
+  --small-max bytes are read whole and hashed together by libsha256_batch(), one per SIMD lane of the backend;
+  neighbours in the size-sorted order have similar block counts, so few lanes idle. Results are printed in manifest order and the
+  stdout/stderr text matches coreutils, so this can replace `sha256sum -c` in scripts.
+
+  Extra options: -j/--threads N, --max-failures N (stop after N mismatches), --small-max BYTES. Thread count, read
+  size and the libsha256 backend default to the host profile written by SHA256_autotune.
+*/
+
+static const size_t MAX_GROUP = 16;
+
+// Small files hashed per libsha256_batch() call: a full set of the backend's lanes, and at least 8.
+static size_t group_size()
+{
+  return std::max<size_t>(8, libsha256_batch_lanes());
+}
+
+/* Manifest parsing, following coreutils' split_3() and bsd_split_3(). */
+
+enum Status : uint8_t
+{
+  PENDING,
+  MATCHED,
+  MISMATCHED,
+  READ_FAILED,
+  SKIPPED,
+};
+
+struct Entry
+{
+  std::string name;
+  uint8_t expected[32];
+  off_t size = 0;
+  bool regular = false;
+  int error = 0;
+  std::atomic<uint8_t> status{PENDING};
+};
+
+struct Options
+{
+  bool quiet = false;
+  bool status_only = false;
+  bool strict = false;
+  bool warn = false;
+  bool ignore_missing = false;
+  HashProfile profile = load_profile();
+  unsigned threads = 0;
+  size_t max_failures = 0;
+  size_t small_max = 16384;
+};
+
+static const char *program_name = "sha256sum";
+static int bsd_reversed = -1;
+
+static int hexval(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static bool parse_hex(const char *s, uint8_t out[32])
+{
+  for (int i = 0; i < 32; i++)
+  {
+    int hi = hexval(s[2 * i]), lo = hi < 0 ? -1 : hexval(s[2 * i + 1]);
+    if (lo < 0)
+      return false;
+    out[i] = (hi << 4) | lo;
+  }
+  return true;
+}
+
+static bool unescape(std::string &name)
+{
+  std::string out;
+  for (size_t i = 0; i < name.size(); i++)
+  {
+    if (name[i] != '\\')
+    {
+      out += name[i];
+      continue;
+    }
+    if (++i == name.size())
+      return false;
+    switch (name[i])
+    {
+      case '\\':
+        out += '\\';
+        break;
+      case 'n':
+        out += '\n';
+        break;
+      case 'r':
+        out += '\r';
+        break;
+      default:
+        return false;
+    }
+  }
+  name.swap(out);
+  return true;
+}
+
+static bool parse_line(const char *s, size_t len, std::string &name, uint8_t expected[32])
+{
+  size_t i = 0;
+  while (i < len && (s[i] == ' ' || s[i] == '\t')) i++;
+  bool escaped = i < len && s[i] == '\\';
+  i += escaped;
+
+  if (len - i > 6 && memcmp(s + i, "SHA256", 6) == 0)
+  {
+    size_t j = i + 6;
+    j += s[j] == ' ';
+    if (j < len && s[j] == '(')
+    {
+      size_t close = len;
+      while (close > j && s[close - 1] != ')') close--;
+      if (close > j + 1)
+      {
+        size_t k = close;
+        while (k < len && (s[k] == ' ' || s[k] == '\t')) k++;
+        if (k < len && s[k] == '=')
+        {
+          k++;
+          while (k < len && (s[k] == ' ' || s[k] == '\t')) k++;
+          if (len - k == 64 && parse_hex(s + k, expected))
+          {
+            name.assign(s + j + 1, close - 1 - (j + 1));
+            return !escaped || unescape(name);
+          }
+        }
+      }
+    }
+  }
+
+  if (len - i < 66 || !parse_hex(s + i, expected) || (s[i + 64] != ' ' && s[i + 64] != '\t'))
+    return false;
+  i += 65;
+  if (len - i == 1 || (s[i] != ' ' && s[i] != '*'))
+  {
+    // "hash name" with a single separator, as written by BSD md5 -r; never mixed with the GNU form.
+    if (bsd_reversed == 0)
+      return false;
+    bsd_reversed = 1;
+  }
+  else if (bsd_reversed != 1)
+  {
+    bsd_reversed = 0;
+    i++;
+  }
+  if (i >= len)
+    return false;
+  name.assign(s + i, len - i);
+  return !escaped || unescape(name);
+}
+
+/* Output helpers: coreutils' quotef() for diagnostics and the escaped form for names containing newlines. */
+
+static std::string quotef(const std::string &name)
+{
+  bool plain = !name.empty();
+  bool control = false;
+  for (unsigned char c : name)
+  {
+    if (!isalnum(c) && !strchr("%+,-./:=@^_", c))
+      plain = false;
+    if (c < 0x20 || c == 0x7f)
+      control = true;
+  }
+  if (plain)
+    return name;
+
+  std::string out;
+  if (!control && name.find('\'') != std::string::npos && name.find_first_of("\"$`\\") == std::string::npos)
+    return "\"" + name + "\"";
+  out = "'";
+  for (unsigned char c : name)
+  {
+    if (c < 0x20 || c == 0x7f)
+    {
+      static const char *names = "\a\b\t\n\v\f\r";
+      static const char *codes = "abtnvfr";
+      const char *p = c ? strchr(names, c) : nullptr;
+      char buf[8];
+      if (p)
+        snprintf(buf, sizeof(buf), "\\%c", codes[p - names]);
+      else
+        snprintf(buf, sizeof(buf), "\\%03o", c);
+      out += "'$'";
+      out += buf;
+      out += "''";
+    }
+    else if (c == '\'')
+      out += "'\\''";
+    else
+      out += (char)c;
+  }
+  out += "'";
+  return out;
+}
+
+static void print_name(const std::string &name)
+{
+  if (name.find_first_of("\n\r") == std::string::npos)
+  {
+    fwrite(name.data(), 1, name.size(), stdout);
+    return;
+  }
+  putchar('\\');
+  for (char c : name)
+  {
+    if (c == '\\')
+      fputs("\\\\", stdout);
+    else if (c == '\n')
+      fputs("\\n", stdout);
+    else if (c == '\r')
+      fputs("\\r", stdout);
+    else
+      putchar(c);
+  }
+}
+
+static void diagnostic(const std::string &msg)
+{
+  fflush(stdout);
+  fprintf(stderr, "%s: %s\n", program_name, msg.c_str());
+}
+
+/* Verification. */
+
+static void verify_stream(Entry &e, const Options &opt, const PoolBuffer &buf)
+{
+  int fd = e.name == "-" ? STDIN_FILENO : open(e.name.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    e.error = errno;
+    e.status = opt.ignore_missing && errno == ENOENT ? SKIPPED : READ_FAILED;
+    return;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  libsha256_ctx ctx;
+  ssize_t n;
+  libsha256_init(&ctx);
+  while ((n = read(fd, buf.data(), buf.size())) > 0) libsha256_update(&ctx, buf.data(), n);
+  int err = n < 0 ? errno : 0;
+  if (fd != STDIN_FILENO)
+    close(fd);
+  if (err)
+  {
+    e.error = err;
+    e.status = READ_FAILED;
+    return;
+  }
+
+  uint8_t digest[32];
+  libsha256_final(&ctx, digest);
+  e.status = memcmp(digest, e.expected, 32) == 0 ? MATCHED : MISMATCHED;
+}
+
+// Reads a group of small regular files whole and hashes the readable ones together in one batch.
+static void verify_small(Entry **batch, int count, const Options &opt, std::vector<uint8_t> lane_buf[MAX_GROUP])
+{
+  const void *msg[MAX_GROUP];
+  size_t lens[MAX_GROUP];
+  uint8_t out[MAX_GROUP][32];
+  int lanes = 0;
+  Entry *owner[MAX_GROUP];
+
+  for (int i = 0; i < count; i++)
+  {
+    Entry &e = *batch[i];
+    int fd = open(e.name.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      e.error = errno;
+      e.status = opt.ignore_missing && errno == ENOENT ? SKIPPED : READ_FAILED;
+      continue;
+    }
+
+    // The size came from stat(); keep reading in case the file grew since then.
+    std::vector<uint8_t> &buf = lane_buf[lanes];
+    size_t len = 0;
+    ssize_t n;
+    buf.resize(e.size + 64);
+    while ((n = read(fd, buf.data() + len, buf.size() - len)) > 0)
+    {
+      len += n;
+      if (buf.size() == len)
+        buf.resize(buf.size() * 2);
+    }
+    int err = n < 0 ? errno : 0;
+    close(fd);
+    if (err)
+    {
+      e.error = err;
+      e.status = READ_FAILED;
+      continue;
+    }
+
+    msg[lanes] = buf.data();
+    lens[lanes] = len;
+    owner[lanes++] = &e;
+  }
+
+  if (!lanes)
+    return;
+  libsha256_batch(msg, lens, lanes, out);
+  for (int i = 0; i < lanes; i++) owner[i]->status = memcmp(out[i], owner[i]->expected, 32) == 0 ? MATCHED : MISMATCHED;
+}
+
+template <typename Fn>
+static void parallel_for(unsigned num_threads, size_t n, Fn fn)
+{
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < num_threads; ++t)
+    threads.emplace_back(
+        [&]()
+        {
+          for (size_t i; (i = next++) < n;) fn(i);
+        });
+  for (auto &t : threads) t.join();
+}
+
+static bool check_manifest(const char *manifest, const Options &opt)
+{
+  std::string display = strcmp(manifest, "-") == 0 ? "standard input" : manifest;
+  FILE *fp = strcmp(manifest, "-") == 0 ? stdin : fopen(manifest, "r");
+  if (!fp)
+  {
+    diagnostic(quotef(display) + ": " + strerror(errno));
+    return false;
+  }
+
+  std::deque<Entry> entries;
+  size_t misformatted = 0;
+  char *line = nullptr;
+  size_t cap = 0;
+  ssize_t len;
+  for (size_t line_no = 1; (len = getline(&line, &cap, fp)) > 0; line_no++)
+  {
+    if (line[0] == '#')
+      continue;
+    len -= line[len - 1] == '\n';
+    len -= len > 0 && line[len - 1] == '\r';
+    if (len == 0)
+      continue;
+
+    std::string name;
+    uint8_t expected[32];
+    if (memchr(line, '\0', len) || !parse_line(line, len, name, expected))
+    {
+      misformatted++;
+      if (opt.warn)
+        diagnostic(quotef(display) + ": " + std::to_string(line_no) + ": improperly formatted SHA256 checksum line");
+      continue;
+    }
+    entries.emplace_back();
+    entries.back().name.swap(name);
+    memcpy(entries.back().expected, expected, 32);
+  }
+  bool read_error = ferror(fp);
+  int read_errno = errno;
+  free(line);
+  if (fp != stdin)
+    fclose(fp);
+  if (read_error)
+  {
+    diagnostic(quotef(display) + ": " + strerror(read_errno));
+    return false;
+  }
+
+  std::string backend = apply_profile_backend(opt.profile);
+  unsigned num_threads = opt.threads ? opt.threads : profile_workers(opt.profile, backend);
+  size_t group = group_size();
+  BufferPool::get().set_hugepages(opt.profile.hugepages);
+
+  parallel_for(num_threads, entries.size(),
+               [&](size_t i)
+               {
+                 struct stat st;
+                 Entry &e = entries[i];
+                 if (e.name != "-" && stat(e.name.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+                 {
+                   e.size = st.st_size;
+                   e.regular = true;
+                 }
+               });
+
+  // Largest first; the small tail is grouped a batch at a time for the SIMD lanes.
+  std::vector<Entry *> order;
+  for (auto &e : entries) order.push_back(&e);
+  std::stable_sort(order.begin(), order.end(), [](const Entry *a, const Entry *b) { return a->size > b->size; });
+  struct Task
+  {
+    size_t begin, count;
+  };
+  std::vector<Task> tasks;
+  for (size_t i = 0; i < order.size();)
+  {
+    size_t count = 1;
+    if (order[i]->regular && (size_t)order[i]->size <= opt.small_max)
+      while (count < group && i + count < order.size() && order[i + count]->regular) count++;
+    tasks.push_back({i, count});
+    i += count;
+  }
+
+  std::mutex mu;
+  std::condition_variable cv;
+  std::atomic<size_t> failures{0};
+  std::atomic<bool> stop{false};
+  std::atomic<unsigned> running{num_threads};
+  std::atomic<size_t> next_task{0};
+  std::vector<std::thread> workers;
+
+  for (unsigned t = 0; t < num_threads; ++t)
+    workers.emplace_back(
+        [&, t]()
+        {
+          apply_profile_placement(opt.profile, t, backend);
+          PoolBuffer stream_buf(std::min(opt.profile.chunk, BufferPool::MAX_CLASS));
+          std::vector<uint8_t> lane_buf[MAX_GROUP];
+          for (size_t k; !stop && (k = next_task++) < tasks.size();)
+          {
+            Entry **batch = &order[tasks[k].begin];
+            if (tasks[k].count == 1 && !((*batch)->regular && (size_t)(*batch)->size <= opt.small_max))
+              verify_stream(**batch, opt, stream_buf);
+            else
+              verify_small(batch, tasks[k].count, opt, lane_buf);
+
+            for (size_t i = 0; i < tasks[k].count; i++)
+              if (batch[i]->status == MISMATCHED && opt.max_failures && ++failures >= opt.max_failures)
+                stop = true;
+            std::lock_guard<std::mutex> lock(mu);
+            cv.notify_one();
+          }
+          std::lock_guard<std::mutex> lock(mu);
+          running--;
+          cv.notify_one();
+        });
+
+  size_t matched = 0, mismatched = 0, unreadable = 0;
+  for (size_t i = 0; i < entries.size(); i++)
+  {
+    Entry &e = entries[i];
+    {
+      std::unique_lock<std::mutex> lock(mu);
+      cv.wait(lock, [&]() { return e.status != PENDING || running == 0; });
+    }
+    switch (e.status)
+    {
+      case PENDING:
+      case SKIPPED:
+        break;
+      case MATCHED:
+        matched++;
+        if (!opt.status_only && !opt.quiet)
+        {
+          print_name(e.name);
+          fputs(": OK\n", stdout);
+        }
+        break;
+      case MISMATCHED:
+        mismatched++;
+        if (!opt.status_only)
+        {
+          print_name(e.name);
+          fputs(": FAILED\n", stdout);
+        }
+        break;
+      case READ_FAILED:
+        unreadable++;
+        diagnostic(quotef(e.name) + ": " + strerror(e.error));
+        if (!opt.status_only)
+        {
+          print_name(e.name);
+          fputs(": FAILED open or read\n", stdout);
+        }
+        break;
+    }
+  }
+  for (auto &t : workers) t.join();
+
+  if (stop)
+    diagnostic(quotef(display) + ": stopped early after " + std::to_string(opt.max_failures) + " mismatched checksums");
+
+  if (entries.empty())
+  {
+    diagnostic(quotef(display) + ": no properly formatted checksum lines found");
+    return false;
+  }
+  if (!opt.status_only)
+  {
+    if (misformatted)
+      diagnostic("WARNING: " + std::to_string(misformatted) +
+                 (misformatted == 1 ? " line is improperly formatted" : " lines are improperly formatted"));
+    if (unreadable)
+      diagnostic("WARNING: " + std::to_string(unreadable) +
+                 (unreadable == 1 ? " listed file could not be read" : " listed files could not be read"));
+    if (mismatched)
+      diagnostic("WARNING: " + std::to_string(mismatched) +
+                 (mismatched == 1 ? " computed checksum did NOT match" : " computed checksums did NOT match"));
+    if (opt.ignore_missing && !matched)
+      diagnostic(quotef(display) + ": no file was verified");
+  }
+  return matched && !mismatched && !unreadable && !stop && (!opt.strict || !misformatted);
+}
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  std::vector<const char *> manifests;
+  program_name = argv[0];
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "-c" || arg == "--check")
+      continue;
+    else if (arg == "--quiet")
+      opt.quiet = true;
+    else if (arg == "--status")
+      opt.status_only = true;
+    else if (arg == "--strict")
+      opt.strict = true;
+    else if (arg == "-w" || arg == "--warn")
+      opt.warn = true;
+    else if (arg == "--ignore-missing")
+      opt.ignore_missing = true;
+    else if ((arg == "-j" || arg == "--threads") && i + 1 < argc)
+      opt.threads = atoi(argv[++i]);
+    else if (arg == "--max-failures" && i + 1 < argc)
+      opt.max_failures = strtoull(argv[++i], nullptr, 10);
+    else if (arg == "--small-max" && i + 1 < argc)
+      opt.small_max = strtoull(argv[++i], nullptr, 10);
+    else if (arg == "-b" || arg == "--binary" || arg == "-t" || arg == "--text")
+      continue;
+    else
+      manifests.push_back(argv[i]);
+  }
+  if (manifests.empty())
+    manifests.push_back("-");
+
+  bool ok = true;
+  for (const char *m : manifests) ok &= check_manifest(m, opt);
+  fflush(stdout);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,540 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_daemon.h"
+#include "sha256_profile.h"
+#include "sha256_telemetry.h"
+
+/*
+  Local hashing daemon.
+
+  Clients (see sha256_daemon.h) hand the daemon a shared-memory ring once and then only ring a doorbell byte per
+  submission, so message bytes never pass through the socket. One dispatcher thread collects submitted slots from
+  every client into a single FIFO and hashes it with libsha256_batch() a full set of lanes at a time. A partial batch
+  waits at most --max-wait-us for company before it is hashed anyway; 0 hashes whatever the last round of doorbells
+  brought in. Digests go straight back into the clients' slots.
+
+  --serve runs the daemon on the socket. --bench runs it in-process and forks 1, 2, 4 ... clients against it, each
+  hashing a short message in a closed loop, and reports throughput and client-side p50/p99 latency next to the same
+  clients hashing for themselves.
+
+  --metrics-port serves live counters, per-request latency histograms, queue depth and CPU utilization on
+  http://127.0.0.1:PORT/metrics (Prometheus) and /metrics.json; --metrics-json appends a snapshot to a file every
+  --metrics-interval seconds. See sha256_telemetry.h.
+*/
+
+static uint64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class Daemon
+{
+public:
+  std::atomic<uint64_t> hashed{0}, batches{0};
+
+  Daemon(const std::string &path, unsigned max_wait_us)
+      : path(path), max_wait_ns(max_wait_us * 1000ULL), width(std::min<size_t>(16, std::max<size_t>(8, libsha256_batch_lanes()))),
+        backend(Telemetry::backend_index(libsha256_backend_name()))
+  {
+  }
+
+  ~Daemon()
+  {
+    if (listen_fd >= 0)
+    {
+      close(listen_fd);
+      unlink(path.c_str());
+    }
+    if (epoll_fd >= 0)
+      close(epoll_fd);
+  }
+
+  size_t batch_width() const { return width; }
+
+  bool listen()
+  {
+    sockaddr_un addr;
+    listen_fd = unix_socket(path, addr);
+    if (listen_fd < 0)
+      return false;
+    unlink(path.c_str());
+    if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) != 0 || ::listen(listen_fd, 128) != 0)
+      return false;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev = {EPOLLIN, {.fd = listen_fd}};
+    return epoll_fd >= 0 && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) == 0;
+  }
+
+  void run(const std::atomic<bool> &stop)
+  {
+    epoll_event events[64];
+    while (!stop.load(std::memory_order_relaxed))
+    {
+      // Wait for doorbells, or until the oldest pending request has waited long enough; poll at least every 100 ms
+      // for the stop flag.
+      uint64_t wait_ns = 100000000;
+      if (!pending.empty())
+      {
+        uint64_t age = now_ns() - pending.front().arrival;
+        wait_ns = age >= max_wait_ns ? 0 : max_wait_ns - age;
+      }
+      timespec ts = {(time_t)(wait_ns / 1000000000), (long)(wait_ns % 1000000000)};
+      int n = epoll_pwait2(epoll_fd, events, 64, &ts, nullptr);
+      // Take everything that is already ready before deciding what to hash.
+      while (n > 0)
+      {
+        for (int i = 0; i < n; i++)
+        {
+          if (events[i].data.fd == listen_fd)
+            accept_client();
+          else
+            on_client(events[i].data.fd);
+        }
+        n = n == 64 ? epoll_wait(epoll_fd, events, 64, 0) : 0;
+      }
+
+      while (pending.size() >= width) hash_batch(width);
+      if (!pending.empty() && now_ns() - pending.front().arrival >= max_wait_ns)
+        hash_batch(pending.size());
+      Telemetry::get().set_queue_depth(pending.size());
+    }
+  }
+
+private:
+  struct Client
+  {
+    int fd = -1;
+    DaemonRing *ring = nullptr;
+    bool alive = true;
+    bool queued[RING_SLOTS] = {};
+
+    ~Client()
+    {
+      if (ring)
+        munmap(ring, sizeof(DaemonRing));
+    }
+  };
+
+  struct Pending
+  {
+    std::shared_ptr<Client> client;
+    uint32_t slot;
+    uint64_t arrival;
+  };
+
+  void accept_client()
+  {
+    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0)
+      return;
+    auto c = std::make_shared<Client>();
+    c->fd = fd;
+    clients[fd] = c;
+    epoll_event ev = {EPOLLIN | EPOLLRDHUP, {.fd = fd}};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  }
+
+  void drop_client(int fd)
+  {
+    auto it = clients.find(fd);
+    if (it == clients.end())
+      return;
+    // Pending requests keep the mapping alive through their shared_ptr; they are skipped when their batch comes.
+    it->second->alive = false;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    clients.erase(it);
+  }
+
+  // The first message carries the ring's memfd; check it is sealed against shrinking (or the client could truncate it
+  // under the daemon and fault it with SIGBUS), big enough and really a ring before mapping it for good.
+  bool attach_ring(Client &c)
+  {
+    char byte;
+    iovec iov = {&byte, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(c.fd, &msg, MSG_CMSG_CLOEXEC) != 1)
+      return false;
+    cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    if (!cm || cm->cmsg_type != SCM_RIGHTS || cm->cmsg_len != CMSG_LEN(sizeof(int)))
+      return false;
+    int mem;
+    memcpy(&mem, CMSG_DATA(cm), sizeof(int));
+    struct stat st;
+    void *p = MAP_FAILED;
+    int seals = fcntl(mem, F_GET_SEALS);
+    if (seals >= 0 && (seals & F_SEAL_SHRINK) && fstat(mem, &st) == 0 && (size_t)st.st_size >= sizeof(DaemonRing))
+      p = mmap(nullptr, sizeof(DaemonRing), PROT_READ | PROT_WRITE, MAP_SHARED, mem, 0);
+    close(mem);
+    if (p == MAP_FAILED)
+      return false;
+    c.ring = (DaemonRing *)p;
+    return c.ring->magic == RING_MAGIC && c.ring->slots == RING_SLOTS;
+  }
+
+  void on_client(int fd)
+  {
+    auto it = clients.find(fd);
+    if (it == clients.end())
+      return;
+    Client &c = *it->second;
+    if (!c.ring)
+    {
+      if (!attach_ring(c))
+        drop_client(fd);
+      return;
+    }
+
+    char bell[256];
+    ssize_t r;
+    while ((r = read(fd, bell, sizeof(bell))) == (ssize_t)sizeof(bell))
+      ;
+    if (r == 0 || (r < 0 && errno != EAGAIN))
+    {
+      drop_client(fd);
+      return;
+    }
+
+    uint64_t t = now_ns();
+    for (uint32_t s = 0; s < RING_SLOTS; s++)
+    {
+      uint32_t st = c.ring->slot[s].state.load(std::memory_order_acquire);
+      if ((st == SLOT_SUBMITTED || st == SLOT_WAITING) && !c.queued[s])
+      {
+        c.queued[s] = true;
+        pending.push_back({it->second, s, t});
+      }
+    }
+  }
+
+  void hash_batch(size_t n)
+  {
+    const void *msgs[16];
+    size_t lens[16];
+    uint8_t digests[16][32];
+    Pending taken[16];
+    size_t k = 0;
+
+    while (k < n && !pending.empty())
+    {
+      Pending p = std::move(pending.front());
+      pending.pop_front();
+      if (!p.client->alive)
+        continue;
+      DaemonSlot &slot = p.client->ring->slot[p.slot];
+      msgs[k] = slot.data;
+      lens[k] = std::min<uint32_t>(slot.len, SLOT_MSG_MAX);  // the client owns this memory; never trust the length
+      taken[k++] = std::move(p);
+    }
+    if (!k)
+      return;
+    libsha256_batch(msgs, lens, k, digests);
+
+    uint64_t done = now_ns();
+    for (size_t i = 0; i < k; i++)
+    {
+      Telemetry::get().record(backend, lens[i], done - taken[i].arrival);
+      DaemonSlot &slot = taken[i].client->ring->slot[taken[i].slot];
+      memcpy(slot.digest, digests[i], 32);
+      taken[i].client->queued[taken[i].slot] = false;
+      if (slot.state.exchange(SLOT_DONE, std::memory_order_acq_rel) == SLOT_WAITING)
+        futex_wake(&slot.state);
+    }
+    hashed += k;
+    batches++;
+  }
+
+  std::string path;
+  uint64_t max_wait_ns;
+  size_t width;
+  int backend;
+  int listen_fd = -1, epoll_fd = -1;
+  std::map<int, std::shared_ptr<Client>> clients;
+  std::deque<Pending> pending;
+};
+
+/* Benchmark. */
+
+struct ClientReport
+{
+  uint64_t requests = 0;
+  uint64_t errors = 0;
+  std::vector<uint32_t> latency_ns;
+};
+
+static const size_t MAX_SAMPLES = 1 << 20;
+
+// One forked client: `depth` requests in flight, refilled as a group, until the deadline.
+static void client_main(int out, int id, bool direct, const std::string &path, size_t len, unsigned depth, uint64_t deadline)
+{
+  ClientReport rep;
+  std::vector<uint8_t> msg(len);
+  for (size_t i = 0; i < len; i++) msg[i] = id * 31 + i;
+  uint8_t expected[32], digest[32];
+  libsha256(msg.data(), len, expected);
+
+  HashClient client;
+  if (!direct && !client.connect(path))
+    rep.errors++;
+  else
+    while (now_ns() < deadline)
+    {
+      uint64_t t0 = now_ns();
+      int slots[RING_SLOTS];
+      for (unsigned d = 0; d < depth; d++)
+      {
+        if (direct)
+        {
+          libsha256(msg.data(), len, digest);
+          rep.errors += memcmp(digest, expected, 32) != 0;
+        }
+        else
+          slots[d] = client.submit(msg.data(), len);
+      }
+      if (!direct)
+      {
+        client.doorbell();
+        bool alive = true;
+        for (unsigned d = 0; d < depth && alive; d++)
+        {
+          alive = client.wait(slots[d], digest);
+          rep.errors += !alive || memcmp(digest, expected, 32) != 0;
+        }
+        if (!alive)
+          break;
+      }
+      uint32_t lat = std::min<uint64_t>(now_ns() - t0, UINT32_MAX);
+      for (unsigned d = 0; d < depth && rep.latency_ns.size() < MAX_SAMPLES; d++) rep.latency_ns.push_back(lat);
+      rep.requests += depth;
+    }
+
+  uint64_t header[3] = {rep.requests, rep.errors, rep.latency_ns.size()};
+  if (write(out, header, sizeof(header)) != sizeof(header) ||
+      write(out, rep.latency_ns.data(), rep.latency_ns.size() * 4) != (ssize_t)(rep.latency_ns.size() * 4))
+    _exit(1);
+  _exit(0);
+}
+
+static bool read_full(int fd, void *buf, size_t n)
+{
+  uint8_t *p = (uint8_t *)buf;
+  while (n)
+  {
+    ssize_t r = read(fd, p, n);
+    if (r <= 0)
+      return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+struct RoundResult
+{
+  double rate;  // hashes per second
+  double p50_us, p99_us;
+  uint64_t errors;
+};
+
+static RoundResult run_round(unsigned clients, bool direct, const std::string &path, size_t len, unsigned depth, double seconds)
+{
+  uint64_t start = now_ns(), deadline = start + (uint64_t)(seconds * 1e9);
+  std::vector<int> pipes;
+  std::vector<pid_t> pids;
+  for (unsigned i = 0; i < clients; i++)
+  {
+    int fds[2];
+    if (pipe(fds) != 0)
+      break;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+      close(fds[0]);
+      client_main(fds[1], i, direct, path, len, depth, deadline);
+    }
+    close(fds[1]);
+    pipes.push_back(fds[0]);
+    pids.push_back(pid);
+  }
+
+  RoundResult res = {0, 0, 0, 0};
+  uint64_t requests = 0;
+  std::vector<uint32_t> all;
+  for (int fd : pipes)
+  {
+    uint64_t header[3];
+    if (read_full(fd, header, sizeof(header)))
+    {
+      size_t base = all.size();
+      all.resize(base + header[2]);
+      if (!read_full(fd, all.data() + base, header[2] * 4))
+        all.resize(base);
+      requests += header[0];
+      res.errors += header[1];
+    }
+    else
+      res.errors++;
+    close(fd);
+  }
+  for (pid_t pid : pids) waitpid(pid, nullptr, 0);
+
+  res.rate = requests / ((now_ns() - start) / 1e9);
+  if (!all.empty())
+  {
+    std::sort(all.begin(), all.end());
+    res.p50_us = all[all.size() / 2] / 1e3;
+    res.p99_us = all[std::min(all.size() - 1, all.size() * 99 / 100)] / 1e3;
+  }
+  return res;
+}
+
+static std::vector<unsigned> parse_counts(const char *s)
+{
+  std::vector<unsigned> counts;
+  for (char *end; *s; s = *end ? end + 1 : end)
+  {
+    unsigned v = strtoul(s, &end, 10);
+    if (v)
+      counts.push_back(v);
+    if (end == s)
+      break;
+  }
+  return counts;
+}
+
+static volatile sig_atomic_t interrupted = 0;
+
+int main(int argc, char **argv)
+{
+  std::string path = daemon_socket_path();
+  unsigned max_wait_us = 50, depth = 1, metrics_port = 0;
+  size_t len = 64;
+  double seconds = 2, metrics_interval = 1;
+  std::string metrics_json;
+  bool serve = false, bench = false;
+  std::vector<unsigned> counts = {1, 2, 4, 8, 16, 32};
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--serve")
+      serve = true;
+    else if (arg == "--bench")
+      bench = true;
+    else if (arg == "--socket" && i + 1 < argc)
+      path = argv[++i];
+    else if (arg == "--max-wait-us" && i + 1 < argc)
+      max_wait_us = atoi(argv[++i]);
+    else if (arg == "--clients" && i + 1 < argc)
+      counts = parse_counts(argv[++i]);
+    else if (arg == "--depth" && i + 1 < argc)
+      depth = std::min<unsigned>(RING_SLOTS, std::max(1, atoi(argv[++i])));
+    else if (arg == "--len" && i + 1 < argc)
+      len = std::min<size_t>(SLOT_MSG_MAX, atol(argv[++i]));
+    else if (arg == "--seconds" && i + 1 < argc)
+      seconds = std::max(0.1, atof(argv[++i]));
+    else if (arg == "--metrics-port" && i + 1 < argc)
+      metrics_port = atoi(argv[++i]);
+    else if (arg == "--metrics-json" && i + 1 < argc)
+      metrics_json = argv[++i];
+    else if (arg == "--metrics-interval" && i + 1 < argc)
+      metrics_interval = atof(argv[++i]);
+    else
+    {
+      serve = bench = false;
+      break;
+    }
+  }
+  if (serve == bench)
+  {
+    fprintf(stderr,
+            "usage: %s --serve [--socket PATH] [--max-wait-us N] [METRICS]\n"
+            "       %s --bench [--clients 1,2,4,...] [--depth N] [--len BYTES] [--seconds S] [--max-wait-us N] [METRICS]\n"
+            "METRICS: [--metrics-port PORT] [--metrics-json FILE] [--metrics-interval S]\n",
+            argv[0], argv[0]);
+    return 1;
+  }
+
+  std::string backend = apply_profile_backend(load_profile());
+  if (bench)
+    path += "." + std::to_string(getpid());
+  Daemon daemon(path, max_wait_us);
+  if (!daemon.listen())
+  {
+    fprintf(stderr, "could not listen on %s: %s\n", path.c_str(), strerror(errno));
+    return 1;
+  }
+  printf("Daemon on %s: backend %s, %zu messages per batch, max wait %u us\n", path.c_str(), backend.c_str(), daemon.batch_width(),
+         max_wait_us);
+  TelemetryExporter exporter(metrics_port, metrics_json, metrics_interval);
+  if ((metrics_port || !metrics_json.empty()) && !exporter.start())
+  {
+    fprintf(stderr, "could not start metrics (port %u, file %s): %s\n", metrics_port, metrics_json.c_str(), strerror(errno));
+    return 1;
+  }
+  if (metrics_port)
+    printf("Metrics on http://127.0.0.1:%u/metrics and /metrics.json\n", metrics_port);
+
+  std::atomic<bool> stop{false};
+  if (serve)
+  {
+    struct sigaction sa = {};
+    sa.sa_handler = [](int) { interrupted = 1; };
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    std::thread watcher(
+        [&]()
+        {
+          while (!interrupted) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+          stop = true;
+        });
+    daemon.run(stop);
+    watcher.join();
+    printf("Hashed %llu messages in %llu batches\n", (unsigned long long)daemon.hashed.load(), (unsigned long long)daemon.batches.load());
+    return 0;
+  }
+
+  std::thread dispatcher([&]() { daemon.run(stop); });
+  printf("%zu-byte messages, %u in flight per client, %.1f s per round\n\n", len, depth, seconds);
+  printf("%7s %12s %12s %9s %9s %10s\n", "clients", "direct kH/s", "daemon kH/s", "p50 us", "p99 us", "batch fill");
+  uint64_t errors = 0;
+  for (unsigned n : counts)
+  {
+    RoundResult direct = run_round(n, true, path, len, depth, seconds);
+    uint64_t h0 = daemon.hashed, b0 = daemon.batches;
+    RoundResult served = run_round(n, false, path, len, depth, seconds);
+    uint64_t h = daemon.hashed - h0, b = daemon.batches - b0;
+    double fill = b ? (double)h / b / daemon.batch_width() : 0;
+    printf("%7u %12.1f %12.1f %9.1f %9.1f %9.0f%%\n", n, direct.rate / 1e3, served.rate / 1e3, served.p50_us, served.p99_us, 100 * fill);
+    errors += direct.errors + served.errors;
+  }
+  stop = true;
+  dispatcher.join();
+  if (errors)
+    printf("\n%llu requests failed or returned a wrong digest\n", (unsigned long long)errors);
+  return errors ? 1 : 0;
+}
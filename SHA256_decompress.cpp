@@ -0,0 +1,456 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_pool.h"
+#include "sha256_profile.h"
+#include "sha256_util.h"
+
+/*
+  Pipelined decompress-and-hash for gzip and zstd archives: the SHA-256 of the compressed file and of its decompressed
+  content from one read, without materialising the content.
+
+    reader ──► compressed buffers ──┬──► hash compressed
+                                    └──► decompress ──► content buffers ──► hash content
+
+  Each stage is its own thread. Stages are joined by bounded queues over fixed rings of pool buffers (--depth buffers
+  of --buffer bytes per ring), so memory stays constant whatever the archive's size or compression ratio. A compressed
+  buffer goes back to the reader once both the compressed hasher and the decompressor are done with it.
+
+  Every stage times the work it does, apart from waiting on its queues, so the report gives each stage's own GB/s and
+  names the slowest as the bottleneck. gzip (including multi-member files) is always built; zstd needs libzstd at
+  build time (the makefile detects it).
+*/
+
+struct Buffer
+{
+  explicit Buffer(size_t bytes) : mem(bytes) {}
+  PoolBuffer mem;
+  size_t len = 0;
+  std::atomic<int> refs{0};
+};
+
+// Blocking FIFO; pop() returns nullptr once the queue is closed and drained. Capacity is bounded by the buffer rings
+// feeding it, so push() never has to wait.
+class Queue
+{
+public:
+  void push(Buffer *b)
+  {
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      items.push_back(b);
+    }
+    cv.notify_one();
+  }
+
+  Buffer *pop()
+  {
+    std::unique_lock<std::mutex> lk(mu);
+    cv.wait(lk, [&]() { return closed || !items.empty(); });
+    if (items.empty())
+      return nullptr;
+    Buffer *b = items.front();
+    items.pop_front();
+    return b;
+  }
+
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      closed = true;
+    }
+    cv.notify_all();
+  }
+
+private:
+  std::mutex mu;
+  std::condition_variable cv;
+  std::deque<Buffer *> items;
+  bool closed = false;
+};
+
+// A fixed set of buffers; get() waits for one to be returned, which is what bounds every queue downstream.
+class Ring
+{
+public:
+  Ring(size_t count, size_t bytes)
+  {
+    for (size_t i = 0; i < count; i++) buffers.emplace_back(bytes);
+    for (Buffer &b : buffers) free.push(&b);
+  }
+
+  // Only one thread takes from a given ring, so the time it spends waiting here can be kept without a lock.
+  Buffer *get()
+  {
+    double t = now_s();
+    Buffer *b = free.pop();
+    waited += now_s() - t;
+    return b;
+  }
+  void put(Buffer *b) { free.push(b); }
+
+  void release(Buffer *b)
+  {
+    if (b->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      put(b);
+  }
+
+  double waited = 0;  // seconds spent in get()
+
+private:
+  std::deque<Buffer> buffers;
+  Queue free;
+};
+
+struct Stage
+{
+  const char *name;
+  uint64_t bytes = 0;
+  double busy = 0;  // seconds spent working, queue waits excluded
+};
+
+/*
+  Decompressors. feed() consumes one compressed buffer into `out`, handing each full output buffer to `next` and
+  taking a fresh one from `ring`; a partly filled `out` carries over to the next call.
+*/
+
+class Decompressor
+{
+public:
+  virtual ~Decompressor() = default;
+  virtual bool feed(const uint8_t *in, size_t len, Buffer *&out, Ring &ring, Queue &next) = 0;
+  virtual bool finished() const = 0;
+  virtual bool ready() const = 0;  // false if the library could not set up its stream
+};
+
+class Gunzip : public Decompressor
+{
+public:
+  Gunzip()
+  {
+    memset(&z, 0, sizeof(z));
+    init = inflateInit2(&z, 15 + 16);
+  }
+  ~Gunzip()
+  {
+    if (init == Z_OK)
+      inflateEnd(&z);
+  }
+
+  bool feed(const uint8_t *in, size_t len, Buffer *&out, Ring &ring, Queue &next) override
+  {
+    z.next_in = const_cast<uint8_t *>(in);
+    z.avail_in = len;
+    bool full = false;
+    // A full output buffer may hide more output for the same input, so go round again after swapping it out.
+    while (z.avail_in || full)
+    {
+      if (ended && z.avail_in)
+      {
+        // Another gzip member follows; gzip -d concatenates their contents.
+        inflateReset(&z);
+        ended = false;
+      }
+      z.next_out = out->mem.data() + out->len;
+      z.avail_out = out->mem.size() - out->len;
+      int r = inflate(&z, Z_NO_FLUSH);
+      out->len = out->mem.size() - z.avail_out;
+      if (r == Z_STREAM_END)
+        ended = true;
+      else if (r != Z_OK && r != Z_BUF_ERROR)
+        return false;
+      full = out->len == out->mem.size();
+      if (full)
+      {
+        next.push(out);
+        out = ring.get();
+        out->len = 0;
+      }
+      else if (r == Z_BUF_ERROR)
+        break;
+    }
+    return true;
+  }
+
+  bool finished() const override { return ended; }
+  bool ready() const override { return init == Z_OK; }
+
+private:
+  z_stream z;
+  int init;
+  bool ended = false;
+};
+
+#ifdef HAVE_ZSTD
+class Unzstd : public Decompressor
+{
+public:
+  Unzstd() : d(ZSTD_createDStream()), init(d ? ZSTD_initDStream(d) : 0) {}
+  ~Unzstd() { ZSTD_freeDStream(d); }
+
+  bool feed(const uint8_t *in, size_t len, Buffer *&out, Ring &ring, Queue &next) override
+  {
+    ZSTD_inBuffer src = {in, len, 0};
+    // As with gzip, a full output buffer may hide more output for the same input.
+    while (src.pos < src.size || more)
+    {
+      ZSTD_outBuffer dst = {out->mem.data(), out->mem.size(), out->len};
+      size_t r = ZSTD_decompressStream(d, &dst, &src);
+      if (ZSTD_isError(r))
+        return false;
+      out->len = dst.pos;
+      last = r;
+      more = out->len == out->mem.size();
+      if (more)
+      {
+        next.push(out);
+        out = ring.get();
+        out->len = 0;
+      }
+      else if (src.pos == src.size)
+        break;
+    }
+    return true;
+  }
+
+  bool finished() const override { return last == 0; }
+  bool ready() const override { return d && !ZSTD_isError(init); }
+
+private:
+  ZSTD_DStream *d;
+  size_t init;
+  size_t last = 1;
+  bool more = false;
+};
+#endif
+
+struct Result
+{
+  uint8_t compressed[32], content[32];
+  Stage read = {"read"}, hash_in = {"hash compressed"}, inflate = {"decompress"}, hash_out = {"hash content"};
+  double seconds = 0;
+  std::string error;
+};
+
+static Result run(int fd, Decompressor &dec, size_t buffer, unsigned depth)
+{
+  Result res;
+  Ring in_ring(depth, buffer), out_ring(depth, buffer);
+  Queue to_hash, to_inflate, to_hash_out;
+  std::atomic<bool> failed{false};
+  double start = now_s();
+
+  std::thread hash_in(
+      [&]()
+      {
+        libsha256_ctx ctx;
+        libsha256_init(&ctx);
+        while (Buffer *b = to_hash.pop())
+        {
+          double t = now_s();
+          libsha256_update(&ctx, b->mem.data(), b->len);
+          res.hash_in.busy += now_s() - t;
+          res.hash_in.bytes += b->len;
+          in_ring.release(b);
+        }
+        libsha256_final(&ctx, res.compressed);
+      });
+
+  std::thread inflate(
+      [&]()
+      {
+        Buffer *out = out_ring.get();
+        out->len = 0;
+        bool ok = true;
+        while (Buffer *b = to_inflate.pop())
+        {
+          double t = now_s(), waited = out_ring.waited;
+          if (ok && !dec.feed(b->mem.data(), b->len, out, out_ring, to_hash_out))
+            ok = false;
+          res.inflate.busy += now_s() - t - (out_ring.waited - waited);
+          in_ring.release(b);
+        }
+        if (!ok || !dec.finished())
+          failed = true;
+        if (out->len)
+          to_hash_out.push(out);
+        else
+          out_ring.put(out);
+        to_hash_out.close();
+      });
+
+  std::thread hash_out(
+      [&]()
+      {
+        libsha256_ctx ctx;
+        libsha256_init(&ctx);
+        while (Buffer *b = to_hash_out.pop())
+        {
+          double t = now_s();
+          libsha256_update(&ctx, b->mem.data(), b->len);
+          res.hash_out.busy += now_s() - t;
+          res.hash_out.bytes += b->len;
+          out_ring.put(b);
+        }
+        libsha256_final(&ctx, res.content);
+      });
+
+  while (true)
+  {
+    Buffer *b = in_ring.get();
+    double t = now_s();
+    ssize_t n;
+    while ((n = read(fd, b->mem.data(), b->mem.size())) < 0 && errno == EINTR)
+      ;
+    res.read.busy += now_s() - t;
+    if (n <= 0)
+    {
+      if (n < 0)
+        res.error = strerror(errno);
+      in_ring.put(b);
+      break;
+    }
+    b->len = n;
+    b->refs = 2;
+    res.read.bytes += n;
+    to_hash.push(b);
+    to_inflate.push(b);
+  }
+  to_hash.close();
+  to_inflate.close();
+  hash_in.join();
+  inflate.join();
+  hash_out.join();
+  res.seconds = now_s() - start;
+  res.inflate.bytes = res.hash_out.bytes;  // stages are rated on what they produce or consume downstream
+  if (res.error.empty() && failed)
+    res.error = "corrupt or truncated archive";
+  return res;
+}
+
+int main(int argc, char **argv)
+{
+  HashProfile profile = load_profile();
+  size_t buffer = std::min<size_t>(profile.chunk, BufferPool::MAX_CLASS);
+  unsigned depth = 4;
+  bool quiet = false;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--buffer" && i + 1 < argc)
+      buffer = std::clamp<size_t>(atol(argv[++i]), 4096, BufferPool::MAX_CLASS);
+    else if (arg == "--depth" && i + 1 < argc)
+      depth = std::max(2, atoi(argv[++i]));
+    else if (arg == "-q")
+      quiet = true;
+    else if (!arg.empty() && arg[0] == '-')
+    {
+      files.clear();
+      break;
+    }
+    else
+      files.push_back(arg);
+  }
+  if (files.empty())
+  {
+    fprintf(stderr, "usage: %s [--buffer BYTES] [--depth N] [-q] FILE.gz|FILE.zst...\n", argv[0]);
+    return 1;
+  }
+
+  std::string backend = apply_profile_backend(profile);
+  BufferPool::get().set_hugepages(profile.hugepages);
+  int status = 0;
+  for (const std::string &name : files)
+  {
+    int fd = open(name.c_str(), O_RDONLY);
+    uint8_t magic[4] = {};
+    if (fd < 0 || pread(fd, magic, 4, 0) != 4)
+    {
+      fprintf(stderr, "%s: %s\n", name.c_str(), fd < 0 ? strerror(errno) : "too short for a gzip or zstd file");
+      status = 1;
+      if (fd >= 0)
+        close(fd);
+      continue;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    Decompressor *dec = nullptr;
+    if (magic[0] == 0x1f && magic[1] == 0x8b)
+      dec = new Gunzip();
+#ifdef HAVE_ZSTD
+    else if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+      dec = new Unzstd();
+#endif
+    if (!dec)
+    {
+      fprintf(stderr, "%s: not a %s\n", name.c_str(),
+#ifdef HAVE_ZSTD
+              "gzip or zstd file"
+#else
+              "gzip file (zstd support was not built in)"
+#endif
+      );
+      status = 1;
+      close(fd);
+      continue;
+    }
+    if (!dec->ready())
+    {
+      fprintf(stderr, "%s: could not set up the decompressor\n", name.c_str());
+      status = 1;
+      delete dec;
+      close(fd);
+      continue;
+    }
+
+    Result res = run(fd, *dec, buffer, depth);
+    delete dec;
+    close(fd);
+    if (!res.error.empty())
+    {
+      fprintf(stderr, "%s: %s\n", name.c_str(), res.error.c_str());
+      status = 1;
+      continue;
+    }
+
+    printf("compressed    %s  %s\ndecompressed  %s  %s\n", to_hex(res.compressed).c_str(), name.c_str(), to_hex(res.content).c_str(),
+           name.c_str());
+    if (quiet)
+      continue;
+    const Stage *stages[] = {&res.read, &res.hash_in, &res.inflate, &res.hash_out};
+    const Stage *slowest = stages[0];
+    fprintf(stderr, "  %-16s %14s %9s %9s\n", "stage", "bytes", "busy s", "GB/s");
+    for (const Stage *s : stages)
+    {
+      fprintf(stderr, "  %-16s %14llu %9.3f %9.2f\n", s->name, (unsigned long long)s->bytes, s->busy, s->busy > 0 ? s->bytes / s->busy / 1e9 : 0);
+      if (s->busy > slowest->busy)
+        slowest = s;
+    }
+    fprintf(stderr, "  %.3f s wall, %.2f GB/s of content; bottleneck: %s (%s, %zu x %zu KiB buffers per ring)\n", res.seconds,
+            res.hash_out.bytes / res.seconds / 1e9, slowest->name, backend.c_str(), (size_t)depth, buffer >> 10);
+  }
+  return status;
+}
@@ -0,0 +1,144 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_delta.h"
+#include "sha256_profile.h"
+#include "sha256_util.h"
+
+/*
+  Block signature and delta benchmark for two local files.
+
+  Builds the signature of OLD, then the delta that turns OLD into NEW, twice: once hashing one block per
+  libsha256_batch() call and once with the full batch width. Both runs must produce the same ops. The delta is then
+  applied to OLD and the result checked against NEW's SHA-256, so a pass means the ops really rebuild the file.
+
+  Reports signature and delta throughput in GB/s of the file scanned, and how much of NEW could be copied.
+*/
+
+static bool load(const char *path, std::vector<uint8_t> &out)
+{
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0)
+  {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+  out.resize(st.st_size);
+  size_t done = 0;
+  while (done < out.size())
+  {
+    ssize_t n = read(fd, out.data() + done, out.size() - done);
+    if (n <= 0)
+    {
+      fprintf(stderr, "%s: %s\n", path, n < 0 ? strerror(errno) : "file shrank while reading");
+      close(fd);
+      return false;
+    }
+    done += n;
+  }
+  close(fd);
+  return true;
+}
+
+static bool same_ops(const std::vector<DeltaOp> &a, const std::vector<DeltaOp> &b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++)
+    if (a[i].kind != b[i].kind || a[i].offset != b[i].offset || a[i].length != b[i].length)
+      return false;
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  size_t block = 2048, width = 0;
+  std::vector<const char *> files;
+  bool usage = false;
+  for (int i = 1; i < argc && !usage; ++i)
+  {
+    std::string arg = argv[i];
+    if ((arg == "--block" || arg == "--width") && i + 1 < argc)
+      (arg == "--block" ? block : width) = strtoull(argv[++i], nullptr, 10);
+    else if (arg[0] != '-')
+      files.push_back(argv[i]);
+    else
+      usage = true;
+  }
+  if (usage || files.size() != 2 || !block)
+  {
+    fprintf(stderr, "usage: %s [--block BYTES] [--width N] OLD NEW\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<uint8_t> old_data, new_data;
+  if (!load(files[0], old_data) || !load(files[1], new_data))
+    return 1;
+
+  std::string backend = apply_profile_backend(load_profile());
+  if (!width)
+    width = delta_batch_width();
+  printf("Backend %s: %s is %zu bytes (%zu blocks of %zu), %s is %zu bytes\n\n", backend.c_str(), files[0], old_data.size(),
+         old_data.size() / block, block, files[1], new_data.size());
+
+  printf("%-14s %6s %12s %12s %14s %10s\n", "strong hashes", "width", "sig GB/s", "delta GB/s", "hashed", "batches");
+  std::vector<DeltaOp> ops[2];
+  DeltaStats stats[2];
+  size_t widths[2] = {1, width};
+  for (int run = 0; run < 2; run++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    BlockSignature sig = make_signature(old_data.data(), old_data.size(), block, widths[run]);
+    double sig_s = seconds_since(start);
+
+    BlockIndex index(sig);
+    start = std::chrono::steady_clock::now();
+    ops[run] = make_delta(index, new_data.data(), new_data.size(), stats[run], widths[run]);
+    double delta_s = seconds_since(start);
+
+    printf("%-14s %6zu %12.2f %12.2f %14llu %10llu\n", run ? "batched" : "one at a time", widths[run], old_data.size() / sig_s / 1e9,
+           new_data.size() / delta_s / 1e9, (unsigned long long)stats[run].strong_hashes, (unsigned long long)stats[run].batches);
+  }
+
+  const DeltaStats &s = stats[1];
+  size_t copies = std::count_if(ops[1].begin(), ops[1].end(), [](const DeltaOp &op) { return op.kind == DeltaOp::COPY; });
+  printf("\nDelta: %zu ops (%zu copies), %llu bytes copied, %llu literal (%.1f%% of %s)\n", ops[1].size(), copies,
+         (unsigned long long)s.copied, (unsigned long long)s.literal, new_data.empty() ? 0.0 : 100.0 * s.literal / new_data.size(),
+         files[1]);
+  printf("Candidates: %llu weak hits, %llu false, %llu discarded after a false one\n", (unsigned long long)s.weak_hits,
+         (unsigned long long)s.false_hits, (unsigned long long)s.wasted);
+
+  int failures = 0;
+  if (!same_ops(ops[0], ops[1]))
+  {
+    printf("FAIL: batched delta differs from the one-at-a-time delta\n");
+    failures++;
+  }
+  std::vector<uint8_t> rebuilt = apply_delta(old_data.data(), new_data.data(), ops[1]);
+  uint8_t want[32], got[32];
+  libsha256(new_data.data(), new_data.size(), want);
+  libsha256(rebuilt.data(), rebuilt.size(), got);
+  if (rebuilt.size() != new_data.size() || memcmp(want, got, 32) != 0)
+  {
+    printf("FAIL: applying the delta does not rebuild %s\n", files[1]);
+    failures++;
+  }
+  else
+    printf("Rebuilt %s from the delta: SHA-256 matches\n", files[1]);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,351 @@
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_digestset.h"
+#include "sha256_drbg.h"
+#include "sha256_pool.h"
+#include "sha256_profile.h"
+#include "sha256_util.h"
+
+/*
+  Builds, queries and benchmarks DigestSet files.
+
+  build reads one hex digest per line (sha256sum output works: anything after the first 64 characters is ignored) and
+  writes the set. check hashes files in batches and looks the digests up with contains_batch(), printing each with
+  "known" or "unknown".
+
+  bench builds a set from the SHA-256 of --count 32-byte records of a CounterDrbg stream and queries it with --lookups
+  records, half of them members. It times single and batched lookups, a hash-then-probe pipeline that feeds
+  libsha256_batch() output straight to contains_batch(), and the same lookups against an unordered_set of hex strings,
+  the obvious way to hold such a list in memory, with its heap use taken from mallinfo2(). Every answer is checked
+  against the known membership of its record.
+*/
+
+using Digest = std::array<uint8_t, 32>;
+
+static const size_t RECORD = 32;
+static const size_t BATCH = 1024;           // digests per contains_batch() / libsha256_batch() call
+static const size_t SMALL_FILE = 1 << 20;   // larger files are hashed on their own, in pool-buffer pieces
+
+static bool from_hex(const std::string &s, uint8_t *out)
+{
+  if (s.size() < 64)
+    return false;
+  for (size_t i = 0; i < 64; i++)
+  {
+    char c = s[i];
+    int v = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    if (v < 0)
+      return false;
+    out[i / 2] = i % 2 ? out[i / 2] | v : v << 4;
+  }
+  return s.size() == 64 || s[64] == ' ' || s[64] == '\t';
+}
+
+static int build_set(const std::string &out, const std::string &list)
+{
+  std::ifstream file;
+  if (list != "-")
+  {
+    file.open(list);
+    if (!file)
+    {
+      fprintf(stderr, "%s: %s\n", list.c_str(), strerror(errno));
+      return 1;
+    }
+  }
+  std::istream &in = list == "-" ? std::cin : file;
+
+  std::vector<Digest> digests;
+  std::string line;
+  for (size_t lineno = 1; std::getline(in, line); lineno++)
+  {
+    if (line.empty())
+      continue;
+    Digest d;
+    if (!from_hex(line, d.data()))
+    {
+      fprintf(stderr, "%s:%zu: not a SHA-256 hex digest\n", list.c_str(), lineno);
+      return 1;
+    }
+    digests.push_back(d);
+  }
+  size_t lines = digests.size();
+  if (!DigestSet::build(digests, out))
+  {
+    fprintf(stderr, "%s: %s\n", out.c_str(), strerror(errno));
+    return 1;
+  }
+  fprintf(stderr, "%zu digests (%zu distinct) written to %s\n", lines, digests.size(), out.c_str());
+  return 0;
+}
+
+static bool read_file(const std::string &path, std::vector<uint8_t> &data)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    return false;
+  data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return !in.bad();
+}
+
+static bool hash_large_file(const std::string &path, uint8_t digest[32])
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  PoolBuffer buf(BufferPool::MAX_CLASS);
+  libsha256_ctx ctx;
+  libsha256_init(&ctx);
+  ssize_t n;
+  while ((n = read(fd, buf.data(), BufferPool::MAX_CLASS)) > 0 || (n < 0 && errno == EINTR))
+    if (n > 0)
+      libsha256_update(&ctx, buf.data(), n);
+  int err = errno;
+  close(fd);
+  libsha256_final(&ctx, digest);
+  errno = err;
+  return n == 0;
+}
+
+static int check_files(const std::string &set_path, const std::vector<std::string> &paths)
+{
+  DigestSet set;
+  if (!set.open(set_path))
+  {
+    fprintf(stderr, "%s: %s\n", set_path.c_str(), strerror(errno));
+    return 1;
+  }
+
+  int failures = 0;
+  std::vector<std::vector<uint8_t>> contents;
+  std::vector<size_t> owner;
+  std::vector<Digest> digests(paths.size());
+  std::vector<bool> readable(paths.size(), true);
+
+  // Small files are hashed together, a batch of contents at a time; large ones one by one as they come.
+  auto flush = [&]() {
+    std::vector<const void *> msgs;
+    std::vector<size_t> lens;
+    for (auto &c : contents) msgs.push_back(c.data()), lens.push_back(c.size());
+    std::vector<Digest> out(contents.size());
+    libsha256_batch(msgs.data(), lens.data(), contents.size(), reinterpret_cast<uint8_t(*)[32]>(out.data()));
+    for (size_t i = 0; i < contents.size(); i++) digests[owner[i]] = out[i];
+    contents.clear();
+    owner.clear();
+  };
+  size_t pending_bytes = 0;
+  for (size_t i = 0; i < paths.size(); i++)
+  {
+    struct stat st;
+    bool large = stat(paths[i].c_str(), &st) == 0 && (size_t)st.st_size > SMALL_FILE;
+    std::vector<uint8_t> data;
+    if (large ? !hash_large_file(paths[i], digests[i].data()) : !read_file(paths[i], data))
+    {
+      fprintf(stderr, "%s: %s\n", paths[i].c_str(), strerror(errno));
+      readable[i] = false;
+      failures++;
+      continue;
+    }
+    if (large)
+      continue;
+    pending_bytes += data.size();
+    contents.push_back(std::move(data));
+    owner.push_back(i);
+    if (contents.size() == BATCH || pending_bytes >= BufferPool::MAX_CLASS)
+      flush(), pending_bytes = 0;
+  }
+  flush();
+
+  std::unique_ptr<bool[]> found(new bool[paths.size()]);
+  set.contains_batch(reinterpret_cast<const uint8_t(*)[32]>(digests.data()), paths.size(), found.get());
+  for (size_t i = 0; i < paths.size(); i++)
+    if (readable[i])
+      printf("%-7s %s  %s\n", found[i] ? "known" : "unknown", to_hex(digests[i].data()).c_str(), paths[i].c_str());
+  return failures ? 1 : 0;
+}
+
+// SHA-256 of records [first, first + n) of the stream, written to out.
+static void hash_records(const CounterDrbg &drbg, const std::vector<uint64_t> &records, size_t first, size_t n, uint8_t *scratch,
+                         Digest *out)
+{
+  const void *msgs[BATCH];
+  size_t lens[BATCH];
+  for (size_t done = 0; done < n; done += BATCH)
+  {
+    size_t k = std::min(BATCH, n - done);
+    for (size_t i = 0; i < k; i++)
+    {
+      drbg.generate(records[first + done + i] * RECORD, scratch + i * RECORD, RECORD);
+      msgs[i] = scratch + i * RECORD;
+      lens[i] = RECORD;
+    }
+    libsha256_batch(msgs, lens, k, reinterpret_cast<uint8_t(*)[32]>(out + done));
+  }
+}
+
+static int bench(uint64_t count, uint64_t lookups, const std::string &path)
+{
+  CounterDrbg drbg(uint64_t(42));
+  std::vector<uint8_t> scratch(BATCH * RECORD);
+
+  // Members are records [0, count); queries alternate between a random member and a random record past the end.
+  std::vector<uint64_t> members(count), queries(lookups);
+  for (uint64_t i = 0; i < count; i++) members[i] = i;
+  std::mt19937_64 rng(7);
+  for (uint64_t i = 0; i < lookups; i++) queries[i] = i % 2 ? count + rng() % (count * 4 + 1) : rng() % count;
+
+  std::vector<Digest> digests(count), query_digests(lookups);
+  hash_records(drbg, members, 0, count, scratch.data(), digests.data());
+  hash_records(drbg, queries, 0, lookups, scratch.data(), query_digests.data());
+  const uint8_t(*q)[32] = reinterpret_cast<const uint8_t(*)[32]>(query_digests.data());
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Digest> sorted = digests;
+  if (!DigestSet::build(sorted, path))
+  {
+    fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+    return 1;
+  }
+  double build_secs = seconds_since(start);
+  sorted = std::vector<Digest>();
+
+  start = std::chrono::steady_clock::now();
+  DigestSet set;
+  if (!set.open(path))
+  {
+    fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+    return 1;
+  }
+  double open_secs = seconds_since(start);
+
+  int failures = 0;
+  auto verify = [&](const char *what, const bool *found) {
+    uint64_t wrong = 0;
+    for (uint64_t i = 0; i < lookups; i++) wrong += found[i] != (queries[i] < count);
+    if (wrong)
+      printf("%s: %llu wrong answers\n", what, (unsigned long long)wrong), failures++;
+  };
+  std::unique_ptr<bool[]> found(new bool[lookups]);
+
+  uint64_t bloom_passed = 0;
+  for (uint64_t i = 1; i < lookups; i += 2) bloom_passed += set.may_contain(q[i]);
+
+  // Untimed pass first so the mapping is resident for every timed one.
+  set.contains_batch(q, lookups, found.get());
+  start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < lookups; i++) found[i] = set.contains(q[i]);
+  double single_secs = seconds_since(start);
+  verify("contains", found.get());
+
+  std::fill(found.get(), found.get() + lookups, false);
+  start = std::chrono::steady_clock::now();
+  set.contains_batch(q, lookups, found.get());
+  double batch_secs = seconds_since(start);
+  verify("contains_batch", found.get());
+
+  // Hash records and probe their digests, one BATCH at a time, as a scanner would.
+  std::vector<Digest> piece(BATCH);
+  start = std::chrono::steady_clock::now();
+  for (uint64_t done = 0; done < lookups; done += BATCH)
+  {
+    size_t k = std::min<uint64_t>(BATCH, lookups - done);
+    hash_records(drbg, queries, done, k, scratch.data(), piece.data());
+    set.contains_batch(reinterpret_cast<const uint8_t(*)[32]>(piece.data()), k, found.get() + done);
+  }
+  double pipeline_secs = seconds_since(start);
+  verify("hash + contains_batch", found.get());
+
+  size_t heap_before = mallinfo2().uordblks;
+  start = std::chrono::steady_clock::now();
+  std::unordered_set<std::string> naive;
+  for (const Digest &d : digests) naive.insert(to_hex(d.data()));
+  double naive_build_secs = seconds_since(start);
+  size_t naive_bytes = mallinfo2().uordblks - heap_before;
+  start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < lookups; i++) found[i] = naive.count(to_hex(q[i]));
+  double naive_secs = seconds_since(start);
+  verify("unordered_set", found.get());
+
+  printf("%llu digests, %llu lookups (half members), backend %s\n\n", (unsigned long long)count, (unsigned long long)lookups,
+         libsha256_backend_name());
+  printf("%-30s %12s %14s %10s\n", "", "build s", "memory MiB", "B/digest");
+  printf("%-30s %12.3f %14.1f %10.1f\n", "DigestSet file", build_secs, set.bytes() / 1048576.0, (double)set.bytes() / count);
+  printf("%-30s %12.3f %14.1f %10.1f\n", "unordered_set<std::string>", naive_build_secs, naive_bytes / 1048576.0,
+         (double)naive_bytes / count);
+  printf("\nDigestSet open: %.3f ms; Bloom filter passes %.3f%% of non-members\n\n", open_secs * 1e3, 100.0 * bloom_passed / (lookups / 2));
+  printf("%-30s %12s\n", "", "M lookups/s");
+  printf("%-30s %12.2f\n", "contains", lookups / single_secs / 1e6);
+  printf("%-30s %12.2f\n", "contains_batch", lookups / batch_secs / 1e6);
+  printf("%-30s %12.2f\n", "hash + contains_batch", lookups / pipeline_secs / 1e6);
+  printf("%-30s %12.2f\n", "unordered_set<std::string>", lookups / naive_secs / 1e6);
+  unlink(path.c_str());
+  return failures ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  std::string command = argc > 1 ? argv[1] : "";
+  std::vector<std::string> args(argv + std::min(argc, 2), argv + argc);
+  uint64_t count = 4000000, lookups = 4000000;
+  std::string bench_path = "/tmp/sha256digestset.bench";
+  bool usage = false;
+
+  if (command == "build")
+    usage = args.empty() || args.size() > 2;
+  else if (command == "check")
+    usage = args.size() < 2;
+  else if (command == "bench")
+  {
+    for (size_t i = 0; i < args.size() && !usage; ++i)
+    {
+      if (i + 1 >= args.size())
+        usage = true;
+      else if (args[i] == "--count")
+        count = std::max(1ULL, strtoull(args[++i].c_str(), nullptr, 10));
+      else if (args[i] == "--lookups")
+        lookups = std::max(2ULL, strtoull(args[++i].c_str(), nullptr, 10));
+      else if (args[i] == "--file")
+        bench_path = args[++i];
+      else
+        usage = true;
+    }
+  }
+  else
+    usage = true;
+  if (usage)
+  {
+    fprintf(stderr,
+            "usage: %s build SET [LIST|-]                 write a set from hex digests, one per line\n"
+            "       %s check SET FILE...                  hash files and look them up\n"
+            "       %s bench [--count N] [--lookups N] [--file PATH]\n",
+            argv[0], argv[0], argv[0]);
+    return 1;
+  }
+
+  apply_profile_backend(load_profile());
+  if (command == "build")
+    return build_set(args[0], args.size() > 1 ? args[1] : "-");
+  if (command == "check")
+    return check_files(args[0], std::vector<std::string>(args.begin() + 1, args.end()));
+  return bench(count, lookups, bench_path);
+}
@@ -0,0 +1,158 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_drbg.h"
+#include "sha256_pool.h"
+#include "sha256_profile.h"
+#include "sha256_util.h"
+
+/*
+  Counter-mode keystream generator and benchmark.
+
+  With -o, writes --bytes bytes of the stream for --seed to a file (or stdout for -), generated by -j threads into
+  a pool buffer a piece at a time.
+
+  Without it, generates --mb MiB with every supported backend, on one thread and on all of them, and reports GB/s.
+  Every run must produce the same bytes as the first, and a range starting at an odd offset must match the same bytes
+  of the full run, or the benchmark fails.
+*/
+
+static const size_t WRITE_CHUNK = BufferPool::MAX_CLASS;
+
+static int write_stream(const CounterDrbg &drbg, const std::string &path, uint64_t bytes, unsigned threads)
+{
+  int fd = path == "-" ? STDOUT_FILENO : open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+    return 1;
+  }
+  PoolBuffer buf(WRITE_CHUNK);
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t done = 0; done < bytes;)
+  {
+    size_t n = std::min<uint64_t>(WRITE_CHUNK, bytes - done);
+    drbg.generate_parallel(done, buf.data(), n, threads);
+    for (size_t off = 0; off < n;)
+    {
+      ssize_t w = write(fd, buf.data() + off, n - off);
+      if (w < 0 && errno == EINTR)
+        continue;
+      if (w <= 0)
+      {
+        fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+        return 1;
+      }
+      off += w;
+    }
+    done += n;
+  }
+  double secs = seconds_since(start);
+  if (fd != STDOUT_FILENO && close(fd) != 0)
+  {
+    fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+    return 1;
+  }
+  fprintf(stderr, "%llu bytes in %.3f s (%.2f GB/s) with %u threads\n", (unsigned long long)bytes, secs, bytes / secs / 1e9, threads);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  std::string seed = "0", out_path;
+  uint64_t bytes = 0, mb = 256;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  bool usage = false;
+  for (int i = 1; i < argc && !usage; ++i)
+  {
+    std::string arg = argv[i];
+    if (i + 1 >= argc)
+      usage = true;
+    else if (arg == "--seed")
+      seed = argv[++i];
+    else if (arg == "--bytes")
+      bytes = strtoull(argv[++i], nullptr, 10);
+    else if (arg == "--mb")
+      mb = std::max(1ULL, strtoull(argv[++i], nullptr, 10));
+    else if (arg == "-j" || arg == "--threads")
+      threads = std::max(1, atoi(argv[++i]));
+    else if (arg == "-o")
+      out_path = argv[++i];
+    else
+      usage = true;
+  }
+  if (usage)
+  {
+    fprintf(stderr,
+            "usage: %s [--seed TEXT] [-j THREADS] -o FILE|- --bytes N   write the keystream\n"
+            "       %s [--seed TEXT] [-j THREADS] [--mb N]               benchmark every backend\n",
+            argv[0], argv[0]);
+    return 1;
+  }
+
+  std::string profile_backend = apply_profile_backend(load_profile());
+  CounterDrbg drbg(seed.data(), seed.size());
+  if (!out_path.empty())
+    return write_stream(drbg, out_path, bytes, threads);
+
+  size_t len = mb << 20;
+  std::vector<uint8_t> buf(len);
+  std::vector<uint8_t> reference;
+  uint8_t digest[32];
+  int failures = 0;
+
+  printf("Seed \"%s\", %llu MiB per run\n\n", seed.c_str(), (unsigned long long)mb);
+  printf("%-10s %6s %8s %10s  %s\n", "backend", "lanes", "threads", "GB/s", "SHA-256 of the output");
+  std::vector<std::string> backends;
+  for (size_t i = 0; const char *name = libsha256_backend_at(i); i++) backends.push_back(name);
+  for (const std::string &backend : backends)
+  {
+    libsha256_set_backend(backend.c_str());
+    for (unsigned t : {1u, threads})
+    {
+      // Best of three, after a run that faults the buffer in.
+      drbg.generate_parallel(0, buf.data(), len, t);
+      double best = 1e30;
+      for (int run = 0; run < 3; run++)
+      {
+        auto start = std::chrono::steady_clock::now();
+        drbg.generate_parallel(0, buf.data(), len, t);
+        best = std::min(best, seconds_since(start));
+      }
+      libsha256(buf.data(), len, digest);
+      bool same = true;
+      if (reference.empty())
+        reference.assign(buf.data(), buf.data() + len);
+      else
+        same = memcmp(reference.data(), buf.data(), len) == 0;
+      printf("%-10s %6zu %8u %10.2f  %s%s\n", backend.c_str(), libsha256_backend_lanes(), t, len / best / 1e9, to_hex(digest).c_str(),
+             same ? "" : "  MISMATCH");
+      failures += !same;
+      if (threads == 1)
+        break;
+    }
+
+    // An unaligned range must be the same bytes as that range of the whole stream.
+    size_t offset = std::min<size_t>(len / 2, 12345), n = std::min<size_t>(len - offset, 100003);
+    drbg.generate(offset, buf.data(), n);
+    if (memcmp(buf.data(), reference.data() + offset, n) != 0)
+    {
+      printf("%-10s range at offset %zu differs from the full stream\n", backend.c_str(), offset);
+      failures++;
+    }
+  }
+  libsha256_set_backend(profile_backend.c_str());
+  return failures ? 1 : 0;
+}
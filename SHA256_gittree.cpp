@@ -0,0 +1,470 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_profile.h"
+#include "sha256_util.h"
+
+/*
+  Git object IDs for SHA-256 repositories (`git init --object-format=sha256`), computed for a whole working tree.
+
+  A blob's ID is SHA-256("blob <len>\0" || content). A tree's ID is SHA-256("tree <len>\0" || entries), where each
+  entry is "<octal mode> <name>\0" followed by the child's raw 32-byte ID. Entries are sorted by name, with a
+  directory compared as if its name ended in '/'. Git records no empty directories, so a directory with nothing to
+  hash under it is left out of its parent.
+
+  Everything runs as one dependency-driven job on a thread pool. Listing a directory is a task; it creates the
+  children, queues the subdirectories and large files as tasks of their own, and drops small files and symlinks into
+  a shared batch that a worker hashes a backend's worth of lanes at a time through libsha256_batch. Every directory
+  counts its unfinished children; whichever thread finishes the last one builds and hashes the tree object right
+  away and reports to the parent in turn, so the root's ID is known as soon as its last blob is.
+
+  The .git directory is skipped and .gitignore is not consulted, so the result matches `git add -A && git write-tree`
+  in a tree with no ignored files and no nested repositories.
+*/
+
+static const size_t SMALL_BLOB = 64 << 10;  // largest blob read whole and batched
+static const size_t READ_SIZE = 1 << 20;    // streaming read size for larger blobs
+
+static const uint32_t MODE_TREE = 040000, MODE_FILE = 0100644, MODE_EXEC = 0100755, MODE_LINK = 0120000;
+
+struct Node
+{
+  std::string name;  // entry name in the parent
+  std::string path;
+  uint32_t mode = 0;
+  uint64_t size = 0;
+  Node *parent = nullptr;
+  std::vector<std::unique_ptr<Node>> children;  // in git's tree order
+  std::atomic<size_t> pending{0};               // children not hashed yet, plus one while listing
+  bool present = true;                          // false for a tree with nothing in it
+  uint8_t oid[32] = {};
+};
+
+// Git's entry order: bytewise, with a tree's name followed by '/'.
+static bool git_order(const std::unique_ptr<Node> &a, const std::unique_ptr<Node> &b)
+{
+  size_t n = std::min(a->name.size(), b->name.size());
+  int c = memcmp(a->name.data(), b->name.data(), n);
+  if (c)
+    return c < 0;
+  auto next = [n](const Node &x) { return n < x.name.size() ? (uint8_t)x.name[n] : x.mode == MODE_TREE ? '/' : 0; };
+  return next(*a) < next(*b);
+}
+
+static size_t object_header(char *out, const char *type, uint64_t len)
+{
+  return sprintf(out, "%s %llu", type, (unsigned long long)len) + 1;  // the NUL is part of the header
+}
+
+class TreeHasher
+{
+public:
+  struct Stats
+  {
+    uint64_t blobs = 0, trees = 0, bytes = 0;
+    uint64_t batches = 0, batched = 0;  // small-blob batches and the blobs in them
+    uint64_t errors = 0;
+  };
+
+  TreeHasher(unsigned workers) : workers(std::max(1u, workers)), width(std::max<size_t>(8, libsha256_batch_lanes())) {}
+
+  // Hashes the directory at path; returns false if anything under it could not be read.
+  bool run(const std::string &path, uint8_t oid[32])
+  {
+    Node root;
+    root.path = path;
+    root.mode = MODE_TREE;
+    root_len = path.size();
+    root.pending = 1;
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      done = false;
+      tasks.push_back(&root);
+      listing = 1;
+    }
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < workers; i++) pool.emplace_back([this]() { work(); });
+    for (auto &t : pool) t.join();
+    memcpy(oid, root.oid, 32);
+    return counters.errors == 0;
+  }
+
+  Stats stats() const { return counters; }
+
+  // One blob, as `git hash-object` computes it.
+  static bool hash_blob(const std::string &path, uint8_t oid[32], uint64_t *size = nullptr)
+  {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0)
+      return false;
+    std::vector<uint8_t> buf(READ_SIZE);
+    char header[32];
+    libsha256_ctx ctx;
+    libsha256_init(&ctx);
+
+    if (S_ISLNK(st.st_mode))
+    {
+      ssize_t n = readlink(path.c_str(), (char *)buf.data(), buf.size());
+      if (n < 0)
+        return false;
+      libsha256_update(&ctx, header, object_header(header, "blob", n));
+      libsha256_update(&ctx, buf.data(), n);
+      libsha256_final(&ctx, oid);
+      if (size)
+        *size = n;
+      return true;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+      if (fd >= 0)
+        close(fd);
+      return false;
+    }
+    libsha256_update(&ctx, header, object_header(header, "blob", st.st_size));
+    uint64_t total = 0;
+    ssize_t n;
+    while ((n = read(fd, buf.data(), buf.size())) > 0)
+    {
+      libsha256_update(&ctx, buf.data(), n);
+      total += n;
+    }
+    close(fd);
+    if (n < 0 || total != (uint64_t)st.st_size)
+      return false;  // changed while we read it; the header already committed to the old size
+    libsha256_final(&ctx, oid);
+    if (size)
+      *size = total;
+    return true;
+  }
+
+private:
+  void work()
+  {
+    std::vector<Node *> batch;
+    std::vector<uint8_t> buf;
+    while (true)
+    {
+      Node *task = nullptr;
+      {
+        std::unique_lock<std::mutex> lk(mu);
+        // A partial batch only goes out once no listing is left that could still fill it.
+        cv.wait(lk, [&]() { return done || !tasks.empty() || small.size() >= width || (!small.empty() && !listing); });
+        if (done)
+          return;
+        if (!tasks.empty())
+        {
+          task = tasks.front();
+          tasks.pop_front();
+        }
+        else
+        {
+          size_t k = std::min(width, small.size());
+          batch.assign(small.end() - k, small.end());
+          small.resize(small.size() - k);
+        }
+      }
+
+      if (!task)
+      {
+        hash_small(batch, buf);
+        for (Node *n : batch) child_done(n);
+      }
+      else if (task->mode == MODE_TREE)
+        list(task);
+      else
+      {
+        if (!hash_blob(task->path, task->oid))
+          fail(task->path);
+        count_blob(task->size);
+        child_done(task);
+      }
+    }
+  }
+
+  void list(Node *dir)
+  {
+    DIR *d = opendir(dir->path.c_str());
+    if (!d)
+      fail(dir->path);
+    while (struct dirent *e = d ? readdir(d) : nullptr)
+    {
+      if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..") || !strcmp(e->d_name, ".git"))
+        continue;
+      auto child = std::make_unique<Node>();
+      child->name = e->d_name;
+      child->path = dir->path + "/" + e->d_name;
+      child->parent = dir;
+      struct stat st;
+      if (lstat(child->path.c_str(), &st) != 0)
+      {
+        fail(child->path);
+        continue;
+      }
+      if (S_ISDIR(st.st_mode))
+        child->mode = MODE_TREE;
+      else if (S_ISREG(st.st_mode))
+        child->mode = st.st_mode & S_IXUSR ? MODE_EXEC : MODE_FILE;
+      else if (S_ISLNK(st.st_mode))
+        child->mode = MODE_LINK;
+      else
+        continue;  // sockets, fifos and devices are not content git stores
+      child->size = st.st_size;
+      child->pending = child->mode == MODE_TREE ? 1 : 0;
+      dir->children.push_back(std::move(child));
+    }
+    if (d)
+      closedir(d);
+    std::sort(dir->children.begin(), dir->children.end(), git_order);
+
+    dir->pending += dir->children.size();
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      for (auto &c : dir->children)
+      {
+        if (c->mode == MODE_TREE)
+        {
+          listing++;
+          tasks.push_back(c.get());
+        }
+        else if (c->size <= SMALL_BLOB)
+          small.push_back(c.get());
+        else
+          tasks.push_back(c.get());
+      }
+      listing--;
+    }
+    cv.notify_all();
+    child_settled(dir);
+  }
+
+  // Reads each small blob after its object header into one buffer and hashes them all in one call.
+  void hash_small(const std::vector<Node *> &batch, std::vector<uint8_t> &buf)
+  {
+    size_t need = 0;
+    for (Node *n : batch) need += 32 + n->size;
+    buf.resize(need);
+
+    std::vector<size_t> offsets, lens;
+    std::vector<Node *> ok;
+    size_t at = 0;
+    for (Node *n : batch)
+    {
+      uint8_t *content = buf.data() + at + 32;
+      ssize_t len = read_small(n, content);
+      if (len < 0)
+      {
+        fail(n->path);
+        continue;
+      }
+      // Written just before the content, so the object is contiguous.
+      char header[32];
+      size_t h = object_header(header, "blob", len);
+      memcpy(content - h, header, h);
+      offsets.push_back(at + 32 - h);
+      lens.push_back(h + len);
+      ok.push_back(n);
+      at += 32 + n->size;
+      count_blob(len);
+    }
+
+    std::vector<const void *> msgs(ok.size());
+    std::vector<uint8_t> digests(ok.size() * 32);
+    for (size_t i = 0; i < ok.size(); i++) msgs[i] = buf.data() + offsets[i];
+    libsha256_batch(msgs.data(), lens.data(), ok.size(), reinterpret_cast<uint8_t(*)[32]>(digests.data()));
+    for (size_t i = 0; i < ok.size(); i++) memcpy(ok[i]->oid, &digests[i * 32], 32);
+
+    std::lock_guard<std::mutex> lk(mu);
+    counters.batches++;
+    counters.batched += ok.size();
+  }
+
+  // The whole content into out (room for n->size bytes), or -1 if it cannot be read or has grown since the listing.
+  static ssize_t read_small(const Node *n, uint8_t *out)
+  {
+    if (n->mode == MODE_LINK)
+    {
+      ssize_t len = readlink(n->path.c_str(), (char *)out, n->size);
+      return len == (ssize_t)n->size ? len : -1;
+    }
+    int fd = open(n->path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return -1;
+    size_t len = 0;
+    ssize_t r = 0;
+    uint8_t extra;
+    while (len < n->size && (r = read(fd, out + len, n->size - len)) > 0) len += r;
+    if (r >= 0 && read(fd, &extra, 1) != 0)
+      r = -1;
+    close(fd);
+    return r < 0 ? -1 : (ssize_t)len;
+  }
+
+  void child_done(Node *n)
+  {
+    if (n->parent)
+      child_settled(n->parent);
+  }
+
+  // One child of dir is finished (or its listing is); the last one builds the tree object.
+  void child_settled(Node *dir)
+  {
+    if (--dir->pending != 0)
+      return;
+
+    std::string body;
+    for (auto &c : dir->children)
+    {
+      if (!c->present)
+        continue;
+      char mode[16];
+      sprintf(mode, "%o ", c->mode);
+      body += mode;
+      body += c->name;
+      body += '\0';
+      body.append((const char *)c->oid, 32);
+    }
+    dir->present = !body.empty();
+    char header[32];
+    libsha256_ctx ctx;
+    libsha256_init(&ctx);
+    libsha256_update(&ctx, header, object_header(header, "tree", body.size()));
+    libsha256_update(&ctx, body.data(), body.size());
+    libsha256_final(&ctx, dir->oid);
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      if (dir->present)
+        counters.trees++;
+    }
+    if (verbose)
+      print_entries(dir);
+    dir->children.clear();  // IDs are all the parent needs from here on
+
+    if (dir->parent)
+      child_settled(dir->parent);
+    else
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      done = true;
+      cv.notify_all();
+    }
+  }
+
+  void print_entries(const Node *dir)
+  {
+    std::lock_guard<std::mutex> lk(print_mu);
+    for (auto &c : dir->children)
+      if (c->present)
+        printf("%06o %s %s\t%s\n", c->mode, c->mode == MODE_TREE ? "tree" : "blob", to_hex(c->oid).c_str(), c->path.c_str() + root_len + 1);
+  }
+
+  void count_blob(uint64_t size)
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    counters.blobs++;
+    counters.bytes += size;
+  }
+
+  void fail(const std::string &path)
+  {
+    fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno ? errno : EIO));
+    std::lock_guard<std::mutex> lk(mu);
+    counters.errors++;
+  }
+
+public:
+  bool verbose = false;
+
+private:
+  unsigned workers;
+  size_t width;
+  size_t root_len = 0;
+
+  std::mutex mu, print_mu;
+  std::condition_variable cv;
+  std::deque<Node *> tasks;   // directories to list and large blobs
+  std::vector<Node *> small;  // small blobs waiting for a batch
+  size_t listing = 0;         // directories queued or being listed
+  bool done = false;
+  Stats counters;
+};
+
+int main(int argc, char **argv)
+{
+  unsigned threads = std::thread::hardware_concurrency();
+  bool verbose = false, usage = false;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc && !usage; ++i)
+  {
+    std::string arg = argv[i];
+    if ((arg == "-j" || arg == "--threads") && i + 1 < argc)
+      threads = atoi(argv[++i]);
+    else if (arg == "-v")
+      verbose = true;
+    else if (arg[0] != '-')
+      paths.push_back(arg);
+    else
+      usage = true;
+  }
+  if (usage || paths.empty())
+  {
+    fprintf(stderr,
+            "usage: %s [-j THREADS] [-v] PATH...\n"
+            "  prints the SHA-256 git object ID of each PATH: a tree for a directory, a blob for anything else;\n"
+            "  -v also lists every tree entry as `git ls-tree -r -t` does\n",
+            argv[0]);
+    return 1;
+  }
+
+  std::string backend = apply_profile_backend(load_profile());
+  int status = 0;
+  for (const std::string &path : paths)
+  {
+    struct stat st;
+    uint8_t oid[32];
+    if (lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+    {
+      TreeHasher hasher(threads);
+      hasher.verbose = verbose;
+      auto start = std::chrono::steady_clock::now();
+      bool ok = hasher.run(path, oid);
+      double secs = seconds_since(start);
+      TreeHasher::Stats s = hasher.stats();
+      printf("%s%s%s\n", to_hex(oid).c_str(), paths.size() > 1 ? "  " : "", paths.size() > 1 ? path.c_str() : "");
+      fprintf(stderr, "%s: %llu blobs (%.1f MB), %llu trees in %.3f s with %u threads (%s): %.0f objects/s, %.1f MB/s; %llu small blobs in %llu batches\n",
+              path.c_str(), (unsigned long long)s.blobs, s.bytes / 1e6, (unsigned long long)s.trees, secs, std::max(1u, threads),
+              backend.c_str(), (s.blobs + s.trees) / secs, s.bytes / 1e6 / secs, (unsigned long long)s.batched, (unsigned long long)s.batches);
+      if (!ok)
+        status = 1;
+    }
+    else if (TreeHasher::hash_blob(path, oid))
+      printf("%s%s%s\n", to_hex(oid).c_str(), paths.size() > 1 ? "  " : "", paths.size() > 1 ? path.c_str() : "");
+    else
+    {
+      fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+      status = 1;
+    }
+  }
+  return status;
+}
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_midstate.h"
+#include "sha256_profile.h"
+
+/*
+  Prefix midstate cache benchmark.
+
+  Builds --messages messages drawn from --families families. Each message is its family's --prefix-byte header
+  followed by a --body-byte unique body. Families are picked with a skew towards the low-numbered ones, so a cache
+  smaller than the family count still hits on the popular ones. Every message is hashed plainly and through the
+  cache, one at a time and in batches, with content and with ID keys, and every digest is compared with the plain
+  one-shot result.
+*/
+
+static uint64_t rng_state = 0x243f6a8885a308d3ULL;
+
+static uint64_t next_rand()
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+int main(int argc, char **argv)
+{
+  size_t families = 64, prefix_len = 1024, body_len = 64, capacity = 32, messages = 200000;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    size_t *target = arg == "--families"   ? &families
+                     : arg == "--prefix"   ? &prefix_len
+                     : arg == "--body"     ? &body_len
+                     : arg == "--capacity" ? &capacity
+                     : arg == "--messages" ? &messages
+                                           : nullptr;
+    if (!target || i + 1 >= argc)
+    {
+      fprintf(stderr, "usage: %s [--families N] [--prefix BYTES] [--body BYTES] [--capacity ENTRIES] [--messages N]\n", argv[0]);
+      return 1;
+    }
+    *target = strtoull(argv[++i], nullptr, 10);
+  }
+  families = std::max<size_t>(1, families);
+  messages = std::max<size_t>(1, messages);
+
+  std::string backend = apply_profile_backend(load_profile());
+  printf("Backend %s: %zu messages of %zu + %zu bytes from %zu families, cache of %zu entries\n\n", backend.c_str(), messages, prefix_len,
+         body_len, families, capacity);
+
+  std::vector<std::vector<uint8_t>> prefixes(families, std::vector<uint8_t>(prefix_len));
+  for (auto &p : prefixes)
+    for (auto &b : p) b = next_rand();
+
+  size_t msg_len = prefix_len + body_len;
+  std::vector<uint8_t> buf(messages * msg_len);
+  std::vector<const void *> msgs(messages);
+  std::vector<size_t> lens(messages, msg_len), prefix_lens(messages, prefix_len);
+  std::vector<uint64_t> ids(messages);
+  for (size_t i = 0; i < messages; i++)
+  {
+    // Half the draws are uniform over all families, a quarter over the first half, and so on.
+    unsigned k = __builtin_ctzll(next_rand() | (1ULL << 20));
+    size_t f = next_rand() % std::max<size_t>(1, families >> k);
+    uint8_t *m = &buf[i * msg_len];
+    memcpy(m, prefixes[f].data(), prefix_len);
+    for (size_t j = 0; j < body_len; j++) m[prefix_len + j] = next_rand();
+    msgs[i] = m;
+    ids[i] = f;
+  }
+
+  std::vector<uint8_t> reference(messages * 32), out(messages * 32);
+  auto digests = [&](std::vector<uint8_t> &v) { return reinterpret_cast<uint8_t(*)[32]>(v.data()); };
+  size_t width = std::max<size_t>(8, libsha256_batch_lanes());
+  uint64_t full_blocks = (msg_len + 9 + 63) / 64;
+  int failures = 0;
+
+  printf("%-22s %10s %10s %14s %16s\n", "mode", "ns/msg", "hit rate", "blocks saved", "blocks/msg");
+  auto run = [&](const char *mode, bool cached, auto &&body)
+  {
+    MidstateCache cache(capacity);
+    auto start = std::chrono::steady_clock::now();
+    body(cache);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / messages;
+    if (cached && memcmp(out.data(), reference.data(), out.size()) != 0)
+    {
+      printf("%s: digests differ from the plain hashes\n", mode);
+      failures++;
+    }
+    MidstateCache::Stats s = cache.stats();
+    double blocks = full_blocks - (double)s.blocks_saved / messages;
+    if (cached)
+      printf("%-22s %10.1f %9.1f%% %14llu %16.2f\n", mode, ns, 100 * s.hit_rate(), (unsigned long long)s.blocks_saved, blocks);
+    else
+      printf("%-22s %10.1f %10s %14s %16.2f\n", mode, ns, "-", "-", blocks);
+  };
+
+  run("one-shot", false, [&](MidstateCache &) { for (size_t i = 0; i < messages; i++) libsha256(msgs[i], msg_len, digests(reference)[i]); });
+  run("cached, content key", true,
+      [&](MidstateCache &c) { for (size_t i = 0; i < messages; i++) c.hash(msgs[i], msg_len, prefix_len, digests(out)[i]); });
+  run("cached, ID key", true,
+      [&](MidstateCache &c) { for (size_t i = 0; i < messages; i++) c.hash(msgs[i], msg_len, prefix_len, digests(out)[i], ids[i]); });
+
+  std::vector<uint8_t> batched(messages * 32);
+  run("batch", false,
+      [&](MidstateCache &)
+      {
+        for (size_t i = 0; i < messages; i += width)
+          libsha256_batch(&msgs[i], &lens[i], std::min(width, messages - i), digests(batched) + i);
+      });
+  if (memcmp(batched.data(), reference.data(), batched.size()) != 0)
+  {
+    printf("batch: digests differ from the plain hashes\n");
+    failures++;
+  }
+  run("batch, content key", true,
+      [&](MidstateCache &c)
+      {
+        for (size_t i = 0; i < messages; i += width)
+          c.batch(&msgs[i], &lens[i], &prefix_lens[i], std::min(width, messages - i), digests(out) + i);
+      });
+  run("batch, ID key", true,
+      [&](MidstateCache &c)
+      {
+        for (size_t i = 0; i < messages; i += width)
+          c.batch(&msgs[i], &lens[i], &prefix_lens[i], std::min(width, messages - i), digests(out) + i, &ids[i]);
+      });
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,428 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_pool.h"
+#include "sha256_profile.h"
+#include "sha256_util.h"
+
+/*
+  Single-pass multi-digest: the plain SHA-256 of a file, the digest of every fixed-size chunk, and the tree root
+  (SHA-256 of the concatenated chunk digests, as in SHA256_placement), all from one read of the input.
+
+  The reader fills a small ring of pool buffers, each a whole number of chunks. Every filled buffer is handed to two
+  consumers at once: the sequential thread, which feeds it to the whole-file context in order, and the chunk workers,
+  which hash its chunks a backend's worth of lanes per libsha256_batch() call. A buffer goes back to the reader when
+  both are done with it, so the file is read exactly once however many digests come out of it.
+
+  The results go to a sidecar file (little-endian):
+
+    "S256MD1\0"         8-byte magic
+    u32 chunk_size      bytes per chunk; the last chunk may be shorter
+    u32 reserved        0
+    u64 file_size
+    u8[32] file_digest
+    u8[32] tree_root
+    u8[32] chunk[n]     n = ceil(file_size / chunk_size); the root of an empty file is SHA-256("")
+
+  stdout gets the usual `sha256sum` line. --verify recomputes everything in one pass and reports the chunks that no
+  longer match, so a damaged range can be located without a second read.
+*/
+
+static const char MAGIC[8] = {'S', '2', '5', '6', 'M', 'D', '1', '\0'};
+static const size_t HEADER = 8 + 4 + 4 + 8 + 32 + 32;
+
+struct Digests
+{
+  uint32_t chunk = 0;
+  uint64_t size = 0;
+  uint8_t file[32];
+  uint8_t root[32];
+  std::vector<uint8_t> chunks;  // 32 bytes per chunk
+
+  size_t num_chunks() const { return chunks.size() / 32; }
+};
+
+/* The pipeline. */
+
+class MultiDigest
+{
+public:
+  MultiDigest(size_t chunk, size_t read_size, unsigned workers, unsigned depth) : chunk(chunk), workers(std::max(1u, workers))
+  {
+    read_size = std::max(chunk, read_size / chunk * chunk);
+    for (unsigned i = 0; i < std::max(2u, depth); i++) slots.emplace_back(read_size);
+    for (Slot &s : slots) free_slots.push_back(&s);
+  }
+
+  // False on a read error, or if the pool could not supply the read buffers.
+  bool run(int fd, Digests &out)
+  {
+    for (const Slot &s : slots)
+      if (s.buf.size() < chunk)
+        return false;
+    out.chunk = chunk;
+    out.size = 0;
+    out.chunks.clear();
+    libsha256_init(&whole);
+    done = false;
+
+    std::thread sequential([this]() { sequential_loop(); });
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < workers; i++) pool.emplace_back([this, &out]() { chunk_loop(out); });
+
+    bool ok = true;
+    uint64_t first_chunk = 0;
+    while (true)
+    {
+      Slot *s;
+      {
+        std::unique_lock<std::mutex> lk(mu);
+        reader_cv.wait(lk, [&]() { return !free_slots.empty(); });
+        s = free_slots.front();
+        free_slots.pop_front();
+      }
+
+      // Fill the buffer completely unless the file ends, so chunk boundaries stay at multiples of the chunk size.
+      size_t len = 0;
+      ssize_t n = 0;
+      while (len < s->buf.size() && (n = read(fd, s->buf.data() + len, s->buf.size() - len)) != 0)
+      {
+        if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          ok = false;
+          break;
+        }
+        len += n;
+      }
+      if (!ok || len == 0)
+      {
+        std::lock_guard<std::mutex> lk(mu);
+        free_slots.push_back(s);
+        break;
+      }
+
+      size_t chunks = (len + chunk - 1) / chunk;
+      {
+        std::lock_guard<std::mutex> lk(mu);
+        s->len = len;
+        s->first_chunk = first_chunk;
+        s->pending = 1 + (chunks + lanes() - 1) / lanes();
+        out.size += len;
+        out.chunks.resize((first_chunk + chunks) * 32);
+        in_order.push_back(s);
+        for (size_t c = 0; c < chunks; c += lanes()) tasks.push_back({s, c, std::min(chunks, c + lanes())});
+      }
+      seq_cv.notify_one();
+      work_cv.notify_all();
+      first_chunk += chunks;
+      if (len < s->buf.size())
+        break;
+    }
+
+    {
+      std::unique_lock<std::mutex> lk(mu);
+      reader_cv.wait(lk, [&]() { return free_slots.size() == slots.size(); });
+      done = true;
+    }
+    seq_cv.notify_all();
+    work_cv.notify_all();
+    sequential.join();
+    for (auto &t : pool) t.join();
+
+    libsha256_final(&whole, out.file);
+    libsha256(out.chunks.data(), out.chunks.size(), out.root);
+    return ok;
+  }
+
+private:
+  struct Slot
+  {
+    explicit Slot(size_t bytes) : buf(bytes) {}
+    PoolBuffer buf;
+    size_t len = 0;
+    uint64_t first_chunk = 0;
+    unsigned pending = 0;  // the sequential pass plus one per chunk task
+  };
+
+  struct Task
+  {
+    Slot *slot;
+    size_t first, last;  // chunk indices within the slot
+  };
+
+  static size_t lanes() { return std::max<size_t>(1, libsha256_batch_lanes()); }
+
+  // Called with mu held.
+  void release(Slot *s)
+  {
+    if (--s->pending == 0)
+    {
+      free_slots.push_back(s);
+      reader_cv.notify_one();
+    }
+  }
+
+  void sequential_loop()
+  {
+    std::unique_lock<std::mutex> lk(mu);
+    while (true)
+    {
+      seq_cv.wait(lk, [&]() { return done || !in_order.empty(); });
+      if (in_order.empty())
+        return;
+      Slot *s = in_order.front();
+      in_order.pop_front();
+      lk.unlock();
+      libsha256_update(&whole, s->buf.data(), s->len);
+      lk.lock();
+      release(s);
+    }
+  }
+
+  void chunk_loop(Digests &out)
+  {
+    const void *msgs[16];
+    size_t lens[16];
+    uint8_t digests[16][32];
+    std::unique_lock<std::mutex> lk(mu);
+    while (true)
+    {
+      work_cv.wait(lk, [&]() { return done || !tasks.empty(); });
+      if (tasks.empty())
+        return;
+      Task t = tasks.front();
+      tasks.pop_front();
+      lk.unlock();
+
+      size_t n = t.last - t.first;
+      for (size_t i = 0; i < n; i++)
+      {
+        size_t off = (t.first + i) * chunk;
+        msgs[i] = t.slot->buf.data() + off;
+        lens[i] = std::min(chunk, t.slot->len - off);
+      }
+      libsha256_batch(msgs, lens, n, digests);
+
+      lk.lock();
+      // out.chunks is only resized by the reader while holding mu, so the copy happens under it too.
+      memcpy(out.chunks.data() + (t.slot->first_chunk + t.first) * 32, digests, n * 32);
+      release(t.slot);
+    }
+  }
+
+  size_t chunk;
+  unsigned workers;
+  std::deque<Slot> slots;
+  std::mutex mu;
+  std::condition_variable reader_cv, seq_cv, work_cv;
+  std::deque<Slot *> free_slots, in_order;
+  std::deque<Task> tasks;
+  libsha256_ctx whole;
+  bool done = false;
+};
+
+/* Sidecar I/O. */
+
+static void put_le(uint8_t *p, uint64_t v, int bytes)
+{
+  for (int i = 0; i < bytes; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes)
+{
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++) v |= (uint64_t)p[i] << (8 * i);
+  return v;
+}
+
+static bool write_sidecar(const std::string &path, const Digests &d)
+{
+  uint8_t header[HEADER] = {};
+  memcpy(header, MAGIC, 8);
+  put_le(header + 8, d.chunk, 4);
+  put_le(header + 16, d.size, 8);
+  memcpy(header + 24, d.file, 32);
+  memcpy(header + 56, d.root, 32);
+  FILE *fp = fopen(path.c_str(), "wb");
+  if (!fp)
+    return false;
+  bool ok = fwrite(header, 1, HEADER, fp) == HEADER && fwrite(d.chunks.data(), 1, d.chunks.size(), fp) == d.chunks.size();
+  return fclose(fp) == 0 && ok;
+}
+
+static bool read_sidecar(const std::string &path, Digests &d)
+{
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (!fp)
+    return false;
+  uint8_t header[HEADER];
+  bool ok = fread(header, 1, HEADER, fp) == HEADER && !memcmp(header, MAGIC, 8);
+  if (ok)
+  {
+    d.chunk = get_le(header + 8, 4);
+    d.size = get_le(header + 16, 8);
+    memcpy(d.file, header + 24, 32);
+    memcpy(d.root, header + 56, 32);
+    ok = d.chunk >= 64 && d.chunk <= BufferPool::MAX_CLASS;
+  }
+  if (ok)
+  {
+    d.chunks.resize((d.size + d.chunk - 1) / d.chunk * 32);
+    ok = fread(d.chunks.data(), 1, d.chunks.size(), fp) == d.chunks.size() && fgetc(fp) == EOF;
+  }
+  fclose(fp);
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  HashProfile profile = load_profile();
+  size_t chunk = 1 << 20;
+  unsigned threads = 0;
+  bool verbose = false, usage = false;
+  std::string sidecar, verify, print;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--chunk" && i + 1 < argc)
+    {
+      long bytes = atol(argv[++i]);
+      usage |= bytes < 64 || (size_t)bytes > BufferPool::MAX_CLASS;  // every chunk must fit one pool buffer
+      chunk = (size_t)bytes & ~(size_t)63;
+    }
+    else if ((arg == "-j" || arg == "--threads") && i + 1 < argc)
+      threads = atoi(argv[++i]);
+    else if ((arg == "-o" || arg == "--sidecar") && i + 1 < argc)
+      sidecar = argv[++i];
+    else if (arg == "--verify" && i + 1 < argc)
+      verify = argv[++i];
+    else if (arg == "--print" && i + 1 < argc)
+      print = argv[++i];
+    else if (arg == "-v")
+      verbose = true;
+    else if (!arg.empty() && arg[0] == '-' && arg != "-")
+      usage = true;
+    else
+      files.push_back(arg);
+  }
+
+  if (!print.empty() && !usage)
+  {
+    Digests d;
+    if (!read_sidecar(print, d))
+    {
+      fprintf(stderr, "%s: not a readable multi-digest sidecar\n", print.c_str());
+      return 1;
+    }
+    printf("size %llu\nsha256 %s\nroot %s\nchunk_size %u\n", (unsigned long long)d.size, to_hex(d.file).c_str(), to_hex(d.root).c_str(),
+           d.chunk);
+    for (size_t c = 0; c < d.num_chunks(); c++) printf("chunk %zu %s\n", c, to_hex(&d.chunks[32 * c]).c_str());
+    return 0;
+  }
+  if (usage || files.empty() || (!verify.empty() && files.size() != 1) || (!sidecar.empty() && files.size() != 1))
+  {
+    fprintf(stderr,
+            "usage: %s [--chunk BYTES] [-j THREADS] [-o SIDECAR] [-v] FILE...   (sidecar defaults to FILE.sha256md)\n"
+            "       %s --verify SIDECAR FILE\n"
+            "       %s --print SIDECAR\n"
+            "--chunk is 64 bytes to %zu MiB\n",
+            argv[0], argv[0], argv[0], BufferPool::MAX_CLASS >> 20);
+    return 1;
+  }
+
+  std::string backend = apply_profile_backend(profile);
+  BufferPool::get().set_hugepages(profile.hugepages);
+  unsigned workers = threads ? threads : std::max(1u, profile_workers(profile, backend) - 1);
+
+  Digests expected;
+  if (!verify.empty())
+  {
+    if (!read_sidecar(verify, expected))
+    {
+      fprintf(stderr, "%s: not a readable multi-digest sidecar\n", verify.c_str());
+      return 1;
+    }
+    chunk = expected.chunk;
+  }
+
+  // Pool buffers top out at 4 MiB; read at least four chunks at a time when they fit.
+  size_t read_size = std::min<size_t>(BufferPool::MAX_CLASS, std::max(chunk * 4, profile.chunk));
+  MultiDigest md(chunk, read_size, workers, workers + 2);
+  int status = 0;
+
+  for (const std::string &name : files)
+  {
+    int fd = name == "-" ? STDIN_FILENO : open(name.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      fprintf(stderr, "%s: %s\n", name.c_str(), strerror(errno));
+      status = 1;
+      continue;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    Digests d;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = md.run(fd, d);
+    double seconds = seconds_since(start);
+    if (fd != STDIN_FILENO)
+      close(fd);
+    if (!ok)
+    {
+      fprintf(stderr, "%s: read error or out of buffer memory\n", name.c_str());
+      status = 1;
+      continue;
+    }
+
+    if (!verify.empty())
+    {
+      size_t bad = 0, n = std::max(d.num_chunks(), expected.num_chunks());
+      for (size_t c = 0; c < n; c++)
+      {
+        bool have = c < d.num_chunks() && c < expected.num_chunks();
+        if (!have || memcmp(&d.chunks[32 * c], &expected.chunks[32 * c], 32) != 0)
+        {
+          uint64_t from = c * (uint64_t)chunk, to = std::min<uint64_t>(from + chunk, std::max(d.size, expected.size));
+          printf("%s: chunk %zu (bytes %llu-%llu) FAILED\n", name.c_str(), c, (unsigned long long)from, (unsigned long long)to - 1);
+          bad++;
+        }
+      }
+      bool whole = d.size == expected.size && !memcmp(d.file, expected.file, 32) && !memcmp(d.root, expected.root, 32);
+      printf("%s: %s\n", name.c_str(), whole && !bad ? "OK" : "FAILED");
+      if (!whole || bad)
+        status = 1;
+      continue;
+    }
+
+    std::string out = sidecar.empty() ? (name == "-" ? "stdin.sha256md" : name + ".sha256md") : sidecar;
+    if (!write_sidecar(out, d))
+    {
+      fprintf(stderr, "%s: %s\n", out.c_str(), strerror(errno));
+      status = 1;
+    }
+    printf("%s  %s\n", to_hex(d.file).c_str(), name.c_str());
+    if (verbose)
+      fprintf(stderr, "%s: root %s, %zu chunks of %zu bytes, %.1f MB/s (%s, %u chunk workers)\n", name.c_str(), to_hex(d.root).c_str(),
+              d.num_chunks(), chunk, d.size / seconds / 1e6, backend.c_str(), workers);
+  }
+  return status;
+}
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_profile.h"
+
+/*
+  Placement benchmark.
+
+  Tree-hashes a large buffer: the buffer is cut into fixed-size chunks, every chunk is hashed on its own and the root
+  is the SHA-256 of the concatenated chunk digests. Worker i owns a contiguous run of chunks. Each placement policy
+  from sha256_placement.h is run with every libsha256 backend this CPU supports (each worker hands its chunks to
+  libsha256_batch(), so the vector backends hash a lane's worth per call), and with the chunk buffers either allocated
+  and filled by the main thread or by each worker after it has been placed, so its pages are on its own node. Every
+  run must reproduce the same root.
+*/
+
+// Byte j of the input, so every layout holds the same message.
+static inline uint8_t input_byte(uint64_t j) { return (j * 2654435761u) >> 24; }
+
+struct Run
+{
+  Placement placement;
+  std::string backend;
+  bool local;  // chunk buffers first-touched by their worker
+};
+
+struct Result
+{
+  double seconds;  // best pass
+  unsigned workers;
+  uint8_t root[32];
+};
+
+static void fill_chunk(uint8_t *dest, uint64_t index, size_t chunk)
+{
+  for (size_t j = 0; j < chunk; j++) dest[j] = input_byte(index * chunk + j);
+}
+
+// Digests for chunks [first, last) whose data starts at base with the given stride.
+static void hash_chunks(uint8_t *base, size_t stride, size_t chunk, size_t first, size_t last, uint8_t (*digests)[32])
+{
+  size_t n = last - first;
+  std::vector<const void *> msgs(n);
+  std::vector<size_t> lens(n, chunk);
+  for (size_t i = 0; i < n; i++) msgs[i] = base + i * stride;
+  libsha256_batch(msgs.data(), lens.data(), n, digests + first);
+}
+
+static Result run(const Run &r, uint8_t *shared, size_t num_chunks, size_t chunk, unsigned threads, int passes)
+{
+  Result res;
+  size_t stride = chunk;
+  std::vector<uint8_t> digest_bytes(32 * num_chunks);
+  auto digests = reinterpret_cast<uint8_t(*)[32]>(digest_bytes.data());
+  libsha256_set_backend(r.backend.c_str());
+  res.workers = std::min<size_t>(placement_workers(r.placement, r.backend, threads), num_chunks);
+  std::atomic<unsigned> ready{0};
+  std::atomic<int> released{-1};
+  std::vector<double> pass_seconds(passes);
+  std::vector<std::chrono::steady_clock::time_point> pass_end(passes);
+  std::vector<std::thread> workers;
+  std::mutex m;
+  std::condition_variable cv;
+
+  // The worker that brings `ready` to target stamps the end of the pass and wakes the timing thread, which blocks
+  // instead of spinning so it never takes a core from the workers it is timing.
+  auto arrive = [&](unsigned target, std::chrono::steady_clock::time_point *end)
+  {
+    if (ready.fetch_add(1) + 1 != target)
+      return;
+    if (end)
+      *end = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m);
+    cv.notify_one();
+  };
+  auto wait_ready = [&](unsigned target)
+  {
+    std::unique_lock<std::mutex> lock(m);
+    cv.wait(lock, [&] { return ready.load() >= target; });
+  };
+
+  for (unsigned w = 0; w < res.workers; w++)
+    workers.emplace_back(
+        [&, w]()
+        {
+          place_current_thread(r.placement, r.backend, w);
+          size_t first = num_chunks * w / res.workers, last = num_chunks * (w + 1) / res.workers;
+          uint8_t *base = shared + first * stride;
+          size_t bytes = (last - first) * stride;
+          if (r.local)
+          {
+            base = (uint8_t *)alloc_local(bytes);
+            for (size_t c = first; c < last; c++) fill_chunk(base + (c - first) * stride, c, chunk);
+          }
+          arrive(res.workers, nullptr);
+          for (int p = 0; p < passes; p++)
+          {
+            while (released.load(std::memory_order_acquire) < p) std::this_thread::yield();
+            hash_chunks(base, stride, chunk, first, last, digests);
+            arrive(res.workers * (p + 2), &pass_end[p]);
+          }
+          if (r.local)
+            free_local(base, bytes);
+        });
+
+  wait_ready(res.workers);
+  for (int p = 0; p < passes; p++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    released.store(p, std::memory_order_release);
+    wait_ready(res.workers * (p + 2));
+    pass_seconds[p] = std::chrono::duration<double>(pass_end[p] - start).count();
+  }
+  for (auto &t : workers) t.join();
+
+  libsha256(digest_bytes.data(), digest_bytes.size(), res.root);
+  res.seconds = *std::min_element(pass_seconds.begin(), pass_seconds.end());
+  return res;
+}
+
+int main(int argc, char **argv)
+{
+  size_t size_mb = 512, chunk = 1 << 20;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  int passes = 3;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--size-mb" && i + 1 < argc)
+      size_mb = std::max(1L, atol(argv[++i]));
+    else if (arg == "--chunk" && i + 1 < argc)
+      chunk = std::max(64L, atol(argv[++i])) & ~(size_t)63;
+    else if (arg == "-j" && i + 1 < argc)
+      threads = std::max(1, atoi(argv[++i]));
+    else if (arg == "--passes" && i + 1 < argc)
+      passes = std::max(1, atoi(argv[++i]));
+    else
+    {
+      fprintf(stderr, "usage: %s [--size-mb N] [--chunk BYTES] [-j THREADS] [--passes N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  const Topology &topo = Topology::get();
+  size_t num_chunks = std::max<size_t>(1, (size_mb << 20) / chunk);
+  size_t stride = chunk;
+  printf("%zu logical CPUs, %d physical cores, %d NUMA nodes; %zu chunks of %zu KiB, %u threads requested\n\n", topo.cpus.size(),
+         topo.num_cores, topo.num_nodes, num_chunks, chunk >> 10, threads);
+
+  // The main-thread layout: allocated and faulted once, on whichever node the main thread runs.
+  uint8_t *shared = (uint8_t *)alloc_local(num_chunks * stride);
+  if (!shared)
+  {
+    fprintf(stderr, "could not allocate %zu bytes\n", num_chunks * stride);
+    return 1;
+  }
+  for (size_t c = 0; c < num_chunks; c++) fill_chunk(shared + c * stride, c, chunk);
+
+  std::vector<std::string> backends;
+  for (size_t i = 0; libsha256_backend_at(i); i++) backends.push_back(libsha256_backend_at(i));
+
+  uint8_t expected[32];
+  bool have_expected = false, mismatch = false;
+  printf("%-11s %-8s %-7s %7s %9s\n", "backend", "policy", "memory", "workers", "GB/s");
+  for (const auto &backend : backends)
+    for (int p = 0; p <= (int)Placement::Auto; p++)
+      for (bool local : {false, true})
+      {
+        Run r{(Placement)p, backend, local};
+        Result res = run(r, shared, num_chunks, chunk, threads, passes);
+        double gbps = (double)num_chunks * chunk / res.seconds / 1e9;
+        printf("%-11s %-8s %-7s %7u %9.3f", backend.c_str(), placement_name(r.placement), local ? "local" : "main", res.workers, gbps);
+        if (!have_expected)
+          memcpy(expected, res.root, 32), have_expected = true;
+        if (memcmp(expected, res.root, 32) != 0)
+        {
+          printf("  root mismatch");
+          mismatch = true;
+        }
+        printf("\n");
+      }
+
+  printf("\nRoot: ");
+  for (int i = 0; i < 32; i++) printf("%02x", expected[i]);
+  printf("\n");
+  free_local(shared, num_chunks * stride);
+  return mismatch ? 1 : 0;
+}
@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_drbg.h"
+#include "sha256_profile.h"
+#include "sha256_qos.h"
+
+/*
+  Mixed-load benchmark: short latency-critical requests arriving at a fixed rate while bulk streams hash large
+  buffers on the same cores.
+
+  Each run lasts --seconds. A generator thread submits --len-byte requests at --rate per second and times each from
+  submission to completion; --streams bulk streams each hash a --bulk-mb buffer over and over. Runs:
+
+    fifo      one queue and hardware_concurrency() threads, every job hashed whole when its turn comes: the plain
+              thread-pool way, where a short request can sit behind a whole buffer
+    qos       QosScheduler, bulk in --chunk-kb chunks
+    qos cap   the same with bulk capped at --cap GB/s (default: half of what uncapped bulk managed alone)
+
+  plus the latency class and the bulk class each on their own, for reference. Reports latency p50/p99/p99.9 and
+  bulk GB/s side by side. Every digest is checked.
+*/
+
+using Clock = std::chrono::steady_clock;
+
+struct Load
+{
+  double seconds = 2;
+  double rate = 20000;
+  size_t len = 64;
+  unsigned streams = 2;
+  size_t bulk_bytes = 64 << 20;
+  bool latency = true, bulk = true;
+};
+
+struct RunResult
+{
+  double p50_us = 0, p99_us = 0, p999_us = 0;
+  double requests_per_s = 0, bulk_gbps = 0;
+  uint64_t errors = 0;
+};
+
+// Whole-job FIFO pool, the baseline.
+class FifoPool
+{
+public:
+  explicit FifoPool(unsigned threads)
+  {
+    for (unsigned i = 0; i < threads; i++)
+      pool.emplace_back(
+          [this]()
+          {
+            std::unique_lock<std::mutex> lk(mu);
+            while (true)
+            {
+              if (tasks.empty())
+              {
+                if (stopping)
+                  return;
+                cv.wait(lk);
+                continue;
+              }
+              std::function<void()> task = std::move(tasks.front());
+              tasks.pop_front();
+              lk.unlock();
+              task();
+              lk.lock();
+            }
+          });
+  }
+
+  ~FifoPool()
+  {
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      stopping = true;
+    }
+    cv.notify_all();
+    for (auto &t : pool) t.join();
+  }
+
+  void submit(std::function<void()> task)
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    tasks.push_back(std::move(task));
+    cv.notify_one();
+  }
+
+private:
+  std::mutex mu;
+  std::condition_variable cv;
+  std::deque<std::function<void()>> tasks;
+  bool stopping = false;
+  std::vector<std::thread> pool;
+};
+
+// Submission functions for one scheduler; done receives the digest.
+struct Target
+{
+  std::function<void(const uint8_t *, size_t, QosScheduler::Done)> small;
+  std::function<void(const uint8_t *, size_t, QosScheduler::Done)> bulk;
+};
+
+static RunResult run(const Target &target, const Load &load, const std::vector<uint8_t> &buffer, const uint8_t *buffer_digest,
+                     const std::vector<uint8_t> &messages, const std::vector<std::array<uint8_t, 32>> &message_digests)
+{
+  Clock::time_point start = Clock::now(), deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(load.seconds));
+  std::atomic<uint64_t> errors{0}, bulk_bytes{0}, outstanding{0};
+  std::atomic<bool> over{false};
+
+  // Bulk streams resubmit their buffer from the completion until the deadline.
+  std::function<void()> submit_bulk = [&]()
+  {
+    outstanding++;
+    target.bulk(buffer.data(), buffer.size(),
+                [&](const uint8_t digest[32])
+                {
+                  errors += memcmp(digest, buffer_digest, 32) != 0;
+                  if (Clock::now() < deadline)
+                  {
+                    bulk_bytes += buffer.size();
+                    if (!over)
+                      submit_bulk();
+                  }
+                  outstanding--;
+                });
+  };
+  if (load.bulk)
+    for (unsigned i = 0; i < load.streams; i++) submit_bulk();
+
+  // Latency requests go out on a fixed schedule, in whatever number is due each time the generator wakes.
+  size_t count = load.latency ? (size_t)(load.rate * load.seconds) : 0, n_messages = message_digests.size();
+  std::vector<uint32_t> latency_ns(count, UINT32_MAX);
+  std::vector<Clock::time_point> sent(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    Clock::time_point due = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(i / load.rate));
+    if (Clock::now() < due)
+      std::this_thread::sleep_until(due);
+    sent[i] = Clock::now();
+    outstanding++;
+    size_t m = i % n_messages;
+    target.small(messages.data() + m * load.len, load.len,
+                 [&, i, m](const uint8_t digest[32])
+                 {
+                   latency_ns[i] = std::min<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - sent[i]).count(),
+                                                      UINT32_MAX - 1);
+                   errors += memcmp(digest, message_digests[m].data(), 32) != 0;
+                   outstanding--;
+                 });
+  }
+  std::this_thread::sleep_until(deadline);
+  over = true;
+  while (outstanding) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  RunResult r;
+  r.errors = errors;
+  r.bulk_gbps = bulk_bytes / load.seconds / 1e9;
+  std::vector<uint32_t> done;
+  for (uint32_t v : latency_ns)
+    if (v != UINT32_MAX)
+      done.push_back(v);
+  r.requests_per_s = done.size() / load.seconds;
+  if (!done.empty())
+  {
+    std::sort(done.begin(), done.end());
+    auto at = [&](double q) { return done[std::min(done.size() - 1, (size_t)(q * done.size()))] / 1e3; };
+    r.p50_us = at(0.5), r.p99_us = at(0.99), r.p999_us = at(0.999);
+  }
+  return r;
+}
+
+static void print(const char *name, const RunResult &r, const Load &load)
+{
+  if (load.latency)
+    printf("%-14s %10.1f %10.1f %10.1f %12.1f", name, r.p50_us, r.p99_us, r.p999_us, r.requests_per_s / 1e3);
+  else
+    printf("%-14s %10s %10s %10s %12s", name, "-", "-", "-", "-");
+  if (load.bulk)
+    printf(" %10.2f", r.bulk_gbps);
+  else
+    printf(" %10s", "-");
+  printf("%s\n", r.errors ? "  WRONG DIGESTS" : "");
+}
+
+int main(int argc, char **argv)
+{
+  Load load;
+  QosOptions opt;
+  double cap_gbps = 0;
+  bool usage = false;
+  for (int i = 1; i < argc && !usage; ++i)
+  {
+    std::string arg = argv[i];
+    if (i + 1 >= argc)
+      usage = true;
+    else if (arg == "--seconds")
+      load.seconds = std::max(0.2, atof(argv[++i]));
+    else if (arg == "--rate")
+      load.rate = std::max(1.0, atof(argv[++i]));
+    else if (arg == "--len")
+      load.len = std::max(1, atoi(argv[++i]));
+    else if (arg == "--streams")
+      load.streams = std::max(1, atoi(argv[++i]));
+    else if (arg == "--bulk-mb")
+      load.bulk_bytes = (size_t)std::max(1, atoi(argv[++i])) << 20;
+    else if (arg == "--chunk-kb")
+      opt.chunk = (size_t)std::max(1, atoi(argv[++i])) << 10;
+    else if (arg == "--max-wait-us")
+      opt.max_wait_us = atoi(argv[++i]);
+    else if (arg == "--workers")
+      opt.workers = std::max(1, atoi(argv[++i]));
+    else if (arg == "--reserved")
+      opt.reserved_workers = atoi(argv[++i]);
+    else if (arg == "--cap")
+      cap_gbps = atof(argv[++i]);
+    else
+      usage = true;
+  }
+  usage |= opt.reserved_workers >= opt.workers;  // bulk needs at least one worker
+  if (usage)
+  {
+    fprintf(stderr,
+            "usage: %s [--seconds S] [--rate REQ/S] [--len BYTES] [--streams N] [--bulk-mb MB] [--chunk-kb KB]\n"
+            "          [--max-wait-us N] [--workers N] [--reserved N] [--cap GB/S]   (--reserved below --workers)\n",
+            argv[0]);
+    return 1;
+  }
+
+  std::string backend = apply_profile_backend(load_profile());
+  CounterDrbg drbg(uint64_t(46));
+  std::vector<uint8_t> buffer(load.bulk_bytes), messages(load.len * 1024);
+  drbg.read(buffer.data(), buffer.size());
+  drbg.read(messages.data(), messages.size());
+  uint8_t buffer_digest[32];
+  libsha256(buffer.data(), buffer.size(), buffer_digest);
+  std::vector<std::array<uint8_t, 32>> message_digests(1024);
+  for (size_t i = 0; i < message_digests.size(); i++) libsha256(messages.data() + i * load.len, load.len, message_digests[i].data());
+
+  printf("Backend %s, workers %u (%u reserved), %.0f req/s of %zu bytes, %u bulk streams of %zu MiB, %zu KiB chunks, %.1f s per run\n\n",
+         backend.c_str(), opt.workers, opt.reserved_workers, load.rate, load.len, load.streams, load.bulk_bytes >> 20, opt.chunk >> 10,
+         load.seconds);
+  printf("%-14s %10s %10s %10s %12s %10s\n", "", "p50 us", "p99 us", "p99.9 us", "k req/s", "bulk GB/s");
+
+  uint64_t errors = 0;
+  auto qos_run = [&](const char *name, Load l, double cap_bytes_per_s)
+  {
+    QosScheduler qos(opt);
+    int cls = qos.add_bulk_class("bulk", cap_bytes_per_s);
+    Target t = {[&](const uint8_t *d, size_t n, QosScheduler::Done done) { qos.hash(d, n, std::move(done)); },
+                [&](const uint8_t *d, size_t n, QosScheduler::Done done) { qos.hash_bulk(cls, d, n, std::move(done)); }};
+    RunResult r = run(t, l, buffer, buffer_digest, messages, message_digests);
+    print(name, r, l);
+    errors += r.errors;
+    return r;
+  };
+
+  Load only = load;
+  only.bulk = false;
+  qos_run("latency only", only, 0);
+  only = load;
+  only.latency = false;
+  RunResult bulk_alone = qos_run("bulk only", only, 0);
+
+  {
+    FifoPool pool(opt.workers);
+    auto whole = [&](const uint8_t *d, size_t n, QosScheduler::Done done)
+    {
+      pool.submit(
+          [d, n, done = std::move(done)]()
+          {
+            uint8_t digest[32];
+            libsha256(d, n, digest);
+            done(digest);
+          });
+    };
+    RunResult r = run({whole, whole}, load, buffer, buffer_digest, messages, message_digests);
+    print("fifo", r, load);
+    errors += r.errors;
+  }
+  qos_run("qos", load, 0);
+  double cap = cap_gbps > 0 ? cap_gbps * 1e9 : bulk_alone.bulk_gbps * 1e9 / 2;
+  char name[32];
+  snprintf(name, sizeof(name), "qos cap %.2f", cap / 1e9);
+  qos_run(name, load, cap);
+
+  if (errors)
+    printf("\n%llu wrong digests\n", (unsigned long long)errors);
+  return errors ? 1 : 0;
+}
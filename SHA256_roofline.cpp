@@ -0,0 +1,431 @@
+#include <immintrin.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_profile.h"
+#include "sha256_util.h"
+
+/*
+  Measured roofline for the SHA-256 backends on this host (one core).
+
+  Ceilings:
+    - peak integer op rate of each execution unit a backend uses: scalar ALU (xor/add chains, which every ALU port
+      executes; rotates issue on only some of them, so a rotate-heavy kernel would measure those ports and sit below
+      what the SHA-256 mix of rotates, adds, logic and lea reaches), AVX2 and AVX-512 32-bit lane ops, and SHA-NI
+      sha256rnds2 instructions;
+    - read bandwidth at working sets that fit L1, L2 and L3, and one well beyond L3 (DRAM).
+
+  Points: every supported backend hashes 1 KiB messages (libsha256_batch, full lanes) out of buffers from 16 KiB up
+  to the DRAM working set, reporting compressions/s and bytes/s.
+
+  Ops per block count the instructions the backend's compression function is written with, with rotates as one op
+  where the ISA has them: 2232 for scalar (the same ~2,200 ANALYSIS.md used to estimate), 3320 for AVX2 (a rotate is
+  two shifts and an or) and 1560 for AVX-512 (vprord, vpternlogd). SHA-NI is measured in its own unit, 32
+  sha256rnds2 per block. Arithmetic intensity is ops per byte hashed, so each backend sits on its own roofline:
+  attainable = min(compute ceiling, bandwidth x intensity).
+
+  Writes roofline.json and a plot-ready roofline.csv (one row per point, with both ceilings and the fraction of the
+  attainable rate reached).
+*/
+
+static const size_t MESSAGE = 1024;
+
+struct BackendModel
+{
+  const char *backend;
+  const char *unit;  // execution unit whose peak bounds it
+  double ops_per_block;
+};
+
+static const BackendModel MODELS[] = {
+  {"scalar", "scalar", 2232}, {"interleaved", "scalar", 2232}, {"avx2", "avx2", 3320}, {"avx512", "avx512", 1560}, {"shani", "shani", 32},
+};
+
+// Grows the iteration count until one run of kernel(iterations) takes at least min_s, then returns the best of
+// `repeats` runs at that count in units per second (kernel returns the units it did). Best-of filters out the
+// preemption and frequency noise a shared host adds; ceilings especially must not be underestimated.
+template <typename F> static double rate(F kernel, double min_s = 0.2, int repeats = 3)
+{
+  for (uint64_t iters = 1024;; iters *= 2)
+  {
+    double t0 = now_s();
+    double units = kernel(iters);
+    double dt = now_s() - t0;
+    if (dt < min_s)
+      continue;
+    double best = units / dt;
+    for (int r = 1; r < repeats; r++)
+    {
+      t0 = now_s();
+      units = kernel(iters);
+      best = std::max(best, units / (now_s() - t0));
+    }
+    return best;
+  }
+}
+
+/*
+  Peak op rates: independent dependency chains in named registers (an array would live on the stack), so throughput
+  rather than latency is measured. The empty asm keeps the compiler from merging or vectorising the chains.
+*/
+
+#define REPEAT8(M) M(0) M(1) M(2) M(3) M(4) M(5) M(6) M(7)
+#define REPEAT12(M) REPEAT8(M) M(8) M(9) M(10) M(11)
+
+static double scalar_ops(uint64_t iters)
+{
+  uint32_t k1 = 0x9e3779b9, k2 = 0x7f4a7c15;
+  asm volatile("" : "+r"(k1), "+r"(k2));  // opaque, or the xor and add get folded into one constant
+#define DECL(n) uint32_t a##n = n;
+#define STEP(n)             \
+  a##n = (a##n ^ k1) + k2; \
+  asm volatile("" : "+r"(a##n));
+#define FOLD(n) ^a##n
+  REPEAT12(DECL)
+  for (uint64_t i = 0; i < iters; i++)
+  {
+    REPEAT12(STEP)
+  }
+  volatile uint32_t sink = 0 REPEAT12(FOLD);
+  (void)sink;
+  return iters * 12.0 * 2;
+#undef DECL
+#undef STEP
+#undef FOLD
+}
+
+__attribute__((target("avx2"))) static double avx2_ops(uint64_t iters)
+{
+  const __m256i k1 = _mm256_set1_epi32(0x9e3779b9), k2 = _mm256_set1_epi32(0x7f4a7c15);
+#define DECL(n) __m256i a##n = _mm256_set1_epi32(n);
+#define STEP(n)                                           \
+  a##n = _mm256_add_epi32(_mm256_xor_si256(a##n, k1), k2); \
+  asm volatile("" : "+x"(a##n));
+#define FOLD(n) ^_mm256_extract_epi32(a##n, 0)
+  REPEAT12(DECL)
+  for (uint64_t i = 0; i < iters; i++)
+  {
+    REPEAT12(STEP)
+  }
+  volatile int sink = 0 REPEAT12(FOLD);
+  (void)sink;
+  return iters * 12.0 * 2 * 8;
+#undef DECL
+#undef STEP
+#undef FOLD
+}
+
+__attribute__((target("avx512f"))) static double avx512_ops(uint64_t iters)
+{
+  const __m512i k1 = _mm512_set1_epi32(0x9e3779b9), k2 = _mm512_set1_epi32(0x7f4a7c15);
+#define DECL(n) __m512i a##n = _mm512_set1_epi32(n);
+#define STEP(n)                                           \
+  a##n = _mm512_add_epi32(_mm512_xor_si512(a##n, k1), k2); \
+  asm volatile("" : "+v"(a##n));
+#define FOLD(n) +_mm512_reduce_add_epi32(a##n)
+  REPEAT12(DECL)
+  for (uint64_t i = 0; i < iters; i++)
+  {
+    REPEAT12(STEP)
+  }
+  volatile int sink = 0 REPEAT12(FOLD);
+  (void)sink;
+  return iters * 12.0 * 2 * 16;
+#undef DECL
+#undef STEP
+#undef FOLD
+}
+
+__attribute__((target("sha,sse4.1"))) static double shani_ops(uint64_t iters)
+{
+  const __m128i b = _mm_set1_epi32(0x510e527f), k = _mm_set1_epi32(0x428a2f98);
+#define DECL(n) __m128i a##n = _mm_set1_epi32(n);
+#define STEP(n)                                 \
+  a##n = _mm_sha256rnds2_epu32(b, a##n, k); \
+  asm volatile("" : "+x"(a##n));
+#define FOLD(n) ^_mm_extract_epi32(a##n, 0)
+  REPEAT8(DECL)
+  for (uint64_t i = 0; i < iters; i++)
+  {
+    REPEAT8(STEP)
+  }
+  volatile int sink = 0 REPEAT8(FOLD);
+  (void)sink;
+  return iters * 8.0;
+#undef DECL
+#undef STEP
+#undef FOLD
+}
+
+/* Read bandwidth: stream the working set with the widest loads available, folding into independent accumulators. */
+
+static double read_sse2(const uint8_t *buf, size_t bytes, uint64_t passes)
+{
+  __m128i a0 = _mm_setzero_si128(), a1 = a0, a2 = a0, a3 = a0;
+  for (uint64_t p = 0; p < passes; p++)
+    for (size_t i = 0; i < bytes; i += 64)
+    {
+      a0 = _mm_xor_si128(a0, _mm_load_si128((const __m128i *)(buf + i)));
+      a1 = _mm_xor_si128(a1, _mm_load_si128((const __m128i *)(buf + i + 16)));
+      a2 = _mm_xor_si128(a2, _mm_load_si128((const __m128i *)(buf + i + 32)));
+      a3 = _mm_xor_si128(a3, _mm_load_si128((const __m128i *)(buf + i + 48)));
+    }
+  volatile int sink = _mm_cvtsi128_si32(_mm_xor_si128(_mm_xor_si128(a0, a1), _mm_xor_si128(a2, a3)));
+  (void)sink;
+  return (double)bytes * passes;
+}
+
+__attribute__((target("avx2"))) static double read_avx2(const uint8_t *buf, size_t bytes, uint64_t passes)
+{
+  __m256i a0 = _mm256_setzero_si256(), a1 = a0, a2 = a0, a3 = a0;
+  for (uint64_t p = 0; p < passes; p++)
+    for (size_t i = 0; i < bytes; i += 128)
+    {
+      a0 = _mm256_xor_si256(a0, _mm256_load_si256((const __m256i *)(buf + i)));
+      a1 = _mm256_xor_si256(a1, _mm256_load_si256((const __m256i *)(buf + i + 32)));
+      a2 = _mm256_xor_si256(a2, _mm256_load_si256((const __m256i *)(buf + i + 64)));
+      a3 = _mm256_xor_si256(a3, _mm256_load_si256((const __m256i *)(buf + i + 96)));
+    }
+  volatile int sink = _mm256_extract_epi32(_mm256_xor_si256(_mm256_xor_si256(a0, a1), _mm256_xor_si256(a2, a3)), 0);
+  (void)sink;
+  return (double)bytes * passes;
+}
+
+__attribute__((target("avx512f"))) static double read_avx512(const uint8_t *buf, size_t bytes, uint64_t passes)
+{
+  __m512i a0 = _mm512_setzero_si512(), a1 = a0, a2 = a0, a3 = a0;
+  for (uint64_t p = 0; p < passes; p++)
+    for (size_t i = 0; i < bytes; i += 256)
+    {
+      a0 = _mm512_xor_si512(a0, _mm512_load_si512(buf + i));
+      a1 = _mm512_xor_si512(a1, _mm512_load_si512(buf + i + 64));
+      a2 = _mm512_xor_si512(a2, _mm512_load_si512(buf + i + 128));
+      a3 = _mm512_xor_si512(a3, _mm512_load_si512(buf + i + 192));
+    }
+  volatile int sink = _mm512_reduce_add_epi32(_mm512_xor_si512(_mm512_xor_si512(a0, a1), _mm512_xor_si512(a2, a3)));
+  (void)sink;
+  return (double)bytes * passes;
+}
+
+struct Level
+{
+  std::string name;
+  size_t size;        // capacity; the working set is half of it (DRAM: the whole buffer)
+  double bandwidth;   // bytes/s
+};
+
+struct Point
+{
+  std::string backend, level;
+  size_t working_set;
+  double compressions, bytes;  // per second
+};
+
+static const Level &level_for(const std::vector<Level> &levels, size_t ws)
+{
+  for (const Level &l : levels)
+    if (ws <= l.size)
+      return l;
+  return levels.back();
+}
+
+static Point hash_point(const std::string &backend, const uint8_t *buf, size_t ws)
+{
+  size_t n = ws / MESSAGE, width = std::max<size_t>(1, libsha256_backend_lanes());
+  std::vector<const void *> msgs(n);
+  std::vector<size_t> lens(n, MESSAGE);
+  std::vector<uint8_t> out(n * 32);
+  for (size_t i = 0; i < n; i++) msgs[i] = buf + i * MESSAGE;
+  auto digests = reinterpret_cast<uint8_t(*)[32]>(out.data());
+
+  double passes_per_s = rate(
+      [&](uint64_t iters)
+      {
+        // iters counts messages; whole passes over the buffer keep the working set honest.
+        uint64_t passes = std::max<uint64_t>(1, iters / n);
+        for (uint64_t p = 0; p < passes; p++)
+          for (size_t i = 0; i < n; i += width) libsha256_batch(&msgs[i], &lens[i], std::min(width, n - i), digests + i);
+        return (double)passes;
+      },
+      0.25, 2);
+  return {backend, "", ws, passes_per_s * n * (MESSAGE / 64 + 1), passes_per_s * ws};
+}
+
+int main(int argc, char **argv)
+{
+  std::string json_path = "roofline.json", csv_path = "roofline.csv";
+  size_t max_mb = 256;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--json" && i + 1 < argc)
+      json_path = argv[++i];
+    else if (arg == "--csv" && i + 1 < argc)
+      csv_path = argv[++i];
+    else if (arg == "--max-mb" && i + 1 < argc)
+      max_mb = std::max(16L, atol(argv[++i]));
+    else
+    {
+      fprintf(stderr, "usage: %s [--json PATH] [--csv PATH] [--max-mb MB]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // Compute ceilings.
+  struct Unit
+  {
+    const char *name;
+    bool supported;
+    double (*kernel)(uint64_t);
+    double ops = 0;
+  };
+  __builtin_cpu_init();
+  Unit units[] = {
+    {"scalar", true, scalar_ops},
+    {"avx2", (bool)__builtin_cpu_supports("avx2"), avx2_ops},
+    {"avx512", (bool)__builtin_cpu_supports("avx512f"), avx512_ops},
+    {"shani", (bool)__builtin_cpu_supports("sha"), shani_ops},
+  };
+  printf("Peak op rates (one core)\n");
+  for (Unit &u : units)
+    if (u.supported)
+    {
+      u.ops = rate(u.kernel);
+      printf("  %-7s %8.2f G%s/s\n", u.name, u.ops / 1e9, !strcmp(u.name, "shani") ? "rnds2" : " ops");
+    }
+  auto unit_ops = [&](const char *name)
+  {
+    for (const Unit &u : units)
+      if (!strcmp(u.name, name))
+        return u.ops;
+    return 0.0;
+  };
+
+  // Bandwidth ceilings.
+  long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE), l2 = sysconf(_SC_LEVEL2_CACHE_SIZE), l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  size_t dram = max_mb << 20;
+  std::vector<Level> levels;
+  if (l1 > 0)
+    levels.push_back({"L1", (size_t)l1, 0});
+  if (l2 > 0)
+    levels.push_back({"L2", (size_t)l2, 0});
+  if (l3 > 0 && (size_t)l3 * 2 <= dram)
+    levels.push_back({"L3", (size_t)l3, 0});
+  else if (l3 > 0)
+    printf("L3 is %ld MiB, so the %zu MiB DRAM working set may still be partly cached; raise --max-mb past %ld for a true DRAM "
+           "ceiling\n",
+           l3 >> 20, max_mb, (l3 >> 20) * 2);
+  levels.push_back({"DRAM", dram, 0});
+
+  double (*read)(const uint8_t *, size_t, uint64_t) = read_sse2;
+  const char *loads = "SSE2";
+  if (__builtin_cpu_supports("avx512f"))
+    read = read_avx512, loads = "AVX-512";
+  else if (__builtin_cpu_supports("avx2"))
+    read = read_avx2, loads = "AVX2";
+  uint8_t *buf = (uint8_t *)aligned_alloc(2 << 20, dram);
+  if (!buf)
+  {
+    fprintf(stderr, "could not allocate %zu MiB\n", max_mb);
+    return 1;
+  }
+  for (size_t i = 0; i < dram; i++) buf[i] = (uint8_t)(i * 131 + 7);
+  printf("Read bandwidth (one core, %s loads)\n", loads);
+  for (Level &l : levels)
+  {
+    size_t ws = l.name == "DRAM" ? dram : l.size / 2 / 256 * 256;
+    l.bandwidth = rate(
+        [&](uint64_t iters)
+        {
+          uint64_t passes = std::max<uint64_t>(1, iters * 4096 / ws);
+          return read(buf, ws, passes);
+        });
+    printf("  %-5s %10zu KiB working set %8.2f GB/s\n", l.name.c_str(), ws >> 10, l.bandwidth / 1e9);
+  }
+
+  // Backend points.
+  std::vector<Point> points;
+  printf("Backends (1 KiB messages)\n  %-12s %12s %6s %14s %10s %9s %10s\n", "backend", "working set", "level", "compressions/s", "GB/s",
+         "of roof", "bound");
+  std::vector<std::string> backends;
+  for (size_t i = 0; const char *name = libsha256_backend_at(i); i++) backends.push_back(name);
+  for (const std::string &backend : backends)
+  {
+    const BackendModel *model = nullptr;
+    for (const BackendModel &m : MODELS)
+      if (backend == m.backend)
+        model = &m;
+    if (!model || libsha256_set_backend(backend.c_str()) != 0)
+      continue;
+    for (size_t ws = 16 << 10; ws <= dram; ws *= 4)
+    {
+      Point p = hash_point(backend, buf, ws);
+      const Level &l = level_for(levels, ws);
+      p.level = l.name;
+      double compute = unit_ops(model->unit) / model->ops_per_block, memory = l.bandwidth / 64;
+      printf("  %-12s %8zu KiB %6s %14.3e %10.2f %8.0f%% %10s\n", backend.c_str(), ws >> 10, l.name.c_str(), p.compressions, p.bytes / 1e9,
+             100 * p.compressions / std::min(compute, memory), compute <= memory ? "compute" : "bandwidth");
+      points.push_back(p);
+    }
+  }
+  apply_profile_backend(load_profile());
+  free(buf);
+
+  FILE *csv = fopen(csv_path.c_str(), "w");
+  FILE *json = fopen(json_path.c_str(), "w");
+  if (!csv || !json)
+  {
+    fprintf(stderr, "could not write %s / %s\n", csv_path.c_str(), json_path.c_str());
+    return 1;
+  }
+  fprintf(csv, "backend,unit,working_set_bytes,level,ops_per_block,intensity_ops_per_byte,compressions_per_s,bytes_per_s,achieved_ops_per_s,"
+               "compute_ceiling_ops_per_s,bandwidth_bytes_per_s,bandwidth_ceiling_ops_per_s,attainable_ops_per_s,fraction_of_attainable,bound\n");
+  fprintf(json, "{\n  \"host\": \"%s\",\n  \"message_bytes\": %zu,\n  \"compute\": {", host_name().c_str(), MESSAGE);
+  bool first = true;
+  for (const Unit &u : units)
+    if (u.supported)
+    {
+      fprintf(json, "%s\n    \"%s\": %.6e", first ? "" : ",", u.name, u.ops);
+      first = false;
+    }
+  fprintf(json, "\n  },\n  \"bandwidth\": [");
+  for (size_t i = 0; i < levels.size(); i++)
+    fprintf(json, "%s\n    {\"level\": \"%s\", \"capacity_bytes\": %zu, \"bytes_per_s\": %.6e}", i ? "," : "", levels[i].name.c_str(),
+            levels[i].size, levels[i].bandwidth);
+  fprintf(json, "\n  ],\n  \"points\": [");
+  for (size_t i = 0; i < points.size(); i++)
+  {
+    const Point &p = points[i];
+    const BackendModel *model = nullptr;
+    for (const BackendModel &m : MODELS)
+      if (p.backend == m.backend)
+        model = &m;
+    double intensity = model->ops_per_block / 64, compute = unit_ops(model->unit);
+    double bw = level_for(levels, p.working_set).bandwidth, memory = bw * intensity, roof = std::min(compute, memory);
+    double achieved = p.compressions * model->ops_per_block;
+    const char *bound = compute <= memory ? "compute" : "bandwidth";
+    fprintf(csv, "%s,%s,%zu,%s,%.0f,%.4f,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%.4f,%s\n", p.backend.c_str(), model->unit, p.working_set,
+            p.level.c_str(), model->ops_per_block, intensity, p.compressions, p.bytes, achieved, compute, bw, memory, roof, achieved / roof,
+            bound);
+    fprintf(json,
+            "%s\n    {\"backend\": \"%s\", \"unit\": \"%s\", \"working_set_bytes\": %zu, \"level\": \"%s\", \"ops_per_block\": %.0f, "
+            "\"intensity_ops_per_byte\": %.4f, \"compressions_per_s\": %.6e, \"bytes_per_s\": %.6e, \"achieved_ops_per_s\": %.6e, "
+            "\"attainable_ops_per_s\": %.6e, \"fraction_of_attainable\": %.4f, \"bound\": \"%s\"}",
+            i ? "," : "", p.backend.c_str(), model->unit, p.working_set, p.level.c_str(), model->ops_per_block, intensity, p.compressions,
+            p.bytes, achieved, roof, achieved / roof, bound);
+  }
+  fprintf(json, "\n  ]\n}\n");
+  fclose(csv);
+  fclose(json);
+  printf("Wrote %s and %s\n", json_path.c_str(), csv_path.c_str());
+  return 0;
+}
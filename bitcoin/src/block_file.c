@@ -0,0 +1,372 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "block_file.h"
+#include "job_manager.h"
+#include "utils.h"
+
+/****************************** READING ******************************/
+
+int block_file_open(Block_file *f, const char *path)
+{
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	f->path = path;
+	f->data = NULL;
+	f->len = 0;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		perror(path);
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	if (st.st_size > 0) {
+		void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) {
+			perror(path);
+			close(fd);
+			return -1;
+		}
+		madvise(p, st.st_size, MADV_SEQUENTIAL);
+		f->data = p;
+		f->len = st.st_size;
+	}
+	close(fd);
+	return 0;
+}
+
+void block_file_close(Block_file *f)
+{
+	if (f->data)
+		munmap((void *)f->data, f->len);
+	f->data = NULL;
+	f->len = 0;
+}
+
+static uint32_t read_le32(const unsigned char *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+bool block_file_index(const Block_file *f, int file_no, uint32_t magic, Block_ref **refs, size_t *n, size_t *cap)
+{
+	size_t pos = 0;
+
+	while (pos + 8 <= f->len) {
+		uint32_t m = read_le32(f->data + pos);
+		uint32_t size = read_le32(f->data + pos + 4);
+		if (m == 0)
+			return true;	//Preallocated tail
+		if (m != magic || size < BLK_HEADER_SIZE + 1 || size > BLK_MAX_SIZE || size > f->len - pos - 8) {
+			fprintf(stderr, "%s: bad block record at offset %zu\n", f->path, pos);
+			return false;
+		}
+		if (*n == *cap) {
+			*cap = *cap ? 2 * *cap : 1024;
+			*refs = realloc(*refs, *cap * sizeof(**refs));
+		}
+		(*refs)[*n].data = f->data + pos + 8;
+		(*refs)[*n].len = size;
+		(*refs)[*n].file = file_no;
+		(*refs)[*n].offset = pos + 8;
+		(*n)++;
+		pos += 8 + (size_t)size;
+	}
+	return true;
+}
+
+/****************************** PARSING ******************************/
+
+typedef struct {
+	const unsigned char *p;
+	size_t pos, len;
+	bool bad;
+} Reader;
+
+static void skip(Reader *r, uint64_t n)
+{
+	if (r->bad || n > r->len - r->pos)
+		r->bad = true;
+	else
+		r->pos += n;
+}
+
+static uint64_t read_varint(Reader *r)
+{
+	uint64_t v = 0;
+	int size, i;
+
+	if (r->bad || r->pos >= r->len) {
+		r->bad = true;
+		return 0;
+	}
+	v = r->p[r->pos++];
+	size = v == 0xfd ? 2 : v == 0xfe ? 4 : v == 0xff ? 8 : 0;
+	if (!size)
+		return v;
+	if ((size_t)size > r->len - r->pos) {
+		r->bad = true;
+		return 0;
+	}
+	for (v = 0, i = 0; i < size; i++)
+		v |= (uint64_t)r->p[r->pos++] << (8 * i);
+	return v;
+}
+
+//Every count is checked against the bytes left, so a corrupt count cannot run the parser off the block
+static bool parse_tx(Reader *r, Tx_ref *tx)
+{
+	size_t start = r->pos;
+	uint64_t vin, vout, i, items, j;
+
+	tx->data = r->p + start;
+	skip(r, 4);
+	tx->segwit = !r->bad && r->pos + 2 <= r->len && r->p[r->pos] == 0 && r->p[r->pos + 1] == 1;
+	if (tx->segwit)
+		skip(r, 2);
+	tx->body_start = r->pos - start;
+
+	vin = read_varint(r);
+	if (vin > r->len / 41)
+		return false;
+	for (i = 0; i < vin && !r->bad; i++) {
+		skip(r, 36);
+		skip(r, read_varint(r));
+		skip(r, 4);
+	}
+	vout = read_varint(r);
+	if (vout > r->len / 9)
+		return false;
+	for (i = 0; i < vout && !r->bad; i++) {
+		skip(r, 8);
+		skip(r, read_varint(r));
+	}
+	tx->body_len = r->pos - start - tx->body_start;
+
+	if (tx->segwit) {
+		for (i = 0; i < vin && !r->bad; i++) {
+			items = read_varint(r);
+			if (items > r->len)
+				return false;
+			for (j = 0; j < items && !r->bad; j++)
+				skip(r, read_varint(r));
+		}
+	}
+	skip(r, 4);
+	tx->len = r->pos - start;
+	return !r->bad;
+}
+
+long parse_block_txs(const unsigned char *block, size_t len, Tx_ref **txs, size_t *cap)
+{
+	Reader r = {block, BLK_HEADER_SIZE, len, false};
+	uint64_t count, i;
+
+	if (len < BLK_HEADER_SIZE)
+		return -1;
+	count = read_varint(&r);
+	if (r.bad || count == 0 || count > len / 60)
+		return -1;
+	if (count > *cap) {
+		*cap = count;
+		*txs = realloc(*txs, *cap * sizeof(**txs));
+	}
+	for (i = 0; i < count; i++) {
+		if (!parse_tx(&r, &(*txs)[i]))
+			return -1;
+	}
+	return r.pos == len ? (long)count : -1;
+}
+
+size_t tx_stripped_len(const Tx_ref *tx)
+{
+	return tx->segwit ? 4 + tx->body_len + 4 : tx->len;
+}
+
+//version || inputs and outputs || locktime
+void tx_strip(const Tx_ref *tx, unsigned char *out)
+{
+	memcpy(out, tx->data, 4);
+	memcpy(out + 4, tx->data + tx->body_start, tx->body_len);
+	memcpy(out + 4 + tx->body_len, tx->data + tx->len - 4, 4);
+}
+
+/****************************** GENERATOR ******************************/
+
+typedef struct {
+	unsigned char *p;
+	size_t len, cap;
+} Buf;
+
+static void put(Buf *b, const void *data, size_t len)
+{
+	if (b->len + len > b->cap) {
+		b->cap = 2 * (b->len + len);
+		b->p = realloc(b->p, b->cap);
+	}
+	memcpy(b->p + b->len, data, len);
+	b->len += len;
+}
+
+static void put_le(Buf *b, uint64_t v, int size)
+{
+	unsigned char tmp[8];
+	int i;
+	for (i = 0; i < size; i++)
+		tmp[i] = v >> (8 * i);
+	put(b, tmp, size);
+}
+
+static void put_zero(Buf *b, size_t len)
+{
+	if (b->len + len > b->cap) {
+		b->cap = 2 * (b->len + len);
+		b->p = realloc(b->p, b->cap);
+	}
+	memset(b->p + b->len, 0, len);
+	b->len += len;
+}
+
+static void put_varint(Buf *b, uint64_t v)
+{
+	if (v < 0xfd) {
+		put_le(b, v, 1);
+	} else if (v <= 0xffff) {
+		put_le(b, 0xfd, 1);
+		put_le(b, v, 2);
+	} else {
+		put_le(b, 0xfe, 1);
+		put_le(b, v, 4);
+	}
+}
+
+static void put_random(Buf *b, size_t len)
+{
+	size_t i;
+	for (i = 0; i < len; i++)
+		put_le(b, rand(), 1);
+}
+
+//Appends a transaction to blk and its txid to txid; the coinbase spends nothing and carries the height
+static void generate_tx(Buf *blk, Buf *stripped, bool coinbase, int height, unsigned char txid[32])
+{
+	int vin = coinbase ? 1 : 1 + rand() % 3;
+	int vout = 1 + rand() % 4;
+	bool segwit = !coinbase && rand() % 4 == 0;
+	size_t start = blk->len;
+	Reader r;
+	Tx_ref tx;
+	int i;
+
+	put_le(blk, 2, 4);
+	if (segwit)
+		put_le(blk, 0x0100, 2);	//Marker and flag
+	put_varint(blk, vin);
+	for (i = 0; i < vin; i++) {
+		if (coinbase) {
+			put_zero(blk, 32);
+			put_le(blk, 0xffffffff, 4);
+			put_varint(blk, 4 + 8);
+			put_le(blk, height, 4);
+			put_random(blk, 8);
+		} else {
+			put_random(blk, 32);
+			put_le(blk, rand() % 4, 4);
+			put_varint(blk, segwit ? 0 : 106);	//Signature and key in the script or the witness
+			put_random(blk, segwit ? 0 : 106);
+		}
+		put_le(blk, 0xfffffffe, 4);
+	}
+	put_varint(blk, vout);
+	for (i = 0; i < vout; i++) {
+		put_le(blk, (uint64_t)rand() * 1000, 8);
+		put_varint(blk, 25);
+		put_random(blk, 25);
+	}
+	for (i = 0; segwit && i < vin; i++) {
+		put_varint(blk, 2);
+		put_varint(blk, 72);
+		put_random(blk, 72);
+		put_varint(blk, 33);
+		put_random(blk, 33);
+	}
+	put_le(blk, 0, 4);
+
+	//The txid goes through the same parser and stripping as ingestion does
+	r.p = blk->p + start;
+	r.pos = 0;
+	r.len = blk->len - start;
+	r.bad = false;
+	parse_tx(&r, &tx);
+	stripped->len = 0;
+	put_zero(stripped, tx_stripped_len(&tx));
+	tx_strip(&tx, stripped->p);
+	sha256d(stripped->p, stripped->len, txid);
+}
+
+int generate_block_file(const char *path, uint32_t magic, int blocks, int max_tx, uint32_t nbits, unsigned int seed)
+{
+	FILE *out = fopen(path, "wb");
+	Buf blk = {0}, stripped = {0};
+	unsigned char (*txids)[32] = malloc(((size_t)max_tx + 1) * 32);
+	unsigned char prev[32] = {0}, pair[64], target[32];
+	int h, i, n, level;
+	uint32_t nonce;
+
+	if (!out) {
+		perror(path);
+		free(txids);
+		return -1;
+	}
+	srand(seed);
+	set_difficulty(target, nbits);
+	for (h = 0; h < blocks; h++) {
+		n = 1 + rand() % max_tx;
+		blk.len = 0;
+		put_le(&blk, 0x20000000, 4);
+		put(&blk, prev, 32);
+		put_zero(&blk, 32);	//Merkle root, filled in below
+		put_le(&blk, 1296688602 + 600 * h, 4);
+		put_le(&blk, nbits, 4);
+		put_le(&blk, 0, 4);
+		put_varint(&blk, n);
+		for (i = 0; i < n; i++)
+			generate_tx(&blk, &stripped, i == 0, h, txids[i]);
+
+		//Merkle root: an odd last entry is paired with itself
+		for (level = n; level > 1; level = (level + 1) / 2) {
+			for (i = 0; i < level; i += 2) {
+				memcpy(pair, txids[i], 32);
+				memcpy(pair + 32, txids[i + 1 < level ? i + 1 : i], 32);
+				sha256d(pair, 64, txids[i / 2]);
+			}
+		}
+		memcpy(blk.p + 36, txids[0], 32);
+
+		for (nonce = 0;; nonce++) {
+			blk.p[76] = nonce;
+			blk.p[77] = nonce >> 8;
+			blk.p[78] = nonce >> 16;
+			blk.p[79] = nonce >> 24;
+			sha256d(blk.p, BLK_HEADER_SIZE, prev);
+			if (hash_meets_target(prev, target))
+				break;
+		}
+
+		stripped.len = 0;
+		put_le(&stripped, magic, 4);
+		put_le(&stripped, blk.len, 4);
+		fwrite(stripped.p, 1, 8, out);
+		fwrite(blk.p, 1, blk.len, out);
+	}
+	free(blk.p);
+	free(stripped.p);
+	free(txids);
+	return fclose(out) == 0 ? 0 : -1;
+}
@@ -0,0 +1,63 @@
+#ifndef BLOCK_FILE_H
+#define BLOCK_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+	Raw block files as Bitcoin Core writes them (blk*.dat)
+
+	A file is a sequence of records: the network magic, the block size as little endian u32,
+	then the serialized block. Core preallocates the files, so a run of zero bytes where the
+	next magic should be ends the file. Files are memory mapped read-only and blocks and
+	transactions are parsed in place; the only copy made is of a segwit transaction, whose
+	txid covers its serialization without the marker, flag and witnesses.
+
+	The generator writes a regtest-style file of blocks with random legacy and segwit
+	transactions, correct Merkle roots and nonces ground to the nbits target, chained by
+	prevhash.
+*/
+
+#define BLK_MAGIC_MAINNET 0xd9b4bef9	//Magic bytes as a little endian u32
+#define BLK_MAGIC_REGTEST 0xdab5bffa
+#define BLK_HEADER_SIZE 80
+#define BLK_MAX_SIZE (32u << 20)
+
+typedef struct {
+	const char *path;
+	const unsigned char *data;
+	size_t len;
+} Block_file;
+
+typedef struct {
+	const unsigned char *data;	//Header followed by the transactions
+	uint32_t len;
+	int file;
+	uint64_t offset;			//Of the block in its file, after the record header
+} Block_ref;
+
+typedef struct {
+	const unsigned char *data;	//Full serialization, witnesses included
+	size_t len;
+	size_t body_start;			//Segwit: inputs and outputs, after the marker and flag
+	size_t body_len;
+	bool segwit;
+} Tx_ref;
+
+int block_file_open(Block_file *f, const char *path);
+void block_file_close(Block_file *f);
+
+//Appends the blocks of f to *refs (grown with realloc); returns false on a damaged record
+bool block_file_index(const Block_file *f, int file_no, uint32_t magic, Block_ref **refs, size_t *n, size_t *cap);
+
+//Transactions of one block; *txs is grown with realloc. Returns the count, or -1 if malformed.
+long parse_block_txs(const unsigned char *block, size_t len, Tx_ref **txs, size_t *cap);
+
+//Length of the serialization a txid is computed over
+size_t tx_stripped_len(const Tx_ref *tx);
+void tx_strip(const Tx_ref *tx, unsigned char *out);
+
+int generate_block_file(const char *path, uint32_t magic, int blocks, int max_tx, uint32_t nbits, unsigned int seed);
+
+#endif
@@ -0,0 +1,387 @@
+/*
+	Offline verification of raw block files
+
+	Maps blk*.dat files, splits them into blocks and spreads the blocks over worker threads
+	a chunk at a time. For a chunk, a worker parses every transaction in place and computes
+	the txids as SHA-256d through libsha256_batch, so transactions of different lengths and
+	from different blocks share the lanes of one call. The Merkle levels of all the chunk's
+	blocks are then hashed together, a level per batch, and each root is compared with its
+	header. The header hashes are batched the same way and checked against the target
+	set_difficulty() derives from nbits. Afterwards every prevhash must name another block
+	in the input, except for the first block of a chain.
+
+	--generate writes a regtest-style file to try it on.
+
+	Usage: block_ingest [--threads N] [--chunk BLOCKS] [--magic HEX] FILE...
+	       block_ingest --generate FILE [--blocks N] [--tx N] [--nbits HEX] [--seed S] [--magic HEX]
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "block_file.h"
+#include "job_manager.h"
+#include "libsha256.h"
+#include "utils.h"
+
+#define MAX_REPORTS 10	//Bad blocks described individually
+
+typedef struct {
+	uint64_t blocks;
+	uint64_t txs;
+	uint64_t segwit;
+	uint64_t bytes;
+	uint64_t malformed;
+	uint64_t bad_merkle;
+	uint64_t bad_pow;
+} Ingest_stats;
+
+typedef struct {
+	const Block_ref *refs;
+	size_t n;
+	size_t chunk;
+	const char **paths;
+	unsigned char (*hashes)[32];	//Header hash of every block, for the prevhash check
+	_Atomic size_t next;
+	_Atomic int reports;
+} Ingest;
+
+typedef struct {
+	Ingest *in;
+	pthread_t thread;
+	Ingest_stats stats;
+
+	//Scratch, grown as needed and reused across chunks
+	Tx_ref *txs;
+	size_t txs_cap;
+	const void **msgs;
+	size_t *lens;
+	size_t *stripped_at;			//Offset of a segwit transaction's copy in stripped, or SIZE_MAX
+	unsigned char (*inner)[32];
+	unsigned char (*digests)[32];
+	size_t msgs_cap;
+	unsigned char *stripped;
+	size_t stripped_len, stripped_cap;
+	unsigned char (*levels)[32];
+	size_t levels_cap;
+	size_t *start, *count;			//Per block of the chunk: first txid / level entry and how many
+} Worker;
+
+static void *grow(void *p, size_t *cap, size_t need, size_t size)
+{
+	if (need <= *cap)
+		return p;
+	*cap = need > 2 * *cap ? need : 2 * *cap;
+	return realloc(p, *cap * size);
+}
+
+static void reserve_msgs(Worker *w, size_t need)
+{
+	if (need <= w->msgs_cap)
+		return;
+	w->msgs_cap = need > 2 * w->msgs_cap ? need : 2 * w->msgs_cap;
+	w->msgs = realloc(w->msgs, w->msgs_cap * sizeof(*w->msgs));
+	w->lens = realloc(w->lens, w->msgs_cap * sizeof(*w->lens));
+	w->stripped_at = realloc(w->stripped_at, w->msgs_cap * sizeof(*w->stripped_at));
+	w->inner = realloc(w->inner, w->msgs_cap * sizeof(*w->inner));
+	w->digests = realloc(w->digests, w->msgs_cap * sizeof(*w->digests));
+}
+
+//SHA-256d of msgs[0..n) into w->digests: one batch over the messages, one over the inner digests
+static void sha256d_batch(Worker *w, size_t n)
+{
+	size_t i;
+
+	libsha256_batch(w->msgs, w->lens, n, w->inner);
+	for (i = 0; i < n; i++) {
+		w->msgs[i] = w->inner[i];
+		w->lens[i] = 32;
+	}
+	libsha256_batch(w->msgs, w->lens, n, w->digests);
+}
+
+static void report(Ingest *in, size_t b, const char *what)
+{
+	if (atomic_fetch_add(&in->reports, 1) < MAX_REPORTS)
+		fprintf(stderr, "%s: block at offset %llu: %s\n", in->paths[in->refs[b].file], (unsigned long long)in->refs[b].offset, what);
+}
+
+static uint32_t header_nbits(const unsigned char *header)
+{
+	return header[72] | header[73] << 8 | header[74] << 16 | (uint32_t)header[75] << 24;
+}
+
+static void verify_chunk(Worker *w, size_t first, size_t n)
+{
+	Ingest *in = w->in;
+	size_t b, i, total = 0, entries = 0, pairs, k;
+	long count;
+	uint32_t exponent;
+	unsigned char target[32];
+
+	//Parse: legacy transactions are hashed where they lie, segwit ones from a stripped copy
+	w->stripped_len = 0;
+	for (b = 0; b < n; b++) {
+		const Block_ref *ref = &in->refs[first + b];
+		w->start[b] = total;
+		w->count[b] = 0;
+		count = parse_block_txs(ref->data, ref->len, &w->txs, &w->txs_cap);
+		if (count < 0) {
+			w->stats.malformed++;
+			report(in, first + b, "malformed block");
+			continue;
+		}
+		reserve_msgs(w, total + count);
+		for (i = 0; i < (size_t)count; i++) {
+			const Tx_ref *tx = &w->txs[i];
+			w->lens[total + i] = tx_stripped_len(tx);
+			w->msgs[total + i] = tx->data;
+			w->stripped_at[total + i] = SIZE_MAX;
+			if (tx->segwit) {
+				w->stripped = grow(w->stripped, &w->stripped_cap, w->stripped_len + w->lens[total + i], 1);
+				tx_strip(tx, w->stripped + w->stripped_len);
+				w->stripped_at[total + i] = w->stripped_len;
+				w->stripped_len += w->lens[total + i];
+				w->stats.segwit++;
+			}
+		}
+		w->count[b] = count;
+		total += count;
+		w->stats.txs += count;
+		w->stats.bytes += ref->len;
+	}
+
+	//The copies stop moving once the whole chunk is parsed
+	for (i = 0; i < total; i++) {
+		if (w->stripped_at[i] != SIZE_MAX)
+			w->msgs[i] = w->stripped + w->stripped_at[i];
+	}
+	sha256d_batch(w, total);
+
+	//Merkle levels: each block's txids plus a spare slot for duplicating an odd last entry
+	w->levels = grow(w->levels, &w->levels_cap, total + n, sizeof(*w->levels));
+	for (b = 0; b < n; b++) {
+		memcpy(w->levels[entries], w->digests[w->start[b]], 32 * w->count[b]);
+		w->start[b] = entries;
+		entries += w->count[b] + 1;
+	}
+	for (;;) {
+		pairs = 0;
+		for (b = 0; b < n; b++) {
+			unsigned char (*level)[32] = w->levels + w->start[b];
+			if (w->count[b] < 2)
+				continue;
+			if (w->count[b] & 1)
+				memcpy(level[w->count[b]], level[w->count[b] - 1], 32);
+			for (i = 0; i < w->count[b]; i += 2) {
+				w->msgs[pairs] = level[i];
+				w->lens[pairs++] = 64;
+			}
+		}
+		if (!pairs)
+			break;
+		sha256d_batch(w, pairs);
+		for (b = 0, k = 0; b < n; b++) {
+			if (w->count[b] < 2)
+				continue;
+			for (i = 0; i < (w->count[b] + 1) / 2; i++)
+				memcpy(w->levels[w->start[b] + i], w->digests[k++], 32);
+			w->count[b] = (w->count[b] + 1) / 2;
+		}
+	}
+
+	//Headers, with the Merkle check for every block that parsed
+	reserve_msgs(w, n);
+	for (b = 0; b < n; b++) {
+		w->msgs[b] = in->refs[first + b].data;
+		w->lens[b] = BLK_HEADER_SIZE;
+	}
+	sha256d_batch(w, n);
+	for (b = 0; b < n; b++) {
+		const unsigned char *header = in->refs[first + b].data;
+		memcpy(in->hashes[first + b], w->digests[b], 32);
+		w->stats.blocks++;
+		if (w->count[b] && memcmp(w->levels[w->start[b]], header + 36, 32) != 0) {
+			w->stats.bad_merkle++;
+			report(in, first + b, "Merkle root does not match the header");
+		}
+		//set_difficulty() only handles exponents that put the mantissa inside 32 bytes
+		exponent = header_nbits(header) >> 24;
+		if (exponent >= 3 && exponent <= 32)
+			set_difficulty(target, header_nbits(header));
+		if (exponent < 3 || exponent > 32 || !hash_meets_target(w->digests[b], target)) {
+			w->stats.bad_pow++;
+			report(in, first + b, "header hash is above its target");
+		}
+	}
+}
+
+static void *worker_main(void *arg)
+{
+	Worker *w = arg;
+	Ingest *in = w->in;
+	size_t first;
+
+	w->start = malloc(in->chunk * sizeof(*w->start));
+	w->count = malloc(in->chunk * sizeof(*w->count));
+	while ((first = atomic_fetch_add(&in->next, in->chunk)) < in->n)
+		verify_chunk(w, first, in->n - first < in->chunk ? in->n - first : in->chunk);
+
+	free(w->txs);
+	free(w->msgs);
+	free(w->lens);
+	free(w->stripped_at);
+	free(w->inner);
+	free(w->digests);
+	free(w->stripped);
+	free(w->levels);
+	free(w->start);
+	free(w->count);
+	return NULL;
+}
+
+static int compare_hash(const void *a, const void *b)
+{
+	return memcmp(a, b, 32);
+}
+
+//Blocks whose prevhash is neither null nor the hash of another block in the input
+static size_t unlinked_blocks(const Ingest *in)
+{
+	static const unsigned char null_hash[32];
+	unsigned char (*sorted)[32] = malloc(in->n * 32 + 1);
+	size_t b, unlinked = 0;
+
+	memcpy(sorted, in->hashes, in->n * 32);
+	qsort(sorted, in->n, 32, compare_hash);
+	for (b = 0; b < in->n; b++) {
+		const unsigned char *prev = in->refs[b].data + 4;
+		if (memcmp(prev, null_hash, 32) != 0 && !bsearch(prev, sorted, in->n, 32, compare_hash))
+			unlinked++;
+	}
+	free(sorted);
+	return unlinked;
+}
+
+static int generate(const char *path, int blocks, int max_tx, uint32_t nbits, unsigned int seed, uint32_t magic)
+{
+	uint64_t start = now_ns();
+	if (generate_block_file(path, magic, blocks, max_tx, nbits, seed) != 0)
+		return 1;
+	printf("Wrote %d blocks of up to %d transactions to %s in %.2f s\n", blocks, max_tx, path, (now_ns() - start) / 1e9);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	Ingest in = {0};
+	Ingest_stats total = {0};
+	Block_file *files;
+	Block_ref *refs = NULL;
+	Worker *workers;
+	const char *generate_path = NULL;
+	const char **paths;
+	size_t nrefs = 0, refs_cap = 0, unlinked;
+	uint32_t magic = BLK_MAGIC_REGTEST, nbits = 0x207fffff;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN), blocks = 200, max_tx = 2000, nfiles = 0, i, status = 0;
+	unsigned int seed = 1;
+	uint64_t start;
+	double secs;
+
+	in.chunk = 16;
+	paths = calloc(argc, sizeof(*paths));
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--chunk") && i + 1 < argc)
+			in.chunk = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "--magic") && i + 1 < argc)
+			magic = strtoul(argv[++i], NULL, 16);
+		else if (!strcmp(argv[i], "--generate") && i + 1 < argc)
+			generate_path = argv[++i];
+		else if (!strcmp(argv[i], "--blocks") && i + 1 < argc)
+			blocks = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--tx") && i + 1 < argc)
+			max_tx = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--nbits") && i + 1 < argc)
+			nbits = strtoul(argv[++i], NULL, 16);
+		else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+			seed = strtoul(argv[++i], NULL, 10);
+		else if (argv[i][0] != '-')
+			paths[nfiles++] = argv[i];
+		else {
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (threads < 1)
+		threads = 1;
+	if (in.chunk < 1)
+		in.chunk = 1;
+	if (max_tx < 1)
+		max_tx = 1;
+
+	if (generate_path)
+		return generate(generate_path, blocks, max_tx, nbits, seed, magic);
+	if (!nfiles) {
+		fprintf(stderr, "usage: %s [--threads N] [--chunk BLOCKS] [--magic HEX] FILE...\n"
+			"       %s --generate FILE [--blocks N] [--tx N] [--nbits HEX] [--seed S] [--magic HEX]\n", argv[0], argv[0]);
+		return 1;
+	}
+
+	start = now_ns();
+	files = calloc(nfiles, sizeof(*files));
+	for (i = 0; i < nfiles; i++) {
+		if (block_file_open(&files[i], paths[i]) != 0)
+			return 1;
+		if (!block_file_index(&files[i], i, magic, &refs, &nrefs, &refs_cap))
+			status = 1;
+	}
+
+	in.refs = refs;
+	in.n = nrefs;
+	in.paths = paths;
+	in.hashes = malloc(nrefs * 32 + 1);
+	workers = calloc(threads, sizeof(*workers));
+	for (i = 0; i < threads; i++) {
+		workers[i].in = &in;
+		pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total.blocks += workers[i].stats.blocks;
+		total.txs += workers[i].stats.txs;
+		total.segwit += workers[i].stats.segwit;
+		total.bytes += workers[i].stats.bytes;
+		total.malformed += workers[i].stats.malformed;
+		total.bad_merkle += workers[i].stats.bad_merkle;
+		total.bad_pow += workers[i].stats.bad_pow;
+	}
+	unlinked = unlinked_blocks(&in);
+	secs = (now_ns() - start) / 1e9;
+
+	printf("%llu blocks, %llu transactions (%llu segwit), %.1f MB from %d file%s with %d thread%s (%s)\n",
+		(unsigned long long)total.blocks, (unsigned long long)total.txs, (unsigned long long)total.segwit, total.bytes / 1e6,
+		nfiles, nfiles == 1 ? "" : "s", threads, threads == 1 ? "" : "s", libsha256_backend_name());
+	printf("%.3f s: %.0f blocks/s, %.0f tx/s, %.1f MB/s\n", secs, total.blocks / secs, total.txs / secs, total.bytes / 1e6 / secs);
+	printf("Merkle roots: %llu bad; proof of work: %llu bad; malformed: %llu; prevhash not found: %zu\n",
+		(unsigned long long)total.bad_merkle, (unsigned long long)total.bad_pow, (unsigned long long)total.malformed, unlinked);
+
+	//The first block of each chain links to something outside the input unless it is a genesis block
+	if (total.malformed || total.bad_merkle || total.bad_pow || unlinked > 1)
+		status = 1;
+
+	for (i = 0; i < nfiles; i++)
+		block_file_close(&files[i]);
+	free(files);
+	free(refs);
+	free(in.hashes);
+	free(workers);
+	free(paths);
+	return status;
+}
@@ -0,0 +1,241 @@
+/*
+	CPU miner driven by the job manager
+
+	Connects to a stratum-like pool (or starts the local stub in-process with --stub), feeds
+	mining.notify templates to the job manager and scans nonces on worker threads. Workers
+	poll the job generation between nonce batches, so a new template is picked up without
+	stopping them; the time from template arrival to each worker's first hash on it is the
+	time lost between jobs and is reported at exit.
+
+	Usage: cpu_miner [--stub | --serve] [--host H] [--port P] [--threads N] [--duration S]
+	                 [--interval MS] [--nbits HEX] [--tx N] [--nonce-bits B] [--depth D]
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "job_manager.h"
+#include "stratum_stub.h"
+#include "utils.h"
+
+#define NONCE_BATCH 256	//Nonces between generation checks
+
+typedef struct {
+	Job_manager *jm;
+	int fd;
+	int extranonce2_size;
+	int nonce_bits;
+	volatile bool stop;
+	pthread_mutex_t send_lock;
+	int next_id;
+} Miner;
+
+typedef struct {
+	Miner *miner;
+	pthread_t thread;
+	uint64_t hashes;
+	uint64_t shares;
+	uint64_t pickups;		//Job switches this worker followed
+	uint64_t lost_ns;		//Sum over switches of arrival -> first hash on the new job
+	uint64_t max_lost_ns;
+} Worker;
+
+static void *worker_main(void *arg)
+{
+	Worker *self = arg;
+	Miner *miner = self->miner;
+	Mining_work w;
+	uint64_t span = 1ULL << miner->nonce_bits;
+	uint64_t seen = 0;
+	BYTE hash[32];
+	char line[256];
+
+	job_manager_next_work(miner->jm, &w);
+	while (!miner->stop) {
+		uint64_t nonce;
+
+		if (w.generation != seen) {
+			uint64_t lost = now_ns() - job_manager_switch_time(miner->jm);
+			if (seen) {
+				self->pickups++;
+				self->lost_ns += lost;
+				if (lost > self->max_lost_ns)
+					self->max_lost_ns = lost;
+			}
+			seen = w.generation;
+		}
+
+		for (nonce = 0; nonce < span && !miner->stop; nonce += NONCE_BATCH) {
+			uint64_t end = nonce + NONCE_BATCH < span ? nonce + NONCE_BATCH : span;
+			uint64_t n;
+
+			for (n = nonce; n < end; n++) {
+				hash_work_nonce(&w, (uint32_t)n, hash);
+				if (hash_meets_target(hash, w.target)) {
+					pthread_mutex_lock(&miner->send_lock);
+					format_submit(line, sizeof(line), miner->next_id++, &w, miner->extranonce2_size, (uint32_t)n);
+					stratum_send(miner->fd, line);
+					pthread_mutex_unlock(&miner->send_lock);
+					self->shares++;
+				}
+			}
+			self->hashes += end - nonce;
+			if (job_manager_generation(miner->jm) != w.generation)
+				break;
+		}
+		//Nonce space exhausted or a new template arrived; both take the next ready unit
+		job_manager_next_work(miner->jm, &w);
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	Stub_config stub = {0};
+	pthread_t stub_thread;
+	bool run_stub = false, serve_only = false;
+	const char *host = "127.0.0.1";
+	int port = 3333, threads = sysconf(_SC_NPROCESSORS_ONLN), depth = 0;
+	double duration = 10;
+	Miner miner = {0};
+	char *line, *buf;
+	int buf_len = 0, i, accepted = 0, rejected = 0, templates = 0;
+
+	stub.interval_ms = 1000;
+	stub.num_tx = 2000;
+	stub.nbits = 0x1f00ffff;
+	stub.extranonce2_size = 4;
+	miner.nonce_bits = 32;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--stub"))
+			run_stub = true;
+		else if (!strcmp(argv[i], "--serve"))
+			serve_only = true;
+		else if (!strcmp(argv[i], "--host") && i + 1 < argc)
+			host = argv[++i];
+		else if (!strcmp(argv[i], "--port") && i + 1 < argc)
+			port = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--duration") && i + 1 < argc)
+			duration = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--interval") && i + 1 < argc)
+			stub.interval_ms = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--nbits") && i + 1 < argc)
+			stub.nbits = strtoul(argv[++i], NULL, 16);
+		else if (!strcmp(argv[i], "--tx") && i + 1 < argc)
+			stub.num_tx = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--nonce-bits") && i + 1 < argc)
+			miner.nonce_bits = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--depth") && i + 1 < argc)
+			depth = atoi(argv[++i]);
+		else {
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (threads < 1)
+		threads = 1;
+	if (miner.nonce_bits < 10 || miner.nonce_bits > 32)
+		miner.nonce_bits = 32;
+	stub.port = port;
+
+	if (serve_only) {
+		stub_serve(&stub);
+		printf("Templates pushed: %d\nShares accepted: %d, rejected: %d, stale: %d\n", stub.jobs_sent, stub.shares_accepted,
+			stub.shares_rejected, stub.shares_stale);
+		return 0;
+	}
+	if (run_stub)
+		pthread_create(&stub_thread, NULL, stub_serve, &stub);
+
+	miner.fd = stratum_connect(host, port);
+	if (miner.fd < 0) {
+		fprintf(stderr, "Could not connect to %s:%d\n", host, port);
+		return 1;
+	}
+	line = malloc(STRATUM_MAX_LINE);
+	buf = malloc(STRATUM_MAX_LINE);
+	pthread_mutex_init(&miner.send_lock, NULL);
+	miner.next_id = 2;
+
+	//Subscribe and wait for the extranonce assignment
+	unsigned char extranonce1[JM_MAX_EXTRANONCE];
+	size_t extranonce1_len;
+	stratum_send(miner.fd, "{\"id\":1,\"method\":\"mining.subscribe\",\"params\":[\"cpu_miner\"]}\n");
+	if (stratum_read_line(miner.fd, line, STRATUM_MAX_LINE, buf, &buf_len) < 0 ||
+		!parse_subscribe(line, extranonce1, &extranonce1_len, &miner.extranonce2_size)) {
+		fprintf(stderr, "Bad subscribe reply\n");
+		return 1;
+	}
+	miner.jm = job_manager_create(extranonce1, extranonce1_len, miner.extranonce2_size, depth ? depth : 2 * threads);
+
+	Worker *workers = calloc(threads, sizeof(Worker));
+	for (i = 0; i < threads; i++) {
+		workers[i].miner = &miner;
+		pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+	}
+
+	//The main thread is the stratum reader: templates go straight to the manager
+	uint64_t start = now_ns(), stop_at = start + (uint64_t)(duration * GIG);
+	Mining_template *tmpl = malloc(sizeof(Mining_template));
+	while (now_ns() < stop_at) {
+		struct timeval tv = {0, 100000};
+		setsockopt(miner.fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		if (stratum_read_line(miner.fd, line, STRATUM_MAX_LINE, buf, &buf_len) < 0) {
+			if (stub.max_jobs && stub.jobs_sent == stub.max_jobs)
+				break;
+			continue;
+		}
+		if (parse_notify(line, tmpl)) {
+			job_manager_set_template(miner.jm, tmpl);
+			templates++;
+		} else if (strstr(line, "\"result\":true")) {
+			accepted++;
+		} else if (strstr(line, "\"result\":false")) {
+			rejected++;
+		}
+	}
+	double elapsed = (now_ns() - start) / 1e9;
+
+	miner.stop = true;
+	stub.stop = true;
+	uint64_t hashes = 0, shares = 0, pickups = 0, lost_ns = 0, max_lost_ns = 0;
+	for (i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		hashes += workers[i].hashes;
+		shares += workers[i].shares;
+		pickups += workers[i].pickups;
+		lost_ns += workers[i].lost_ns;
+		if (workers[i].max_lost_ns > max_lost_ns)
+			max_lost_ns = workers[i].max_lost_ns;
+	}
+	close(miner.fd);
+	if (run_stub)
+		pthread_join(stub_thread, NULL);
+
+	Job_manager_stats st;
+	job_manager_stats(miner.jm, &st);
+	printf("Threads: %d, templates received: %d, job switches: %llu\n", threads, templates, (unsigned long long)st.switches);
+	printf("Tested %llu hashes in %.2f s\n", (unsigned long long)hashes, elapsed);
+	printf("Hashrate: %.2f H/s\n", hashes / elapsed);
+	printf("Work units rolled: %llu, %.2f us per roll, %.1f Merkle sha256d per roll\n", (unsigned long long)st.rolls,
+		st.rolls ? st.roll_ns / 1e3 / st.rolls : 0.0, st.rolls ? (double)st.merkle_hashes / st.rolls : 0.0);
+	printf("Time lost per job switch: avg %.2f us, max %.2f us over %llu worker pickups\n", pickups ? lost_ns / 1e3 / pickups : 0.0,
+		max_lost_ns / 1e3, (unsigned long long)pickups);
+	printf("Workers that found no ready unit: %llu\n", (unsigned long long)st.ring_waits);
+	printf("Shares found: %llu, accepted: %d, rejected: %d\n", (unsigned long long)shares, accepted, rejected);
+
+	job_manager_destroy(miner.jm);
+	free(workers);
+	free(tmpl);
+	free(line);
+	free(buf);
+	return rejected ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+/*
+	Distributed nonce search over TCP
+
+	Runs the coordinator or a worker from nonce_coordinator.h, or both on localhost with
+	--local N, which forks N worker processes. --chaos slows the first local worker down
+	after a second and kills the second one after two, to exercise rebalancing and
+	reassignment.
+
+	Usage: dist_miner --coordinator [--bind A] [--port P] [--workers N] [--rounds R] [--nbits HEX]
+	                  [--range-ms MS] [--dead-ms MS]
+	       dist_miner --worker [--host H] [--port P] [--threads T] [--slow-after S] [--slow-factor F]
+	                  [--die-after S]
+	       dist_miner --local N [--chaos] [coordinator options] [--threads T]
+*/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "nonce_coordinator.h"
+
+int main(int argc, char **argv)
+{
+	Coordinator_config cc = {"127.0.0.1", 3334, 1, 3, 0x1e03ffff, 1000, 2000, 2000};
+	Worker_config wc = {"127.0.0.1", 3334, 1, 0, 4, 0};
+	bool coordinator = false, worker = false, chaos = false;
+	int local = 0, i, status;
+	pid_t *pids;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--coordinator"))
+			coordinator = true;
+		else if (!strcmp(argv[i], "--worker"))
+			worker = true;
+		else if (!strcmp(argv[i], "--local") && i + 1 < argc)
+			local = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--chaos"))
+			chaos = true;
+		else if (!strcmp(argv[i], "--bind") && i + 1 < argc)
+			cc.bind_addr = argv[++i];
+		else if (!strcmp(argv[i], "--host") && i + 1 < argc)
+			wc.host = argv[++i];
+		else if (!strcmp(argv[i], "--port") && i + 1 < argc)
+			cc.port = wc.port = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--workers") && i + 1 < argc)
+			cc.workers = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--rounds") && i + 1 < argc)
+			cc.rounds = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--nbits") && i + 1 < argc)
+			cc.nbits = strtoul(argv[++i], NULL, 16);
+		else if (!strcmp(argv[i], "--range-ms") && i + 1 < argc)
+			cc.range_ms = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--dead-ms") && i + 1 < argc)
+			cc.dead_ms = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			wc.threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--slow-after") && i + 1 < argc)
+			wc.slow_after = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--slow-factor") && i + 1 < argc)
+			wc.slow_factor = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--die-after") && i + 1 < argc)
+			wc.die_after = atof(argv[++i]);
+		else {
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (wc.threads < 1)
+		wc.threads = 1;
+	if (wc.slow_factor < 2)
+		wc.slow_factor = 2;
+	if (cc.range_ms < 10)
+		cc.range_ms = 10;
+
+	if (worker)
+		return worker_run(&wc);
+	if (coordinator && !local)
+		return coordinator_run(&cc);
+	if (local < 1) {
+		fprintf(stderr, "Pick --coordinator, --worker or --local N\n");
+		return 1;
+	}
+
+	//Workers retry their connect for a while, so they can start before the coordinator listens
+	cc.workers = local;
+	pids = calloc(local, sizeof(pid_t));
+	for (i = 0; i < local; i++) {
+		pids[i] = fork();
+		if (pids[i] == 0) {
+			Worker_config mine = wc;
+			if (chaos && i == 0)
+				mine.slow_after = 1;
+			if (chaos && i == 1)
+				mine.die_after = 2;
+			_exit(worker_run(&mine));
+		}
+	}
+	status = coordinator_run(&cc);
+	for (i = 0; i < local; i++) {
+		kill(pids[i], SIGTERM);
+		waitpid(pids[i], NULL, 0);
+	}
+	free(pids);
+	return status;
+}
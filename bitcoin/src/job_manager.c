@@ -0,0 +1,398 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "job_manager.h"
+#include "utils.h"
+
+//Everything a roll reads, so the roller can work from its own copy without the lock
+typedef struct {
+	unsigned char extranonce1[JM_MAX_EXTRANONCE];
+	size_t extranonce1_len;
+	int extranonce2_size;
+
+	Mining_template tmpl;
+	uint64_t template_ns;		//When tmpl arrived, for ntime rolling
+	SHA256_CTX coinbase_mid;	//coinb1 || extranonce1 compressed up to the last full block
+	uint64_t generation;		//Of tmpl
+} Roll_source;
+
+struct Job_manager {
+	pthread_mutex_t lock;
+	pthread_cond_t ready;		//A unit was added to the ring
+	pthread_cond_t drained;		//A unit was taken from the ring or the template changed
+	pthread_t roller;
+	bool stop;
+
+	Roll_source src;
+	bool have_template;
+	uint64_t next_extranonce2;
+
+	Mining_work *ring;
+	int depth, head, count;
+
+	_Atomic uint64_t generation;
+	_Atomic uint64_t switch_ns;
+	Job_manager_stats stats;
+};
+
+uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * GIG + ts.tv_nsec;
+}
+
+void sha256d(const unsigned char *data, size_t len, unsigned char hash[32])
+{
+	SHA256_CTX ctx;
+	sha256_init(&ctx);
+	sha256_update(&ctx, data, len);
+	sha256_final(&ctx, hash);
+	sha256_init(&ctx);
+	sha256_update(&ctx, hash, 32);
+	sha256_final(&ctx, hash);
+}
+
+//Hashes a Merkle level in place; an odd last entry is paired with itself
+static size_t merkle_level(unsigned char (*level)[32], size_t n)
+{
+	size_t i;
+	unsigned char pair[64];
+
+	for (i = 0; i < n; i += 2) {
+		memcpy(pair, level[i], 32);
+		memcpy(pair + 32, level[i + 1 < n ? i + 1 : i], 32);
+		sha256d(pair, 64, level[i / 2]);
+	}
+	return (n + 1) / 2;
+}
+
+//Branch of txids[0] (the coinbase slot): the sibling on each level. txids is overwritten.
+void merkle_branch(unsigned char (*txids)[32], size_t n, unsigned char (*branch)[32], int *branch_len)
+{
+	*branch_len = 0;
+	while (n > 1 && *branch_len < JM_MAX_BRANCH) {
+		memcpy(branch[(*branch_len)++], txids[1], 32);
+		n = merkle_level(txids, n);
+	}
+}
+
+static void write_le32(unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static size_t write_extranonce2(unsigned char *p, uint64_t extranonce2, int size)
+{
+	int i;
+	for (i = 0; i < size; i++)
+		p[i] = i < 8 ? extranonce2 >> (8 * i) : 0;
+	return size;
+}
+
+static void merkle_root(const Mining_template *tmpl, const unsigned char coinbase_hash[32], unsigned char root[32])
+{
+	int i;
+	unsigned char pair[64];
+
+	memcpy(root, coinbase_hash, 32);
+	for (i = 0; i < tmpl->branch_len; i++) {
+		memcpy(pair, root, 32);
+		memcpy(pair + 32, tmpl->branch[i], 32);
+		sha256d(pair, 64, root);
+	}
+}
+
+static void assemble_header(const Mining_template *tmpl, const unsigned char root[32], uint32_t ntime, uint32_t nonce,
+	unsigned char header[80])
+{
+	write_le32(header, tmpl->version);
+	memcpy(header + 4, tmpl->prevhash, 32);
+	memcpy(header + 36, root, 32);
+	write_le32(header + 68, ntime);
+	write_le32(header + 72, tmpl->nbits);
+	write_le32(header + 76, nonce);
+}
+
+//Straightforward version of what the manager does incrementally; the stub uses it to check shares
+void build_header(const Mining_template *tmpl, const unsigned char *extranonce1, size_t extranonce1_len,
+	uint64_t extranonce2, int extranonce2_size, uint32_t ntime, uint32_t nonce, unsigned char header[80])
+{
+	unsigned char coinbase[2 * JM_MAX_COINBASE + 2 * JM_MAX_EXTRANONCE];
+	unsigned char hash[32], root[32];
+	size_t len = 0;
+
+	memcpy(coinbase, tmpl->coinb1, tmpl->coinb1_len);
+	len += tmpl->coinb1_len;
+	memcpy(coinbase + len, extranonce1, extranonce1_len);
+	len += extranonce1_len;
+	len += write_extranonce2(coinbase + len, extranonce2, extranonce2_size);
+	memcpy(coinbase + len, tmpl->coinb2, tmpl->coinb2_len);
+	len += tmpl->coinb2_len;
+
+	sha256d(coinbase, len, hash);
+	merkle_root(tmpl, hash, root);
+	assemble_header(tmpl, root, ntime, nonce, header);
+}
+
+//One work unit from the plain header, for callers that hand out extranonce2 values themselves
+void build_work(const Mining_template *tmpl, const unsigned char *extranonce1, size_t extranonce1_len,
+	uint64_t extranonce2, int extranonce2_size, Mining_work *w)
+{
+	SHA256_CTX ctx;
+	unsigned char header[80];
+
+	build_header(tmpl, extranonce1, extranonce1_len, extranonce2, extranonce2_size, tmpl->ntime, 0, header);
+	sha256_init(&ctx);
+	sha256_update(&ctx, header, 80);
+	memcpy(w->midstate, ctx.state, sizeof(w->midstate));
+	sha256_pad(&ctx);
+	memcpy(w->tail, ctx.data, 64);
+	set_difficulty(w->target, tmpl->nbits);
+
+	w->generation = 0;
+	memcpy(w->job_id, tmpl->job_id, JM_JOB_ID_LEN);
+	w->extranonce2 = extranonce2;
+	w->ntime = tmpl->ntime;
+}
+
+static void store_be32(BYTE *p, WORD v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+//sha256d of the header from the work's midstate with the given nonce
+void hash_work_nonce(const Mining_work *w, uint32_t nonce, BYTE hash[32])
+{
+	SHA256_CTX ctx;
+	BYTE block[64];
+	int i;
+
+	memcpy(ctx.state, w->midstate, sizeof(ctx.state));
+	memcpy(block, w->tail, 64);
+	block[12] = nonce;
+	block[13] = nonce >> 8;
+	block[14] = nonce >> 16;
+	block[15] = nonce >> 24;
+	sha256_transform(&ctx, block);
+
+	for (i = 0; i < 8; i++)
+		store_be32(block + 4 * i, ctx.state[i]);
+	memset(block + 32, 0, 32);
+	block[32] = 0x80;
+	block[62] = 0x01;	//256 bits
+	sha256_init(&ctx);
+	sha256_transform(&ctx, block);
+	for (i = 0; i < 8; i++)
+		store_be32(hash + 4 * i, ctx.state[i]);
+}
+
+//The digest is a little endian 256-bit number, the target is big endian
+bool hash_meets_target(const unsigned char hash[32], const unsigned char target[32])
+{
+	int i;
+	for (i = 0; i < 32; i++) {
+		if (hash[31 - i] != target[i])
+			return hash[31 - i] < target[i];
+	}
+	return true;
+}
+
+//Builds the unit for extranonce2 from src; returns the time it took
+static uint64_t roll_work(const Roll_source *src, uint64_t extranonce2, Mining_work *w)
+{
+	uint64_t start = now_ns();
+	SHA256_CTX ctx = src->coinbase_mid;
+	const Mining_template *tmpl = &src->tmpl;
+	size_t prefix_len = tmpl->coinb1_len + src->extranonce1_len;
+	size_t done = prefix_len & ~(size_t)63;
+	unsigned char en2[JM_MAX_EXTRANONCE];
+	unsigned char hash[32], root[32], header[80];
+	uint64_t space = src->extranonce2_size >= 8 ? 0 : 1ULL << (8 * src->extranonce2_size);
+	uint32_t ntime = tmpl->ntime + (uint32_t)((start - src->template_ns) / GIG);
+
+	//Extranonce2 wrapped: the ntime bump keeps the headers unique
+	if (space && extranonce2 >= space) {
+		ntime += extranonce2 / space;
+		extranonce2 %= space;
+	}
+
+	//Rest of coinb1 || extranonce1, then extranonce2 || coinb2
+	if (done < tmpl->coinb1_len)
+		sha256_update(&ctx, tmpl->coinb1 + done, tmpl->coinb1_len - done);
+	sha256_update(&ctx, src->extranonce1 + (done > tmpl->coinb1_len ? done - tmpl->coinb1_len : 0),
+		prefix_len - (done > tmpl->coinb1_len ? done : tmpl->coinb1_len));
+	sha256_update(&ctx, en2, write_extranonce2(en2, extranonce2, src->extranonce2_size));
+	sha256_update(&ctx, tmpl->coinb2, tmpl->coinb2_len);
+	sha256_final(&ctx, hash);
+	sha256_init(&ctx);
+	sha256_update(&ctx, hash, 32);
+	sha256_final(&ctx, hash);
+
+	merkle_root(tmpl, hash, root);
+	assemble_header(tmpl, root, ntime, 0, header);
+
+	//Same preprocessing as the GPU host code: midstate of the first block, padded second block
+	sha256_init(&ctx);
+	sha256_update(&ctx, header, 80);
+	memcpy(w->midstate, ctx.state, sizeof(w->midstate));
+	sha256_pad(&ctx);
+	memcpy(w->tail, ctx.data, 64);
+	set_difficulty(w->target, tmpl->nbits);
+
+	w->generation = src->generation;
+	memcpy(w->job_id, tmpl->job_id, JM_JOB_ID_LEN);
+	w->extranonce2 = extranonce2;
+	w->ntime = ntime;
+	return now_ns() - start;
+}
+
+//Caller holds jm->lock
+static void count_roll(Job_manager *jm, uint64_t ns)
+{
+	jm->stats.rolls++;
+	jm->stats.merkle_hashes += jm->src.tmpl.branch_len;
+	jm->stats.roll_ns += ns;
+}
+
+//Rolls with the lock dropped, so take() never waits behind a refill. The template is copied only when it changes;
+//a unit rolled from a template that was replaced meanwhile is dropped.
+static void *roller_main(void *arg)
+{
+	Job_manager *jm = arg;
+	Roll_source src;
+	Mining_work w;
+	uint64_t extranonce2, ns;
+
+	src.generation = 0;
+	pthread_mutex_lock(&jm->lock);
+	while (!jm->stop) {
+		if (!jm->have_template || jm->count == jm->depth) {
+			pthread_cond_wait(&jm->drained, &jm->lock);
+			continue;
+		}
+		if (src.generation != jm->src.generation)
+			src = jm->src;
+		extranonce2 = jm->next_extranonce2++;
+		pthread_mutex_unlock(&jm->lock);
+
+		ns = roll_work(&src, extranonce2, &w);
+
+		pthread_mutex_lock(&jm->lock);
+		if (w.generation != jm->src.generation || jm->count == jm->depth)
+			continue;
+		jm->ring[(jm->head + jm->count) % jm->depth] = w;
+		jm->count++;
+		count_roll(jm, ns);
+		pthread_cond_broadcast(&jm->ready);
+	}
+	pthread_mutex_unlock(&jm->lock);
+	return NULL;
+}
+
+Job_manager *job_manager_create(const unsigned char *extranonce1, size_t extranonce1_len, int extranonce2_size, int depth)
+{
+	Job_manager *jm = calloc(1, sizeof(Job_manager));
+
+	if (extranonce1_len > JM_MAX_EXTRANONCE)
+		extranonce1_len = JM_MAX_EXTRANONCE;
+	if (extranonce2_size > JM_MAX_EXTRANONCE)
+		extranonce2_size = JM_MAX_EXTRANONCE;
+	memcpy(jm->src.extranonce1, extranonce1, extranonce1_len);
+	jm->src.extranonce1_len = extranonce1_len;
+	jm->src.extranonce2_size = extranonce2_size;
+	jm->depth = depth > 0 ? depth : 1;
+	jm->ring = calloc(jm->depth, sizeof(Mining_work));
+
+	pthread_mutex_init(&jm->lock, NULL);
+	pthread_cond_init(&jm->ready, NULL);
+	pthread_cond_init(&jm->drained, NULL);
+	pthread_create(&jm->roller, NULL, roller_main, jm);
+	return jm;
+}
+
+void job_manager_destroy(Job_manager *jm)
+{
+	pthread_mutex_lock(&jm->lock);
+	jm->stop = true;
+	pthread_cond_broadcast(&jm->drained);
+	pthread_mutex_unlock(&jm->lock);
+	pthread_join(jm->roller, NULL);
+
+	pthread_cond_destroy(&jm->ready);
+	pthread_cond_destroy(&jm->drained);
+	pthread_mutex_destroy(&jm->lock);
+	free(jm->ring);
+	free(jm);
+}
+
+void job_manager_set_template(Job_manager *jm, const Mining_template *tmpl)
+{
+	size_t prefix_len = tmpl->coinb1_len + jm->src.extranonce1_len;
+	size_t done = prefix_len & ~(size_t)63;
+	uint64_t start = now_ns();
+
+	pthread_mutex_lock(&jm->lock);
+	jm->src.tmpl = *tmpl;
+	jm->have_template = true;
+	jm->src.template_ns = start;
+	jm->next_extranonce2 = 0;
+
+	//Compress the full blocks of coinb1 || extranonce1 once per template
+	sha256_init(&jm->src.coinbase_mid);
+	sha256_update(&jm->src.coinbase_mid, tmpl->coinb1, done < tmpl->coinb1_len ? done : tmpl->coinb1_len);
+	if (done > tmpl->coinb1_len)
+		sha256_update(&jm->src.coinbase_mid, jm->src.extranonce1, done - tmpl->coinb1_len);
+
+	//Build the first unit of the new generation before anyone can see it
+	jm->src.generation = atomic_fetch_add(&jm->generation, 1) + 1;
+	jm->head = 0;
+	jm->count = 0;
+	count_roll(jm, roll_work(&jm->src, jm->next_extranonce2++, &jm->ring[0]));
+	jm->count = 1;
+	jm->stats.switches++;
+	atomic_store(&jm->switch_ns, start);
+
+	pthread_cond_broadcast(&jm->ready);
+	pthread_cond_broadcast(&jm->drained);
+	pthread_mutex_unlock(&jm->lock);
+}
+
+void job_manager_next_work(Job_manager *jm, Mining_work *w)
+{
+	pthread_mutex_lock(&jm->lock);
+	if (jm->count == 0 && jm->have_template)
+		jm->stats.ring_waits++;
+	while (jm->count == 0)
+		pthread_cond_wait(&jm->ready, &jm->lock);
+	*w = jm->ring[jm->head];
+	jm->head = (jm->head + 1) % jm->depth;
+	jm->count--;
+	pthread_cond_signal(&jm->drained);
+	pthread_mutex_unlock(&jm->lock);
+}
+
+uint64_t job_manager_generation(Job_manager *jm)
+{
+	return atomic_load_explicit(&jm->generation, memory_order_acquire);
+}
+
+uint64_t job_manager_switch_time(Job_manager *jm)
+{
+	return atomic_load_explicit(&jm->switch_ns, memory_order_relaxed);
+}
+
+void job_manager_stats(Job_manager *jm, Job_manager_stats *stats)
+{
+	pthread_mutex_lock(&jm->lock);
+	*stats = jm->stats;
+	pthread_mutex_unlock(&jm->lock);
+}
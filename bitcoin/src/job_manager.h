@@ -0,0 +1,88 @@
+#ifndef JOB_MANAGER_H
+#define JOB_MANAGER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sha256.h"
+
+/*
+	CPU mining job manager
+
+	A template is what a pool pushes with mining.notify: the coinbase split around the
+	extranonce, the Merkle branch of the coinbase and the header fields. The manager turns it
+	into work units by rolling extranonce2 (and ntime), so the nonce space never runs dry.
+
+	Per roll only the coinbase tail after the last full 64-byte block of coinb1 || extranonce1
+	is compressed, followed by one sha256d per branch entry, i.e. log2(#tx) hashes. A roller
+	thread keeps a small ring of ready units so workers never wait on it, and a new template
+	bumps an atomic generation that workers poll between nonce batches.
+*/
+
+#define JM_MAX_BRANCH 32
+#define JM_MAX_COINBASE 1024
+#define JM_MAX_EXTRANONCE 16
+#define JM_JOB_ID_LEN 64
+
+typedef struct {
+	char job_id[JM_JOB_ID_LEN];
+	uint32_t version;
+	uint32_t nbits;
+	uint32_t ntime;
+	unsigned char prevhash[32];		//Header byte order
+	unsigned char coinb1[JM_MAX_COINBASE];
+	size_t coinb1_len;
+	unsigned char coinb2[JM_MAX_COINBASE];
+	size_t coinb2_len;
+	unsigned char branch[JM_MAX_BRANCH][32];
+	int branch_len;
+	bool clean;
+} Mining_template;
+
+typedef struct {
+	uint64_t generation;
+	char job_id[JM_JOB_ID_LEN];
+	uint64_t extranonce2;
+	uint32_t ntime;
+	WORD midstate[8];			//State after the first 64 header bytes
+	BYTE tail[64];				//Second header block, already padded; nonce at bytes 12..15
+	BYTE target[32];			//Big endian, from set_difficulty()
+} Mining_work;
+
+typedef struct {
+	uint64_t switches;
+	uint64_t rolls;
+	uint64_t roll_ns;			//Time spent building work units
+	uint64_t merkle_hashes;		//sha256d calls spent on Merkle roots
+	uint64_t ring_waits;		//Times a worker found no ready unit
+} Job_manager_stats;
+
+typedef struct Job_manager Job_manager;
+
+Job_manager *job_manager_create(const unsigned char *extranonce1, size_t extranonce1_len, int extranonce2_size, int depth);
+void job_manager_destroy(Job_manager *jm);
+
+//Switches every worker to tmpl; the first unit is ready before the generation changes
+void job_manager_set_template(Job_manager *jm, const Mining_template *tmpl);
+
+//Copies the next unit of the current generation into w, blocking only before the first template
+void job_manager_next_work(Job_manager *jm, Mining_work *w);
+
+uint64_t job_manager_generation(Job_manager *jm);
+uint64_t job_manager_switch_time(Job_manager *jm);
+void job_manager_stats(Job_manager *jm, Job_manager_stats *stats);
+
+//Helpers shared with the stub server, the CPU miner and the nonce coordinator
+void sha256d(const unsigned char *data, size_t len, unsigned char hash[32]);
+void merkle_branch(unsigned char (*txids)[32], size_t n, unsigned char (*branch)[32], int *branch_len);
+void build_header(const Mining_template *tmpl, const unsigned char *extranonce1, size_t extranonce1_len,
+	uint64_t extranonce2, int extranonce2_size, uint32_t ntime, uint32_t nonce, unsigned char header[80]);
+void build_work(const Mining_template *tmpl, const unsigned char *extranonce1, size_t extranonce1_len,
+	uint64_t extranonce2, int extranonce2_size, Mining_work *w);
+void hash_work_nonce(const Mining_work *w, uint32_t nonce, BYTE hash[32]);
+bool hash_meets_target(const unsigned char hash[32], const unsigned char target[32]);
+uint64_t now_ns();
+
+#endif
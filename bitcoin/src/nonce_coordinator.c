@@ -0,0 +1,444 @@
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "job_manager.h"
+#include "nonce_coordinator.h"
+#include "stratum_stub.h"
+#include "utils.h"
+
+#define MAX_PEERS 64
+#define EXTRANONCE2_SIZE 4
+
+typedef struct {
+	uint64_t start;
+	uint64_t end;
+} Range;
+
+typedef struct {
+	int fd;
+	char *buf;
+	int buf_len;
+	bool subscribed;
+
+	//Current range; pos is the last reported point below which everything is hashed
+	bool busy;
+	uint64_t seq, start, end, pos;
+	bool trimmed;
+
+	uint64_t last_report_ns;
+	uint64_t rate_ns;			//Time of the report the rate was last updated from
+	uint64_t hashes;			//Worker's running total, as last reported
+	double rate;				//Hashes per second, smoothed over progress reports
+	bool cancel_pending;
+} Peer;
+
+typedef struct {
+	const Coordinator_config *cfg;
+	int lfd;
+	Peer peers[MAX_PEERS];
+	int num_peers;
+
+	Range *pending;				//Returned by dead or trimmed workers, handed out first
+	int num_pending, cap_pending;
+	uint64_t next_index;
+	uint64_t next_seq;
+
+	Mining_template tmpl;
+	unsigned char extranonce1[4];
+	bool searching;
+	uint64_t found_ns;
+
+	//Totals over all rounds
+	uint64_t assigned, requeued, trims, lost_workers, rejected;
+	uint64_t cancel_acks, cancel_ns, max_cancel_ns;
+	uint64_t lost_hashes;		//Reported by workers that later disappeared
+} Coordinator;
+
+static void send_line(Peer *p, const char *line)
+{
+	if (p->fd >= 0 && stratum_send(p->fd, line) < 0) {
+		close(p->fd);
+		p->fd = -1;
+	}
+}
+
+static void requeue(Coordinator *c, uint64_t start, uint64_t end)
+{
+	if (start >= end)
+		return;
+	if (c->num_pending == c->cap_pending) {
+		c->cap_pending = c->cap_pending ? 2 * c->cap_pending : 16;
+		c->pending = realloc(c->pending, c->cap_pending * sizeof(Range));
+	}
+	c->pending[c->num_pending].start = start;
+	c->pending[c->num_pending].end = end;
+	c->num_pending++;
+	c->requeued++;
+}
+
+static void drop_peer(Coordinator *c, Peer *p, const char *why)
+{
+	if (p->busy)
+		requeue(c, p->pos, p->end);
+	if (p->subscribed) {
+		printf("  worker %d lost (%s), %llu hashes of range %llu returned\n", (int)(p - c->peers), why,
+			(unsigned long long)(p->busy ? p->end - p->pos : 0), (unsigned long long)p->seq);
+		c->lost_workers++;
+	}
+	c->lost_hashes += p->hashes;
+	p->hashes = 0;
+	if (p->fd >= 0)
+		close(p->fd);
+	p->fd = -1;
+	p->busy = false;
+	p->cancel_pending = false;
+	p->subscribed = false;
+}
+
+static void assign(Coordinator *c, Peer *p)
+{
+	uint64_t size = p->rate > 0 ? (uint64_t)(p->rate * c->cfg->range_ms / 1000) : PROBE_RANGE;
+	char line[160];
+
+	if (size < MIN_RANGE)
+		size = MIN_RANGE;
+	if (c->num_pending) {
+		//Oldest returned range first; a large one is split so it is not stuck on one worker
+		Range *r = &c->pending[0];
+		p->start = r->start;
+		p->end = r->end - r->start > size ? r->start + size : r->end;
+		r->start = p->end;
+		if (r->start == r->end) {
+			memmove(c->pending, c->pending + 1, (c->num_pending - 1) * sizeof(Range));
+			c->num_pending--;
+		}
+	} else {
+		p->start = c->next_index;
+		p->end = c->next_index + size;
+		c->next_index = p->end;
+	}
+	p->seq = ++c->next_seq;
+	p->pos = p->start;
+	p->busy = true;
+	p->trimmed = false;
+	p->last_report_ns = now_ns();
+	c->assigned++;
+	snprintf(line, sizeof(line), "{\"id\":null,\"method\":\"range.assign\",\"params\":[%llu,\"%016llx\",\"%016llx\"]}\n",
+		(unsigned long long)p->seq, (unsigned long long)p->start, (unsigned long long)p->end);
+	send_line(p, line);
+}
+
+static bool token_u64(Json_token t, uint64_t *v)
+{
+	char tmp[24];
+	char *end;
+	if (t.len <= 0 || t.len >= (int)sizeof(tmp))
+		return false;
+	memcpy(tmp, t.s, t.len);
+	tmp[t.len] = '\0';
+	*v = strtoull(tmp, &end, 16);
+	return *end == '\0';
+}
+
+static uint64_t token_dec(Json_token t)
+{
+	return strtoull(t.s, NULL, 10);
+}
+
+//Rate from the change in the worker's hash total, then trim the range if it fell far behind
+static void on_progress(Coordinator *c, Peer *p, Json_token *t)
+{
+	uint64_t now = now_ns(), seq = token_dec(t[0]), pos, hashes = token_dec(t[2]);
+	double dt = (now - p->rate_ns) / 1e9;
+	char line[128];
+
+	if (!token_u64(t[1], &pos))
+		return;
+	if (dt > 0 && hashes >= p->hashes) {
+		double inst = (hashes - p->hashes) / dt;
+		p->rate = p->rate > 0 ? 0.5 * p->rate + 0.5 * inst : inst;
+	}
+	p->hashes = hashes;
+	p->rate_ns = now;
+	p->last_report_ns = now;
+	if (!p->busy || seq != p->seq)
+		return;
+	if (pos > p->pos)
+		p->pos = pos;
+
+	if (!p->trimmed && p->rate > 0 && (p->end - p->pos) / p->rate > 3.0 * c->cfg->range_ms / 1000) {
+		uint64_t keep = (uint64_t)(p->rate * c->cfg->range_ms / 1000);
+		uint64_t new_end = p->pos + (keep > MIN_RANGE ? keep : MIN_RANGE);
+		if (new_end < p->end) {
+			//The rest comes back with range.done, from wherever the worker actually stopped
+			snprintf(line, sizeof(line), "{\"id\":null,\"method\":\"range.trim\",\"params\":[%llu,\"%016llx\"]}\n",
+				(unsigned long long)p->seq, (unsigned long long)new_end);
+			send_line(p, line);
+			p->trimmed = true;
+			c->trims++;
+		}
+	}
+}
+
+static void on_done(Coordinator *c, Peer *p, Json_token *t)
+{
+	uint64_t end;
+	if (!p->busy || token_dec(t[0]) != p->seq || !token_u64(t[1], &end))
+		return;
+	if (end < p->end)
+		requeue(c, end > p->start ? end : p->start, p->end);
+	p->busy = false;
+}
+
+static void on_found(Coordinator *c, Peer *p, Json_token *t)
+{
+	unsigned char en2[EXTRANONCE2_SIZE], header[80], hash[32], target[32];
+	uint64_t extranonce2 = 0, now = now_ns();
+	uint32_t ntime, nonce;
+	char line[128];
+	int i;
+
+	if (!c->searching || !token_is(t[1], c->tmpl.job_id))
+		return;
+	if (hex_decode(t[2].s, t[2].len, en2, EXTRANONCE2_SIZE) != EXTRANONCE2_SIZE || !hex_u32(t[3], &ntime) ||
+		!hex_u32(t[4], &nonce)) {
+		c->rejected++;
+		return;
+	}
+	for (i = 0; i < EXTRANONCE2_SIZE; i++)
+		extranonce2 |= (uint64_t)en2[i] << (8 * i);
+	build_header(&c->tmpl, c->extranonce1, sizeof(c->extranonce1), extranonce2, EXTRANONCE2_SIZE, ntime, nonce, header);
+	sha256d(header, 80, hash);
+	set_difficulty(target, c->tmpl.nbits);
+	if (!hash_meets_target(hash, target)) {
+		c->rejected++;
+		return;
+	}
+
+	c->searching = false;
+	c->found_ns = now;
+	printf("  winner from worker %d: extranonce2 %llx nonce %08x, hash ", (int)(p - c->peers), (unsigned long long)extranonce2, nonce);
+	for (i = 31; i >= 0; i--)
+		printf("%02x", hash[i]);
+	printf("\n");
+
+	snprintf(line, sizeof(line), "{\"id\":null,\"method\":\"range.cancel\",\"params\":[\"%s\"]}\n", c->tmpl.job_id);
+	for (i = 0; i < c->num_peers; i++) {
+		Peer *q = &c->peers[i];
+		if (q->fd < 0 || !q->subscribed)
+			continue;
+		q->busy = false;
+		q->cancel_pending = true;
+		send_line(q, line);
+	}
+}
+
+static void on_cancelled(Coordinator *c, Peer *p, Json_token *t)
+{
+	uint64_t lat = now_ns() - c->found_ns;
+	if (!p->cancel_pending)
+		return;
+	p->cancel_pending = false;
+	p->hashes = token_dec(t[1]);
+	c->cancel_acks++;
+	c->cancel_ns += lat;
+	if (lat > c->max_cancel_ns)
+		c->max_cancel_ns = lat;
+}
+
+static void on_line(Coordinator *c, Peer *p, const char *line)
+{
+	const char *method = json_find(line, "method");
+	Json_token t[5];
+	int n = json_split(json_find(line, "params"), t, 5);
+	char reply[128], en1_hex[9];
+
+	if (!method)
+		return;
+	if (!strncmp(method, "\"mining.subscribe\"", 18)) {
+		hex_encode(c->extranonce1, sizeof(c->extranonce1), en1_hex);
+		snprintf(reply, sizeof(reply), "{\"id\":1,\"result\":[[],\"%s\",%d],\"error\":null}\n", en1_hex, EXTRANONCE2_SIZE);
+		send_line(p, reply);
+		p->subscribed = true;
+		p->last_report_ns = p->rate_ns = now_ns();
+		if (c->searching && p->fd >= 0)
+			send_notify(p->fd, &c->tmpl);
+	} else if (!strncmp(method, "\"range.progress\"", 16) && n == 3) {
+		on_progress(c, p, t);
+	} else if (!strncmp(method, "\"range.done\"", 12) && n == 2) {
+		on_done(c, p, t);
+	} else if (!strncmp(method, "\"range.found\"", 13) && n == 5) {
+		on_found(c, p, t);
+	} else if (!strncmp(method, "\"range.cancelled\"", 17) && n == 2) {
+		on_cancelled(c, p, t);
+	}
+}
+
+static void accept_peer(Coordinator *c)
+{
+	int fd = accept(c->lfd, NULL, NULL), i;
+	if (fd < 0)
+		return;
+	for (i = 0; i < c->num_peers && c->peers[i].fd >= 0; i++)
+		;
+	if (i == MAX_PEERS) {
+		close(fd);
+		return;
+	}
+	if (i == c->num_peers)
+		c->num_peers++;
+	Peer *p = &c->peers[i];
+	char *buf = p->buf ? p->buf : malloc(STRATUM_MAX_LINE);
+	memset(p, 0, sizeof(*p));
+	p->fd = fd;
+	p->buf = buf;
+}
+
+static int subscribed_peers(Coordinator *c)
+{
+	int i, n = 0;
+	for (i = 0; i < c->num_peers; i++)
+		n += c->peers[i].fd >= 0 && c->peers[i].subscribed;
+	return n;
+}
+
+static bool cancel_outstanding(Coordinator *c)
+{
+	int i;
+	for (i = 0; i < c->num_peers; i++) {
+		if (c->peers[i].fd >= 0 && c->peers[i].cancel_pending)
+			return true;
+	}
+	return false;
+}
+
+//One pass of the event loop: accept, read every ready line, drop silent workers
+static void service(Coordinator *c, int timeout_ms)
+{
+	struct pollfd pfd[MAX_PEERS + 1];
+	char *line = malloc(STRATUM_MAX_LINE);
+	uint64_t now;
+	int i;
+
+	pfd[0].fd = c->lfd;
+	pfd[0].events = POLLIN;
+	for (i = 0; i < c->num_peers; i++) {
+		pfd[i + 1].fd = c->peers[i].fd;
+		pfd[i + 1].events = POLLIN;
+		if (c->peers[i].fd >= 0 && memchr(c->peers[i].buf, '\n', c->peers[i].buf_len))
+			timeout_ms = 0;
+	}
+	poll(pfd, c->num_peers + 1, timeout_ms);
+	if (pfd[0].revents & POLLIN)
+		accept_peer(c);
+
+	for (i = 0; i < c->num_peers; i++) {
+		Peer *p = &c->peers[i];
+		if (p->fd < 0 || !((pfd[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) || memchr(p->buf, '\n', p->buf_len)))
+			continue;
+		//Whatever is buffered, then one more read if the socket was ready
+		do {
+			if (stratum_read_line(p->fd, line, STRATUM_MAX_LINE, p->buf, &p->buf_len) < 0) {
+				drop_peer(c, p, "disconnected");
+				break;
+			}
+			on_line(c, p, line);
+		} while (p->fd >= 0 && memchr(p->buf, '\n', p->buf_len));
+		if (p->fd < 0 && (p->busy || p->subscribed))
+			drop_peer(c, p, "send failed");
+	}
+
+	now = now_ns();
+	for (i = 0; i < c->num_peers; i++) {
+		Peer *p = &c->peers[i];
+		if (p->fd >= 0 && (p->busy || p->cancel_pending) && now - p->last_report_ns > (uint64_t)c->cfg->dead_ms * 1000000)
+			drop_peer(c, p, "silent");
+	}
+	free(line);
+}
+
+int coordinator_run(const Coordinator_config *cfg)
+{
+	Coordinator c;
+	Stub_config stub = {0};
+	uint64_t total_hashes = 0, search_ns = 0;
+	int round, i;
+
+	memset(&c, 0, sizeof(c));
+	c.cfg = cfg;
+	c.lfd = stratum_listen(cfg->bind_addr, cfg->port);
+	if (c.lfd < 0) {
+		perror("coordinator: listen");
+		return 1;
+	}
+	uint64_t seed = now_ns();
+	memcpy(c.extranonce1, &seed, sizeof(c.extranonce1));
+	stub.nbits = cfg->nbits;
+	stub.num_tx = cfg->num_tx;
+
+	printf("Coordinator on %s:%d, waiting for %d workers\n", cfg->bind_addr, cfg->port, cfg->workers);
+	while (subscribed_peers(&c) < cfg->workers)
+		service(&c, 100);
+
+	for (round = 0; round < cfg->rounds; round++) {
+		uint64_t base = 0, start, hashes = 0;
+
+		make_template(&stub, round, &c.tmpl);
+		c.next_index = 0;
+		c.num_pending = 0;
+		c.searching = true;
+		for (i = 0; i < c.num_peers; i++) {
+			Peer *p = &c.peers[i];
+			base += p->hashes;
+			if (p->fd >= 0 && p->subscribed)
+				send_notify(p->fd, &c.tmpl);
+		}
+		base += c.lost_hashes;
+		start = now_ns();
+		printf("Round %d: job %s, %d workers\n", round, c.tmpl.job_id, subscribed_peers(&c));
+
+		while (c.searching || cancel_outstanding(&c)) {
+			for (i = 0; c.searching && i < c.num_peers; i++) {
+				Peer *p = &c.peers[i];
+				if (p->fd >= 0 && p->subscribed && !p->busy)
+					assign(&c, p);
+			}
+			service(&c, 10);
+			if (c.searching && !subscribed_peers(&c)) {
+				printf("  no workers left\n");
+				goto done;
+			}
+		}
+
+		for (i = 0; i < c.num_peers; i++)
+			hashes += c.peers[i].hashes;
+		hashes += c.lost_hashes;
+		hashes -= base;
+		total_hashes += hashes;
+		search_ns += c.found_ns - start;
+		printf("  found after %.2f s, %llu hashes, %.2f MH/s aggregate, space searched up to %llu\n", (c.found_ns - start) / 1e9,
+			(unsigned long long)hashes, hashes / ((now_ns() - start) / 1e3), (unsigned long long)c.next_index);
+	}
+
+done:
+	printf("Rounds: %d, hashes: %llu, aggregate hash rate %.2f MH/s\n", round, (unsigned long long)total_hashes,
+		search_ns ? total_hashes / (search_ns / 1e3) : 0.0);
+	printf("Ranges assigned: %llu, returned to the queue: %llu, trimmed: %llu, workers lost: %llu, bad winners: %llu\n",
+		(unsigned long long)c.assigned, (unsigned long long)c.requeued, (unsigned long long)c.trims,
+		(unsigned long long)c.lost_workers, (unsigned long long)c.rejected);
+	printf("Cancellation: avg %.2f ms, max %.2f ms over %llu acknowledgements\n",
+		c.cancel_acks ? c.cancel_ns / 1e6 / c.cancel_acks : 0.0, c.max_cancel_ns / 1e6, (unsigned long long)c.cancel_acks);
+
+	for (i = 0; i < c.num_peers; i++) {
+		if (c.peers[i].fd >= 0)
+			close(c.peers[i].fd);
+		free(c.peers[i].buf);
+	}
+	close(c.lfd);
+	free(c.pending);
+	return round == cfg->rounds ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+#ifndef NONCE_COORDINATOR_H
+#define NONCE_COORDINATOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+	Distributed nonce-range search
+
+	One coordinator owns a template and the search space of (extranonce2, nonce) pairs,
+	numbered as index = extranonce2 << 32 | nonce. Workers on any host connect over TCP, get
+	the template as a mining.notify line and then ranges [start, end) of that index space.
+
+	A range is sized so it takes about range_ms at the worker's measured hash rate; the
+	first one is a fixed probe. Workers report progress every PROGRESS_MS. A worker that goes
+	silent for dead_ms or closes its socket loses its range, and the part it had not reached
+	goes back to a queue that is handed out before fresh space. A worker whose rate drops so
+	far that its range would take more than three times range_ms is trimmed: it keeps what
+	it can do in range_ms and the rest is requeued. When a worker reports a winner, the
+	coordinator checks it and broadcasts range.cancel; cancellation time is measured from the
+	winning report to each worker's acknowledgement.
+
+	Lines, all JSON like stratum (W = worker, C = coordinator, positions as 16 hex digits):
+		W->C mining.subscribe                C->W result [[], extranonce1, extranonce2_size]
+		C->W mining.notify (as a pool sends it)
+		C->W range.assign [seq, start, end]  C->W range.trim [seq, end]
+		C->W range.cancel [job_id]
+		W->C range.progress [seq, position, total_hashes]
+		W->C range.done [seq, end]           //Everything below end was hashed
+		W->C range.found [seq, job_id, extranonce2, ntime, nonce]
+		W->C range.cancelled [job_id, total_hashes]
+*/
+
+#define PROGRESS_MS 100
+#define PROBE_RANGE (1ULL << 18)
+#define MIN_RANGE (1ULL << 14)
+
+typedef struct {
+	const char *bind_addr;
+	int port;
+	int workers;			//Connections to wait for before the first round
+	int rounds;				//Templates to search, one winner each
+	uint32_t nbits;
+	int range_ms;
+	int dead_ms;
+	int num_tx;
+} Coordinator_config;
+
+typedef struct {
+	const char *host;
+	int port;
+	int threads;
+	//Fault injection for localhost runs
+	double slow_after;		//Seconds before hashing slows down by slow_factor, 0 = never
+	int slow_factor;
+	double die_after;		//Seconds before the process exits without a word, 0 = never
+} Worker_config;
+
+int coordinator_run(const Coordinator_config *cfg);
+int worker_run(const Worker_config *cfg);
+
+#endif
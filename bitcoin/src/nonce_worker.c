@@ -0,0 +1,290 @@
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "job_manager.h"
+#include "nonce_coordinator.h"
+#include "stratum_stub.h"
+#include "utils.h"
+
+#define SCAN_BATCH 4096		//Indices claimed at a time by a scan thread
+#define IDLE (~0ULL)
+
+/*
+	Range worker
+
+	Scan threads claim SCAN_BATCH indices at a time from the current range under a mutex,
+	so trimming or cancelling a range only has to move its end. The main thread owns the
+	socket: it applies assign/trim/cancel, reports progress and notices when every claimed
+	batch of a range has finished.
+*/
+
+typedef struct {
+	const Worker_config *cfg;
+	int fd;
+	pthread_mutex_t send_lock;
+
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	bool stop;
+	Mining_template tmpl;
+	uint64_t tmpl_gen;
+	unsigned char extranonce1[JM_MAX_EXTRANONCE];
+	size_t extranonce1_len;
+	int extranonce2_size;
+
+	//Current range, all under lock except the cancelled flag scan threads poll mid-batch
+	volatile bool cancelled;
+	bool active;
+	uint64_t seq, cursor, end;
+	int in_flight;
+	uint64_t *current;			//Start of the batch each scan thread is hashing, IDLE if none
+	uint64_t hashes;
+	uint64_t start_ns;
+} Worker_state;
+
+typedef struct {
+	Worker_state *ws;
+	int index;
+	pthread_t thread;
+} Scan_thread;
+
+static void send_found(Worker_state *ws, uint64_t seq, const Mining_work *w, uint32_t nonce)
+{
+	unsigned char en2[JM_MAX_EXTRANONCE];
+	char en2_hex[2 * JM_MAX_EXTRANONCE + 1], line[256];
+	int i;
+
+	for (i = 0; i < ws->extranonce2_size; i++)
+		en2[i] = i < 8 ? w->extranonce2 >> (8 * i) : 0;
+	hex_encode(en2, ws->extranonce2_size, en2_hex);
+	snprintf(line, sizeof(line), "{\"id\":null,\"method\":\"range.found\",\"params\":[%llu,\"%s\",\"%s\",\"%08x\",\"%08x\"]}\n",
+		(unsigned long long)seq, w->job_id, en2_hex, w->ntime, nonce);
+	pthread_mutex_lock(&ws->send_lock);
+	stratum_send(ws->fd, line);
+	pthread_mutex_unlock(&ws->send_lock);
+}
+
+static void *scan_main(void *arg)
+{
+	Scan_thread *self = arg;
+	Worker_state *ws = self->ws;
+	Mining_template tmpl;
+	Mining_work w;
+	uint64_t gen = 0, en2 = IDLE;
+	BYTE hash[32];
+
+	pthread_mutex_lock(&ws->lock);
+	for (;;) {
+		uint64_t seq, lo, hi, i, t0;
+
+		while (!ws->stop && !(ws->active && ws->cursor < ws->end))
+			pthread_cond_wait(&ws->wake, &ws->lock);
+		if (ws->stop)
+			break;
+		if (gen != ws->tmpl_gen) {
+			tmpl = ws->tmpl;
+			gen = ws->tmpl_gen;
+			en2 = IDLE;
+		}
+		seq = ws->seq;
+		lo = ws->cursor;
+		hi = lo + SCAN_BATCH < ws->end ? lo + SCAN_BATCH : ws->end;
+		ws->cursor = hi;
+		ws->current[self->index] = lo;
+		ws->in_flight++;
+		pthread_mutex_unlock(&ws->lock);
+
+		t0 = now_ns();
+		for (i = lo; i < hi; i++) {
+			if ((i & 255) == 0 && ws->cancelled)
+				break;
+			if (i >> 32 != en2) {
+				en2 = i >> 32;
+				build_work(&tmpl, ws->extranonce1, ws->extranonce1_len, en2, ws->extranonce2_size, &w);
+			}
+			hash_work_nonce(&w, (uint32_t)i, hash);
+			if (hash_meets_target(hash, w.target))
+				send_found(ws, seq, &w, (uint32_t)i);
+		}
+		if (ws->cfg->slow_after > 0 && now_ns() - ws->start_ns > ws->cfg->slow_after * GIG) {
+			uint64_t pause = (now_ns() - t0) * (ws->cfg->slow_factor - 1);
+			struct timespec ts = {pause / GIG, pause % GIG};
+			nanosleep(&ts, NULL);
+		}
+
+		pthread_mutex_lock(&ws->lock);
+		ws->hashes += i - lo;
+		ws->current[self->index] = IDLE;
+		ws->in_flight--;
+		pthread_cond_broadcast(&ws->wake);
+	}
+	pthread_mutex_unlock(&ws->lock);
+	return NULL;
+}
+
+static void send_line(Worker_state *ws, const char *line)
+{
+	pthread_mutex_lock(&ws->send_lock);
+	stratum_send(ws->fd, line);
+	pthread_mutex_unlock(&ws->send_lock);
+}
+
+static bool token_u64(Json_token t, uint64_t *v)
+{
+	char tmp[24];
+	char *end;
+	if (t.len <= 0 || t.len >= (int)sizeof(tmp))
+		return false;
+	memcpy(tmp, t.s, t.len);
+	tmp[t.len] = '\0';
+	*v = strtoull(tmp, &end, 16);
+	return *end == '\0';
+}
+
+//Caller holds ws->lock. Everything below the returned index has been hashed.
+static uint64_t hashed_below(Worker_state *ws)
+{
+	uint64_t pos = ws->cursor;
+	int i;
+	for (i = 0; i < ws->cfg->threads; i++) {
+		if (ws->current[i] < pos)
+			pos = ws->current[i];
+	}
+	return pos;
+}
+
+static void on_line(Worker_state *ws, const char *line)
+{
+	const char *method = json_find(line, "method");
+	Json_token t[3];
+	int n = json_split(json_find(line, "params"), t, 3);
+	uint64_t start, end;
+	char reply[128];
+
+	if (!method)
+		return;
+	if (!strncmp(method, "\"mining.notify\"", 15)) {
+		Mining_template *tmpl = malloc(sizeof(Mining_template));
+		if (parse_notify(line, tmpl)) {
+			pthread_mutex_lock(&ws->lock);
+			ws->tmpl = *tmpl;
+			ws->tmpl_gen++;
+			pthread_mutex_unlock(&ws->lock);
+		}
+		free(tmpl);
+	} else if (!strncmp(method, "\"range.assign\"", 14) && n == 3 && token_u64(t[1], &start) && token_u64(t[2], &end)) {
+		pthread_mutex_lock(&ws->lock);
+		ws->seq = strtoull(t[0].s, NULL, 10);
+		ws->cursor = start;
+		ws->end = end;
+		ws->active = true;
+		ws->cancelled = false;
+		pthread_cond_broadcast(&ws->wake);
+		pthread_mutex_unlock(&ws->lock);
+	} else if (!strncmp(method, "\"range.trim\"", 12) && n == 2 && token_u64(t[1], &end)) {
+		pthread_mutex_lock(&ws->lock);
+		//Batches already claimed past the new end are finished; range.done reports the real end
+		if (ws->active && strtoull(t[0].s, NULL, 10) == ws->seq && end < ws->end)
+			ws->end = end > ws->cursor ? end : ws->cursor;
+		pthread_mutex_unlock(&ws->lock);
+	} else if (!strncmp(method, "\"range.cancel\"", 14)) {
+		uint64_t hashes;
+		pthread_mutex_lock(&ws->lock);
+		ws->active = false;
+		ws->cancelled = true;
+		while (ws->in_flight)
+			pthread_cond_wait(&ws->wake, &ws->lock);
+		hashes = ws->hashes;
+		pthread_mutex_unlock(&ws->lock);
+		snprintf(reply, sizeof(reply), "{\"id\":null,\"method\":\"range.cancelled\",\"params\":[\"%.*s\",%llu]}\n", n > 0 ? t[0].len : 0,
+			n > 0 ? t[0].s : "", (unsigned long long)hashes);
+		send_line(ws, reply);
+	}
+}
+
+int worker_run(const Worker_config *cfg)
+{
+	Worker_state ws;
+	Scan_thread *threads;
+	char *line = malloc(STRATUM_MAX_LINE), *buf = malloc(STRATUM_MAX_LINE);
+	char msg[160];
+	int buf_len = 0, i;
+	uint64_t next_report;
+
+	memset(&ws, 0, sizeof(ws));
+	ws.cfg = cfg;
+	ws.start_ns = now_ns();
+	ws.fd = stratum_connect(cfg->host, cfg->port);
+	if (ws.fd < 0) {
+		fprintf(stderr, "worker: could not connect to %s:%d\n", cfg->host, cfg->port);
+		return 1;
+	}
+	stratum_send(ws.fd, "{\"id\":1,\"method\":\"mining.subscribe\",\"params\":[\"nonce_worker\"]}\n");
+	if (stratum_read_line(ws.fd, line, STRATUM_MAX_LINE, buf, &buf_len) < 0 ||
+		!parse_subscribe(line, ws.extranonce1, &ws.extranonce1_len, &ws.extranonce2_size)) {
+		fprintf(stderr, "worker: bad subscribe reply\n");
+		return 1;
+	}
+
+	pthread_mutex_init(&ws.send_lock, NULL);
+	pthread_mutex_init(&ws.lock, NULL);
+	pthread_cond_init(&ws.wake, NULL);
+	ws.current = malloc(cfg->threads * sizeof(uint64_t));
+	threads = calloc(cfg->threads, sizeof(Scan_thread));
+	for (i = 0; i < cfg->threads; i++) {
+		ws.current[i] = IDLE;
+		threads[i].ws = &ws;
+		threads[i].index = i;
+		pthread_create(&threads[i].thread, NULL, scan_main, &threads[i]);
+	}
+
+	next_report = now_ns() + PROGRESS_MS * 1000000ULL;
+	for (;;) {
+		struct pollfd pfd = {ws.fd, POLLIN, 0};
+		uint64_t now;
+
+		if (memchr(buf, '\n', buf_len) || poll(&pfd, 1, 5) > 0) {
+			if (stratum_read_line(ws.fd, line, STRATUM_MAX_LINE, buf, &buf_len) < 0)
+				break;
+			on_line(&ws, line);
+		}
+		now = now_ns();
+		if (cfg->die_after > 0 && now - ws.start_ns > cfg->die_after * GIG)
+			_exit(0);
+
+		pthread_mutex_lock(&ws.lock);
+		if (ws.active && ws.cursor >= ws.end && !ws.in_flight) {
+			ws.active = false;
+			snprintf(msg, sizeof(msg), "{\"id\":null,\"method\":\"range.done\",\"params\":[%llu,\"%016llx\"]}\n",
+				(unsigned long long)ws.seq, (unsigned long long)ws.end);
+			pthread_mutex_unlock(&ws.lock);
+			send_line(&ws, msg);
+		} else if (ws.active && now >= next_report) {
+			snprintf(msg, sizeof(msg), "{\"id\":null,\"method\":\"range.progress\",\"params\":[%llu,\"%016llx\",%llu]}\n",
+				(unsigned long long)ws.seq, (unsigned long long)hashed_below(&ws), (unsigned long long)ws.hashes);
+			pthread_mutex_unlock(&ws.lock);
+			send_line(&ws, msg);
+			next_report = now + PROGRESS_MS * 1000000ULL;
+		} else {
+			pthread_mutex_unlock(&ws.lock);
+		}
+	}
+
+	pthread_mutex_lock(&ws.lock);
+	ws.stop = true;
+	pthread_cond_broadcast(&ws.wake);
+	pthread_mutex_unlock(&ws.lock);
+	for (i = 0; i < cfg->threads; i++)
+		pthread_join(threads[i].thread, NULL);
+	close(ws.fd);
+	free(threads);
+	free(ws.current);
+	free(line);
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,439 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stratum_stub.h"
+#include "utils.h"
+
+#define STUB_HISTORY 16		//Templates kept for checking late shares
+
+/************************* JSON AND HEX HELPERS *************************/
+
+void hex_encode(const unsigned char *data, size_t len, char *out)
+{
+	static const char digits[] = "0123456789abcdef";
+	size_t i;
+	for (i = 0; i < len; i++) {
+		out[2 * i] = digits[data[i] >> 4];
+		out[2 * i + 1] = digits[data[i] & 15];
+	}
+	out[2 * len] = '\0';
+}
+
+static int hex_nibble(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+//Returns the number of bytes decoded or -1 on bad input
+int hex_decode(const char *s, int len, unsigned char *out, int cap)
+{
+	int i;
+	if (len % 2 || len / 2 > cap)
+		return -1;
+	for (i = 0; i < len / 2; i++) {
+		int hi = hex_nibble(s[2 * i]), lo = hex_nibble(s[2 * i + 1]);
+		if (hi < 0 || lo < 0)
+			return -1;
+		out[i] = (hi << 4) | lo;
+	}
+	return len / 2;
+}
+
+bool hex_u32(Json_token t, uint32_t *v)
+{
+	unsigned char b[4];
+	if (hex_decode(t.s, t.len, b, 4) != 4)
+		return false;
+	*v = ((uint32_t)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+	return true;
+}
+
+//Points just past "key": in line, or NULL
+const char *json_find(const char *line, const char *key)
+{
+	char pattern[64];
+	const char *p;
+	snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+	p = strstr(line, pattern);
+	return p ? p + strlen(pattern) : NULL;
+}
+
+//Splits the top level of the array at p; strings lose their quotes, nested arrays stay whole
+int json_split(const char *p, Json_token *tok, int max)
+{
+	int n = 0;
+	if (!p || *p != '[')
+		return -1;
+	p++;
+	while (*p && n < max) {
+		while (*p == ' ' || *p == ',')
+			p++;
+		if (*p == ']' || !*p)
+			break;
+		if (*p == '"') {
+			const char *end = strchr(p + 1, '"');
+			if (!end)
+				return -1;
+			tok[n].s = p + 1;
+			tok[n++].len = end - p - 1;
+			p = end + 1;
+		} else if (*p == '[') {
+			int depth = 0;
+			tok[n].s = p;
+			do {
+				depth += (*p == '[') - (*p == ']');
+				p++;
+			} while (*p && depth);
+			tok[n].len = p - tok[n].s;
+			n++;
+		} else {
+			tok[n].s = p;
+			while (*p && *p != ',' && *p != ']')
+				p++;
+			tok[n].len = p - tok[n].s;
+			n++;
+		}
+	}
+	return n;
+}
+
+bool token_is(Json_token t, const char *s)
+{
+	return t.len == (int)strlen(s) && memcmp(t.s, s, t.len) == 0;
+}
+
+/**************************** SOCKET HELPERS ****************************/
+
+int stub_listen(int port)
+{
+	return stratum_listen("127.0.0.1", port);
+}
+
+int stratum_listen(const char *bind_addr, int port)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (fd < 0)
+		return -1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, bind_addr, &addr.sin_addr) != 1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+		listen(fd, 64) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+//Retries for a couple of seconds so an in-process stub has time to come up
+int stratum_connect(const char *host, int port)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+	int attempt;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, host, &addr.sin_addr) != 1)
+		return -1;
+
+	for (attempt = 0; attempt < 200; attempt++) {
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			return fd;
+		}
+		close(fd);
+		usleep(10000);
+	}
+	return -1;
+}
+
+//Buffered line reader; buf/buf_len carry partial input between calls. Returns -1 on EOF.
+int stratum_read_line(int fd, char *line, int cap, char *buf, int *buf_len)
+{
+	for (;;) {
+		char *nl = memchr(buf, '\n', *buf_len);
+		if (nl) {
+			int len = nl - buf;
+			int copy = len < cap - 1 ? len : cap - 1;
+			memcpy(line, buf, copy);
+			line[copy] = '\0';
+			memmove(buf, nl + 1, *buf_len - len - 1);
+			*buf_len -= len + 1;
+			return copy;
+		}
+		if (*buf_len == STRATUM_MAX_LINE)
+			*buf_len = 0;	//Overlong line, drop it
+		ssize_t n = recv(fd, buf + *buf_len, STRATUM_MAX_LINE - *buf_len, 0);
+		if (n <= 0)
+			return -1;
+		*buf_len += n;
+	}
+}
+
+int stratum_send(int fd, const char *line)
+{
+	size_t len = strlen(line), sent = 0;
+	while (sent < len) {
+		ssize_t n = send(fd, line + sent, len - sent, MSG_NOSIGNAL);
+		if (n <= 0)
+			return -1;
+		sent += n;
+	}
+	return 0;
+}
+
+/**************************** CLIENT SIDE ****************************/
+
+bool parse_subscribe(const char *line, unsigned char *extranonce1, size_t *extranonce1_len, int *extranonce2_size)
+{
+	Json_token t[3];
+	int n = json_split(json_find(line, "result"), t, 3);
+	if (n != 3)
+		return false;
+	n = hex_decode(t[1].s, t[1].len, extranonce1, JM_MAX_EXTRANONCE);
+	if (n < 0)
+		return false;
+	*extranonce1_len = n;
+	*extranonce2_size = atoi(t[2].s);
+	return *extranonce2_size > 0 && *extranonce2_size <= JM_MAX_EXTRANONCE;
+}
+
+bool parse_notify(const char *line, Mining_template *tmpl)
+{
+	Json_token t[9], branch[JM_MAX_BRANCH];
+	const char *method = json_find(line, "method");
+	int n, i, len;
+
+	if (!method || strncmp(method, "\"mining.notify\"", 15) != 0)
+		return false;
+	if (json_split(json_find(line, "params"), t, 9) != 9 || t[0].len >= JM_JOB_ID_LEN)
+		return false;
+
+	memcpy(tmpl->job_id, t[0].s, t[0].len);
+	tmpl->job_id[t[0].len] = '\0';
+	if (hex_decode(t[1].s, t[1].len, tmpl->prevhash, 32) != 32)
+		return false;
+	if ((len = hex_decode(t[2].s, t[2].len, tmpl->coinb1, JM_MAX_COINBASE)) < 0)
+		return false;
+	tmpl->coinb1_len = len;
+	if ((len = hex_decode(t[3].s, t[3].len, tmpl->coinb2, JM_MAX_COINBASE)) < 0)
+		return false;
+	tmpl->coinb2_len = len;
+
+	n = json_split(t[4].s, branch, JM_MAX_BRANCH);
+	if (n < 0)
+		return false;
+	for (i = 0; i < n; i++) {
+		if (hex_decode(branch[i].s, branch[i].len, tmpl->branch[i], 32) != 32)
+			return false;
+	}
+	tmpl->branch_len = n;
+
+	if (!hex_u32(t[5], &tmpl->version) || !hex_u32(t[6], &tmpl->nbits) || !hex_u32(t[7], &tmpl->ntime))
+		return false;
+	tmpl->clean = token_is(t[8], "true");
+	return true;
+}
+
+void format_submit(char *line, int cap, int id, const Mining_work *w, int extranonce2_size, uint32_t nonce)
+{
+	unsigned char en2[JM_MAX_EXTRANONCE];
+	char en2_hex[2 * JM_MAX_EXTRANONCE + 1];
+	int i;
+
+	for (i = 0; i < extranonce2_size; i++)
+		en2[i] = i < 8 ? w->extranonce2 >> (8 * i) : 0;
+	hex_encode(en2, extranonce2_size, en2_hex);
+	snprintf(line, cap, "{\"id\":%d,\"method\":\"mining.submit\",\"params\":[\"cpu\",\"%s\",\"%s\",\"%08x\",\"%08x\"]}\n", id,
+		w->job_id, en2_hex, w->ntime, nonce);
+}
+
+/**************************** SERVER SIDE ****************************/
+
+static uint64_t rng_state;
+
+static uint64_t rng_next()
+{
+	if (!rng_state)
+		rng_state = now_ns() | 1;
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static void random_bytes(unsigned char *p, size_t len)
+{
+	size_t i;
+	for (i = 0; i < len; i++)
+		p[i] = rng_next();
+}
+
+//Random coinbase halves of typical size around the extranonce, plus num_tx - 1 random txids
+void make_template(Stub_config *cfg, int job, Mining_template *tmpl)
+{
+	int num_tx = cfg->num_tx > 1 ? cfg->num_tx : 1;
+	unsigned char (*txids)[32] = calloc(num_tx, 32);
+
+	memset(tmpl, 0, sizeof(*tmpl));
+	snprintf(tmpl->job_id, JM_JOB_ID_LEN, "%x", job);
+	random_bytes(tmpl->prevhash, 32);
+	tmpl->coinb1_len = 42 + rng_next() % 64;
+	random_bytes(tmpl->coinb1, tmpl->coinb1_len);
+	tmpl->coinb2_len = 60 + rng_next() % 64;
+	random_bytes(tmpl->coinb2, tmpl->coinb2_len);
+	random_bytes(txids[0], 32 * num_tx);
+	merkle_branch(txids, num_tx, tmpl->branch, &tmpl->branch_len);
+	tmpl->version = 0x20000000;
+	tmpl->nbits = cfg->nbits;
+	tmpl->ntime = time(NULL);
+	tmpl->clean = true;
+	free(txids);
+}
+
+void send_notify(int fd, const Mining_template *tmpl)
+{
+	char *line = malloc(STRATUM_MAX_LINE);
+	char prevhash[65], coinb1[2 * JM_MAX_COINBASE + 1], coinb2[2 * JM_MAX_COINBASE + 1], hash[65];
+	int i, len;
+
+	hex_encode(tmpl->prevhash, 32, prevhash);
+	hex_encode(tmpl->coinb1, tmpl->coinb1_len, coinb1);
+	hex_encode(tmpl->coinb2, tmpl->coinb2_len, coinb2);
+	len = snprintf(line, STRATUM_MAX_LINE, "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"%s\",\"%s\",\"%s\",\"%s\",[", tmpl->job_id,
+		prevhash, coinb1, coinb2);
+	for (i = 0; i < tmpl->branch_len; i++) {
+		hex_encode(tmpl->branch[i], 32, hash);
+		len += snprintf(line + len, STRATUM_MAX_LINE - len, "%s\"%s\"", i ? "," : "", hash);
+	}
+	snprintf(line + len, STRATUM_MAX_LINE - len, "],\"%08x\",\"%08x\",\"%08x\",%s]}\n", tmpl->version, tmpl->nbits, tmpl->ntime,
+		tmpl->clean ? "true" : "false");
+	stratum_send(fd, line);
+	free(line);
+}
+
+static void handle_submit(Stub_config *cfg, int fd, const char *line, Mining_template *history, int jobs,
+	const unsigned char *extranonce1, size_t extranonce1_len)
+{
+	Json_token t[5];
+	const char *id = json_find(line, "id");
+	const char *verdict = "false,\"error\":[23,\"Low difficulty share\",null]";
+	unsigned char en2[JM_MAX_EXTRANONCE], header[80], hash[32], target[32];
+	uint32_t ntime, nonce;
+	uint64_t extranonce2 = 0;
+	char reply[160];
+	int i, en2_len;
+
+	if (json_split(json_find(line, "params"), t, 5) != 5 || !hex_u32(t[3], &ntime) || !hex_u32(t[4], &nonce) ||
+		(en2_len = hex_decode(t[2].s, t[2].len, en2, JM_MAX_EXTRANONCE)) != cfg->extranonce2_size) {
+		cfg->shares_rejected++;
+		verdict = "false,\"error\":[20,\"Malformed share\",null]";
+	} else {
+		const Mining_template *tmpl = NULL;
+		for (i = 0; i < STUB_HISTORY && i < jobs; i++) {
+			if (token_is(t[1], history[(jobs - 1 - i) % STUB_HISTORY].job_id))
+				tmpl = &history[(jobs - 1 - i) % STUB_HISTORY];
+		}
+		for (i = 0; i < en2_len && i < 8; i++)
+			extranonce2 |= (uint64_t)en2[i] << (8 * i);
+
+		if (!tmpl) {
+			cfg->shares_stale++;
+			verdict = "false,\"error\":[21,\"Job not found\",null]";
+		} else {
+			build_header(tmpl, extranonce1, extranonce1_len, extranonce2, cfg->extranonce2_size, ntime, nonce, header);
+			sha256d(header, 80, hash);
+			set_difficulty(target, tmpl->nbits);
+			if (hash_meets_target(hash, target)) {
+				cfg->shares_accepted++;
+				verdict = "true,\"error\":null";
+			} else {
+				cfg->shares_rejected++;
+			}
+		}
+	}
+	snprintf(reply, sizeof(reply), "{\"id\":%d,\"result\":%s}\n", id ? atoi(id) : 0, verdict);
+	stratum_send(fd, reply);
+}
+
+void *stub_serve(void *config)
+{
+	Stub_config *cfg = config;
+	Mining_template *history = calloc(STUB_HISTORY, sizeof(Mining_template));
+	char *line = malloc(STRATUM_MAX_LINE), *buf = malloc(STRATUM_MAX_LINE);
+	unsigned char extranonce1[4];
+	char en1_hex[9];
+	int buf_len = 0;
+	int lfd, fd;
+	uint64_t next_push;
+
+	rng_state = now_ns() | 1;
+	lfd = stub_listen(cfg->port);
+	if (lfd < 0) {
+		perror("stub: listen");
+		return NULL;
+	}
+	fd = accept(lfd, NULL, NULL);
+	close(lfd);
+	if (fd < 0)
+		return NULL;
+
+	//mining.subscribe
+	if (stratum_read_line(fd, line, STRATUM_MAX_LINE, buf, &buf_len) < 0)
+		goto done;
+	random_bytes(extranonce1, sizeof(extranonce1));
+	hex_encode(extranonce1, sizeof(extranonce1), en1_hex);
+	snprintf(line, STRATUM_MAX_LINE, "{\"id\":1,\"result\":[[],\"%s\",%d],\"error\":null}\n", en1_hex, cfg->extranonce2_size);
+	stratum_send(fd, line);
+
+	next_push = now_ns();
+	while (!cfg->stop) {
+		uint64_t now = now_ns();
+		struct pollfd pfd = {fd, POLLIN, 0};
+
+		if (now >= next_push) {
+			if (cfg->max_jobs && cfg->jobs_sent == cfg->max_jobs)
+				break;
+			Mining_template *tmpl = &history[cfg->jobs_sent % STUB_HISTORY];
+			make_template(cfg, cfg->jobs_sent, tmpl);
+			send_notify(fd, tmpl);
+			cfg->jobs_sent++;
+			next_push = now + (uint64_t)cfg->interval_ms * 1000000;
+			continue;
+		}
+		if (!memchr(buf, '\n', buf_len) && poll(&pfd, 1, (next_push - now) / 1000000 + 1) <= 0)
+			continue;
+		if (stratum_read_line(fd, line, STRATUM_MAX_LINE, buf, &buf_len) < 0)
+			break;
+		if (strstr(line, "\"mining.submit\""))
+			handle_submit(cfg, fd, line, history, cfg->jobs_sent, extranonce1, sizeof(extranonce1));
+	}
+
+done:
+	close(fd);
+	free(history);
+	free(line);
+	free(buf);
+	return NULL;
+}
@@ -0,0 +1,64 @@
+#ifndef STRATUM_STUB_H
+#define STRATUM_STUB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "job_manager.h"
+
+/*
+	Local stand-in for a stratum v1 pool
+
+	Speaks the line-delimited JSON subset a miner needs: mining.subscribe, mining.notify and
+	mining.submit. Header fields travel as big endian hex like real stratum, prevhash as the
+	raw header bytes. Templates carry random transactions so the Merkle branch has the length
+	a real block would, and every submitted share is rebuilt and checked against the target.
+*/
+
+#define STRATUM_MAX_LINE (8 * JM_MAX_COINBASE)
+
+typedef struct {
+	int port;
+	int interval_ms;		//Time between pushed templates
+	int max_jobs;			//Templates to push before closing, 0 = until the client leaves
+	int num_tx;				//Transactions per template, coinbase included
+	uint32_t nbits;
+	int extranonce2_size;
+	volatile bool stop;
+
+	//Filled in by the server
+	_Atomic int jobs_sent;		//Also read by the miner while the stub runs
+	int shares_accepted;
+	int shares_rejected;
+	int shares_stale;
+} Stub_config;
+
+typedef struct {
+	const char *s;
+	int len;
+} Json_token;
+
+int stub_listen(int port);
+int stratum_listen(const char *bind_addr, int port);
+void *stub_serve(void *config);	//Serves one client on config->port; pthread entry point
+
+int stratum_connect(const char *host, int port);
+//buf must hold STRATUM_MAX_LINE bytes and starts out empty (*buf_len == 0)
+int stratum_read_line(int fd, char *line, int cap, char *buf, int *buf_len);
+int stratum_send(int fd, const char *line);
+
+bool parse_subscribe(const char *line, unsigned char *extranonce1, size_t *extranonce1_len, int *extranonce2_size);
+bool parse_notify(const char *line, Mining_template *tmpl);
+void format_submit(char *line, int cap, int id, const Mining_work *w, int extranonce2_size, uint32_t nonce);
+
+//Template and line helpers shared with the nonce coordinator
+void make_template(Stub_config *cfg, int job, Mining_template *tmpl);
+void send_notify(int fd, const Mining_template *tmpl);
+void hex_encode(const unsigned char *data, size_t len, char *out);
+int hex_decode(const char *s, int len, unsigned char *out, int cap);
+bool hex_u32(Json_token t, uint32_t *v);
+const char *json_find(const char *line, const char *key);
+int json_split(const char *p, Json_token *tok, int max);
+bool token_is(Json_token t, const char *s);
+
+#endif
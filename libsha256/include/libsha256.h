@@ -0,0 +1,116 @@
+#ifndef LIBSHA256_H
+#define LIBSHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  libsha256: one SHA-256 implementation for the benchmarks, the tools and the miner.
+
+  The ABI is plain C and stable within a major version: the context layout below is fixed (reserved words included),
+  functions are only ever added, and backends are described by a versioned struct.
+
+  Several backends are compiled in and register themselves on first use: scalar, interleaved (two scalar streams
+  per call for instruction-level parallelism), avx2 (8 lanes), avx512 (16 lanes) and shani (SHA extensions). The
+  fastest one the CPU supports is picked at startup unless SHA256_BACKEND names another. Streaming calls use the
+  backend's single-stream transform. libsha256_batch() hashes independent messages across its lanes. When the
+  automatic pick is single-lane (shani) and a 16-lane backend is supported, batches of messages that are a few blocks
+  long go to the wide backend instead, which is faster there; shorter ones stay on the single stream.
+*/
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// The library is built with -fvisibility=hidden; only what this header declares is exported.
+#pragma GCC visibility push(default)
+
+#define LIBSHA256_VERSION_MAJOR 1
+#define LIBSHA256_VERSION_MINOR 3
+
+#define LIBSHA256_DIGEST_SIZE 32
+#define LIBSHA256_BLOCK_SIZE 64
+
+  typedef struct libsha256_ctx
+  {
+    uint32_t state[8];
+    uint64_t length;  // bytes absorbed so far
+    uint8_t buffer[LIBSHA256_BLOCK_SIZE];
+    uint32_t buffer_len;
+    uint32_t reserved[7];
+  } libsha256_ctx;
+
+  // Streaming interface. A context can be reused after libsha256_final().
+  void libsha256_init(libsha256_ctx *ctx);
+  void libsha256_update(libsha256_ctx *ctx, const void *data, size_t len);
+  void libsha256_final(libsha256_ctx *ctx, uint8_t digest[LIBSHA256_DIGEST_SIZE]);
+
+  // One-shot digest of a single message.
+  void libsha256(const void *data, size_t len, uint8_t digest[LIBSHA256_DIGEST_SIZE]);
+
+  // Digests of n independent messages; digests[i] receives the hash of msgs[i] (lens[i] bytes).
+  void libsha256_batch(const void *const *msgs, const size_t *lens, size_t n, uint8_t (*digests)[LIBSHA256_DIGEST_SIZE]);
+
+  // Compressed state after a 64-byte-aligned prefix of `length` bytes, for resuming messages that share it.
+  typedef struct libsha256_midstate
+  {
+    uint32_t state[8];
+    uint64_t length;  // multiple of LIBSHA256_BLOCK_SIZE
+  } libsha256_midstate;
+
+  // Starts ctx as if the prefix behind mid had already been absorbed (since 1.1).
+  void libsha256_init_from(libsha256_ctx *ctx, const libsha256_midstate *mid);
+
+  // libsha256_batch() where msgs[i] continues from starts[i], or from the IV if starts or starts[i] is NULL (since 1.1).
+  void libsha256_batch_from(const libsha256_midstate *const *starts, const void *const *msgs, const size_t *lens, size_t n,
+                            uint8_t (*digests)[LIBSHA256_DIGEST_SIZE]);
+
+  // Raw compression of nblocks 64-byte blocks into state, for callers that keep midstates.
+  void libsha256_transform(uint32_t state[8], const void *blocks, size_t nblocks);
+
+  // Hash chains: replaces each of the n digests with SHA-256 iterated `steps` times over it, h <- SHA-256(h). Chains
+  // advance side by side across the backend's lanes (since 1.2).
+  void libsha256_chain(uint8_t (*digests)[LIBSHA256_DIGEST_SIZE], size_t n, uint64_t steps);
+
+  /*
+    Backends. transform() compresses blocks into one state. transform_lanes(), if set, runs `lanes` independent
+    states at once: lane i compresses nblocks[i] blocks from data[i], and lanes with fewer blocks keep their state.
+  */
+#define LIBSHA256_BACKEND_ABI 1
+
+  typedef struct libsha256_backend
+  {
+    uint32_t abi;  // LIBSHA256_BACKEND_ABI
+    const char *name;
+    int priority;  // higher wins the automatic choice
+    size_t lanes;
+    int (*supported)(void);
+    void (*transform)(uint32_t state[8], const uint8_t *blocks, size_t nblocks);
+    void (*transform_lanes)(uint32_t (*states)[8], const uint8_t *const *data, const size_t *nblocks);
+  } libsha256_backend;
+
+  // Adds a backend; returns 0, or -1 if the ABI does not match, the name is taken or the table is full.
+  int libsha256_register_backend(const libsha256_backend *backend);
+
+  // Switches every thread to the named backend; returns 0, or -1 if it is unknown or unsupported on this CPU.
+  int libsha256_set_backend(const char *name);
+
+  const char *libsha256_backend_name(void);
+  size_t libsha256_backend_lanes(void);
+
+  // Lanes of the backend long batches run on, which is the width to fill libsha256_batch() calls to (since 1.3).
+  size_t libsha256_batch_lanes(void);
+
+  // Supported backends, in registration order; NULL past the end.
+  const char *libsha256_backend_at(size_t i);
+
+  int libsha256_version(void);  // major * 100 + minor
+
+#pragma GCC visibility pop
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
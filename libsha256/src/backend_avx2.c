@@ -0,0 +1,133 @@
+#include <immintrin.h>
+
+#include "internal.h"
+
+/*
+  8-lane AVX2 backend: one message per 32-bit lane. Each lane carries its own chaining state and block count; lanes
+  that run out of blocks read a zero block and keep their state through a blend mask while the longer lanes finish.
+  When every lane pointer is 32-byte aligned (pool buffers are) the block loads use aligned moves.
+*/
+
+#define XOR _mm256_xor_si256
+#define OR _mm256_or_si256
+#define AND _mm256_and_si256
+#define ANDNOT _mm256_andnot_si256
+#define ADD32 _mm256_add_epi32
+
+#define ROTR32(x, y) OR(_mm256_srli_epi32(x, y), _mm256_slli_epi32(x, 32 - y))
+#define XOR3(a, b, c) XOR(XOR(a, b), c)
+#define ADD5_32(a, b, c, d, e) ADD32(ADD32(ADD32(ADD32(a, b), c), d), e)
+
+#define MAJ_AVX(a, b, c) XOR3(AND(a, b), AND(a, c), AND(b, c))
+#define CH_AVX(a, b, c) XOR(AND(a, b), ANDNOT(a, c))
+#define SIGMA1_AVX(x) XOR3(ROTR32(x, 6), ROTR32(x, 11), ROTR32(x, 25))
+#define SIGMA0_AVX(x) XOR3(ROTR32(x, 2), ROTR32(x, 13), ROTR32(x, 22))
+#define WSIGMA1_AVX(x) XOR3(ROTR32(x, 17), ROTR32(x, 19), _mm256_srli_epi32(x, 10))
+#define WSIGMA0_AVX(x) XOR3(ROTR32(x, 7), ROTR32(x, 18), _mm256_srli_epi32(x, 3))
+
+#define TARGET __attribute__((target("avx2")))
+
+static const uint8_t zero_block[64] __attribute__((aligned(32)));
+
+TARGET static inline void transpose8(__m256i s[8])
+{
+  __m256i t0[8], t1[8];
+  for (int i = 0; i < 4; i++)
+  {
+    t0[2 * i] = _mm256_unpacklo_epi32(s[2 * i], s[2 * i + 1]);
+    t0[2 * i + 1] = _mm256_unpackhi_epi32(s[2 * i], s[2 * i + 1]);
+  }
+  t1[0] = _mm256_unpacklo_epi64(t0[0], t0[2]);
+  t1[1] = _mm256_unpackhi_epi64(t0[0], t0[2]);
+  t1[2] = _mm256_unpacklo_epi64(t0[1], t0[3]);
+  t1[3] = _mm256_unpackhi_epi64(t0[1], t0[3]);
+  t1[4] = _mm256_unpacklo_epi64(t0[4], t0[6]);
+  t1[5] = _mm256_unpackhi_epi64(t0[4], t0[6]);
+  t1[6] = _mm256_unpacklo_epi64(t0[5], t0[7]);
+  t1[7] = _mm256_unpackhi_epi64(t0[5], t0[7]);
+  for (int i = 0; i < 4; i++)
+  {
+    s[i] = _mm256_permute2x128_si256(t1[i], t1[i + 4], 0x20);
+    s[i + 4] = _mm256_permute2x128_si256(t1[i], t1[i + 4], 0x31);
+  }
+}
+
+TARGET static inline __attribute__((always_inline)) void lanes8(uint32_t (*states)[8], const uint8_t *const *data, const size_t *nblocks,
+                                                                int aligned)
+{
+  const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7,
+                                        0, 1, 2, 3);
+  __m256i s[8], w[16], T0, T1;
+  size_t max_blocks = 0;
+
+  for (int i = 0; i < 8; i++)
+  {
+    s[i] = _mm256_loadu_si256((const __m256i *)states[i]);
+    if (nblocks[i] > max_blocks)
+      max_blocks = nblocks[i];
+  }
+  if (!max_blocks)
+    return;
+  transpose8(s);
+
+  for (size_t blk = 0; blk < max_blocks; blk++)
+  {
+    for (int i = 0; i < 8; i++)
+    {
+      const uint8_t *p = blk < nblocks[i] ? data[i] + 64 * blk : zero_block;
+      __m256i lo = aligned ? _mm256_load_si256((const __m256i *)p) : _mm256_loadu_si256((const __m256i *)p);
+      __m256i hi = aligned ? _mm256_load_si256((const __m256i *)(p + 32)) : _mm256_loadu_si256((const __m256i *)(p + 32));
+      w[i] = _mm256_shuffle_epi8(lo, bswap);
+      w[i + 8] = _mm256_shuffle_epi8(hi, bswap);
+    }
+    __m256i active = _mm256_set_epi32(-(blk < nblocks[7]), -(blk < nblocks[6]), -(blk < nblocks[5]), -(blk < nblocks[4]),
+                                      -(blk < nblocks[3]), -(blk < nblocks[2]), -(blk < nblocks[1]), -(blk < nblocks[0]));
+    transpose8(w);
+    transpose8(w + 8);
+
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int t = 0; t < 64; t++)
+    {
+      if (t >= 16)
+        w[t & 15] = ADD32(ADD32(WSIGMA1_AVX(w[(t - 2) & 15]), w[(t - 7) & 15]), ADD32(WSIGMA0_AVX(w[(t - 15) & 15]), w[t & 15]));
+      T0 = ADD5_32(h, SIGMA1_AVX(e), CH_AVX(e, f, g), _mm256_set1_epi32(libsha256_K[t]), w[t & 15]);
+      T1 = ADD32(SIGMA0_AVX(a), MAJ_AVX(a, b, c));
+      h = g;
+      g = f;
+      f = e;
+      e = ADD32(d, T0);
+      d = c;
+      c = b;
+      b = a;
+      a = ADD32(T0, T1);
+    }
+    __m256i r[8] = {a, b, c, d, e, f, g, h};
+    for (int i = 0; i < 8; i++) s[i] = _mm256_blendv_epi8(s[i], ADD32(s[i], r[i]), active);
+  }
+
+  transpose8(s);
+  for (int i = 0; i < 8; i++) _mm256_storeu_si256((__m256i *)states[i], s[i]);
+}
+
+TARGET static void transform_lanes8(uint32_t (*states)[8], const uint8_t *const *data, const size_t *nblocks)
+{
+  uintptr_t bits = 0;
+  for (int i = 0; i < 8; i++) bits |= (uintptr_t)data[i];
+  if (bits & 31)
+    lanes8(states, data, nblocks, 0);
+  else
+    lanes8(states, data, nblocks, 1);
+}
+
+static int supported(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+static const libsha256_backend avx2 = {LIBSHA256_BACKEND_ABI, "avx2", 30, 8, supported, libsha256_transform_scalar, transform_lanes8};
+
+void libsha256_register_avx2(void)
+{
+  libsha256_register_builtin(&avx2);
+}
@@ -0,0 +1,122 @@
+#include <immintrin.h>
+
+#include "internal.h"
+
+/*
+  16-lane AVX-512 backend, the AVX2 layout at twice the width. Only AVX-512F is required: rotates and the three-input
+  Ch/Maj functions are single instructions (vprord, vpternlogd), the byte swap is two masked rotates, and lanes that
+  have run out of blocks are left alone by a masked add instead of a blend.
+*/
+
+#define ADD32 _mm512_add_epi32
+#define ROTR32 _mm512_ror_epi32
+#define XOR3(a, b, c) _mm512_ternarylogic_epi32(a, b, c, 0x96)
+#define CH(e, f, g) _mm512_ternarylogic_epi32(e, f, g, 0xCA)
+#define MAJ(a, b, c) _mm512_ternarylogic_epi32(a, b, c, 0xE8)
+
+#define SIGMA1(x) XOR3(ROTR32(x, 6), ROTR32(x, 11), ROTR32(x, 25))
+#define SIGMA0(x) XOR3(ROTR32(x, 2), ROTR32(x, 13), ROTR32(x, 22))
+#define WSIGMA1(x) XOR3(ROTR32(x, 17), ROTR32(x, 19), _mm512_srli_epi32(x, 10))
+#define WSIGMA0(x) XOR3(ROTR32(x, 7), ROTR32(x, 18), _mm512_srli_epi32(x, 3))
+
+#define TARGET __attribute__((target("avx512f")))
+
+static const uint8_t zero_block[64] __attribute__((aligned(64)));
+
+TARGET static inline __m512i bswap32(__m512i x)
+{
+  const __m512i even = _mm512_set1_epi32(0x00ff00ff);
+  return _mm512_or_si512(_mm512_rol_epi32(_mm512_and_si512(x, even), 24), _mm512_rol_epi32(_mm512_andnot_si512(even, x), 8));
+}
+
+// r[i] holds the 16 words of lane i on entry and word i of every lane on return.
+TARGET static inline void transpose16(__m512i r[16])
+{
+  __m512i t[16], u[16];
+  for (int i = 0; i < 8; i++)
+  {
+    t[2 * i] = _mm512_unpacklo_epi32(r[2 * i], r[2 * i + 1]);
+    t[2 * i + 1] = _mm512_unpackhi_epi32(r[2 * i], r[2 * i + 1]);
+  }
+  for (int i = 0; i < 4; i++)
+  {
+    u[4 * i] = _mm512_unpacklo_epi64(t[4 * i], t[4 * i + 2]);
+    u[4 * i + 1] = _mm512_unpackhi_epi64(t[4 * i], t[4 * i + 2]);
+    u[4 * i + 2] = _mm512_unpacklo_epi64(t[4 * i + 1], t[4 * i + 3]);
+    u[4 * i + 3] = _mm512_unpackhi_epi64(t[4 * i + 1], t[4 * i + 3]);
+  }
+  // u[4i + j] now holds word 4k + j of lanes 4i..4i+3 in its 128-bit chunk k; transpose the chunks.
+  for (int j = 0; j < 4; j++)
+  {
+    __m512i v0 = _mm512_shuffle_i32x4(u[j], u[4 + j], 0x44);
+    __m512i v1 = _mm512_shuffle_i32x4(u[j], u[4 + j], 0xEE);
+    __m512i v2 = _mm512_shuffle_i32x4(u[8 + j], u[12 + j], 0x44);
+    __m512i v3 = _mm512_shuffle_i32x4(u[8 + j], u[12 + j], 0xEE);
+    r[j] = _mm512_shuffle_i32x4(v0, v2, 0x88);
+    r[4 + j] = _mm512_shuffle_i32x4(v0, v2, 0xDD);
+    r[8 + j] = _mm512_shuffle_i32x4(v1, v3, 0x88);
+    r[12 + j] = _mm512_shuffle_i32x4(v1, v3, 0xDD);
+  }
+}
+
+TARGET static void transform_lanes16(uint32_t (*states)[8], const uint8_t *const *data, const size_t *nblocks)
+{
+  const __m512i index = _mm512_set_epi32(120, 112, 104, 96, 88, 80, 72, 64, 56, 48, 40, 32, 24, 16, 8, 0);
+  __m512i s[8], w[16], T0, T1;
+  size_t max_blocks = 0;
+
+  for (int i = 0; i < 16; i++)
+    if (nblocks[i] > max_blocks)
+      max_blocks = nblocks[i];
+  if (!max_blocks)
+    return;
+  for (int i = 0; i < 8; i++) s[i] = _mm512_i32gather_epi32(index, &states[0][i], 4);
+
+  for (size_t blk = 0; blk < max_blocks; blk++)
+  {
+    __mmask16 active = 0;
+    for (int i = 0; i < 16; i++)
+    {
+      const uint8_t *p = blk < nblocks[i] ? data[i] + 64 * blk : zero_block;
+      w[i] = _mm512_loadu_si512(p);
+      active |= (__mmask16)(blk < nblocks[i]) << i;
+    }
+    transpose16(w);
+    for (int i = 0; i < 16; i++) w[i] = bswap32(w[i]);
+
+    __m512i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int t = 0; t < 64; t++)
+    {
+      if (t >= 16)
+        w[t & 15] = ADD32(ADD32(WSIGMA1(w[(t - 2) & 15]), w[(t - 7) & 15]), ADD32(WSIGMA0(w[(t - 15) & 15]), w[t & 15]));
+      T0 = ADD32(ADD32(ADD32(h, SIGMA1(e)), ADD32(CH(e, f, g), _mm512_set1_epi32(libsha256_K[t]))), w[t & 15]);
+      T1 = ADD32(SIGMA0(a), MAJ(a, b, c));
+      h = g;
+      g = f;
+      f = e;
+      e = ADD32(d, T0);
+      d = c;
+      c = b;
+      b = a;
+      a = ADD32(T0, T1);
+    }
+    __m512i r[8] = {a, b, c, d, e, f, g, h};
+    for (int i = 0; i < 8; i++) s[i] = _mm512_mask_add_epi32(s[i], active, s[i], r[i]);
+  }
+
+  for (int i = 0; i < 8; i++) _mm512_i32scatter_epi32(&states[0][i], index, s[i], 4);
+}
+
+static int supported(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx512f");
+}
+
+static const libsha256_backend avx512 = {LIBSHA256_BACKEND_ABI, "avx512", 40, 16, supported, libsha256_transform_scalar,
+                                         transform_lanes16};
+
+void libsha256_register_avx512(void)
+{
+  libsha256_register_builtin(&avx512);
+}
@@ -0,0 +1,125 @@
+#include "internal.h"
+
+/*
+  Portable backends. "scalar" is the reference compression function. "interleaved" runs two independent streams
+  through one loop, so the out-of-order core always has a second dependency chain to schedule while the first one
+  waits on its adds; batches hash two messages per call. With sixteen working variables live it spills on x86-64,
+  where it measured slower than scalar, so it ranks below scalar and is only used when asked for.
+*/
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define EP0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define EP1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SIG0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SIG1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+void libsha256_transform_scalar(uint32_t state[8], const uint8_t *blocks, size_t nblocks)
+{
+  for (; nblocks; nblocks--, blocks += 64)
+  {
+    uint32_t W[64], a, b, c, d, e, f, g, h, T1, T2;
+    int i;
+
+    for (i = 0; i < 16; i++) W[i] = libsha256_load_be32(blocks + 4 * i);
+    for (; i < 64; i++) W[i] = SIG1(W[i - 2]) + W[i - 7] + SIG0(W[i - 15]) + W[i - 16];
+
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
+#pragma GCC unroll 64
+    for (i = 0; i < 64; i++)
+    {
+      T1 = h + EP1(e) + CH(e, f, g) + libsha256_K[i] + W[i];
+      T2 = EP0(a) + MAJ(a, b, c);
+      h = g;
+      g = f;
+      f = e;
+      e = d + T1;
+      d = c;
+      c = b;
+      b = a;
+      a = T1 + T2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+// One block of two streams; the compiler keeps both sets of working variables in registers.
+static void compress2(uint32_t s0[8], const uint8_t *p0, uint32_t s1[8], const uint8_t *p1)
+{
+  uint32_t W0[64], W1[64];
+  int i;
+
+  for (i = 0; i < 16; i++)
+  {
+    W0[i] = libsha256_load_be32(p0 + 4 * i);
+    W1[i] = libsha256_load_be32(p1 + 4 * i);
+  }
+  for (; i < 64; i++)
+  {
+    W0[i] = SIG1(W0[i - 2]) + W0[i - 7] + SIG0(W0[i - 15]) + W0[i - 16];
+    W1[i] = SIG1(W1[i - 2]) + W1[i - 7] + SIG0(W1[i - 15]) + W1[i - 16];
+  }
+
+  uint32_t a0 = s0[0], b0 = s0[1], c0 = s0[2], d0 = s0[3], e0 = s0[4], f0 = s0[5], g0 = s0[6], h0 = s0[7];
+  uint32_t a1 = s1[0], b1 = s1[1], c1 = s1[2], d1 = s1[3], e1 = s1[4], f1 = s1[5], g1 = s1[6], h1 = s1[7];
+#pragma GCC unroll 64
+  for (i = 0; i < 64; i++)
+  {
+    uint32_t T10 = h0 + EP1(e0) + CH(e0, f0, g0) + libsha256_K[i] + W0[i];
+    uint32_t T11 = h1 + EP1(e1) + CH(e1, f1, g1) + libsha256_K[i] + W1[i];
+    uint32_t T20 = EP0(a0) + MAJ(a0, b0, c0);
+    uint32_t T21 = EP0(a1) + MAJ(a1, b1, c1);
+    h0 = g0;
+    h1 = g1;
+    g0 = f0;
+    g1 = f1;
+    f0 = e0;
+    f1 = e1;
+    e0 = d0 + T10;
+    e1 = d1 + T11;
+    d0 = c0;
+    d1 = c1;
+    c0 = b0;
+    c1 = b1;
+    b0 = a0;
+    b1 = a1;
+    a0 = T10 + T20;
+    a1 = T11 + T21;
+  }
+  s0[0] += a0, s0[1] += b0, s0[2] += c0, s0[3] += d0, s0[4] += e0, s0[5] += f0, s0[6] += g0, s0[7] += h0;
+  s1[0] += a1, s1[1] += b1, s1[2] += c1, s1[3] += d1, s1[4] += e1, s1[5] += f1, s1[6] += g1, s1[7] += h1;
+}
+
+static void transform_lanes2(uint32_t (*states)[8], const uint8_t *const *data, const size_t *nblocks)
+{
+  size_t both = nblocks[0] < nblocks[1] ? nblocks[0] : nblocks[1];
+  for (size_t i = 0; i < both; i++) compress2(states[0], data[0] + 64 * i, states[1], data[1] + 64 * i);
+  for (int lane = 0; lane < 2; lane++)
+    if (nblocks[lane] > both)
+      libsha256_transform_scalar(states[lane], data[lane] + 64 * both, nblocks[lane] - both);
+}
+
+static const libsha256_backend scalar = {LIBSHA256_BACKEND_ABI, "scalar", 10, 1, NULL, libsha256_transform_scalar, NULL};
+static const libsha256_backend interleaved = {LIBSHA256_BACKEND_ABI, "interleaved", 5, 2, NULL, libsha256_transform_scalar,
+                                              transform_lanes2};
+
+void libsha256_register_scalar(void)
+{
+  libsha256_register_builtin(&scalar);
+  libsha256_register_builtin(&interleaved);
+}
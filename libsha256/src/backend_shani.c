@@ -0,0 +1,151 @@
+#include <cpuid.h>
+#include <immintrin.h>
+
+#include "internal.h"
+
+/*
+  SHA extensions backend (sha256rnds2 / sha256msg1 / sha256msg2), single stream. The state lives in the ABEF/CDGH
+  register layout the instructions expect; each iteration of the round loop does four rounds and advances the
+  message schedule one quarter, the same sequence as Intel's reference code with the unrolling left to the compiler.
+*/
+
+#define TARGET __attribute__((target("sha,sse4.1,ssse3")))
+
+// Four rounds (i = 0..15) and the matching quarter of the message schedule; W[0..3] must hold words 0-15 on entry.
+TARGET static inline __attribute__((always_inline)) void rounds4(int i, __m128i *STATE0, __m128i *STATE1, __m128i W[4])
+{
+  __m128i MSG = _mm_add_epi32(W[i & 3], _mm_loadu_si128((const __m128i *)&libsha256_K[4 * i]));
+  *STATE1 = _mm_sha256rnds2_epu32(*STATE1, *STATE0, MSG);
+  if (i >= 3 && i <= 14)
+  {
+    __m128i TMP = _mm_alignr_epi8(W[i & 3], W[(i + 3) & 3], 4);
+    W[(i + 1) & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(W[(i + 1) & 3], TMP), W[i & 3]);
+  }
+  MSG = _mm_shuffle_epi32(MSG, 0x0E);
+  *STATE0 = _mm_sha256rnds2_epu32(*STATE0, *STATE1, MSG);
+  if (i >= 1 && i <= 12)
+    W[(i + 3) & 3] = _mm_sha256msg1_epu32(W[(i + 3) & 3], W[i & 3]);
+}
+
+// state[0..7] <-> the ABEF/CDGH pair.
+TARGET static inline __attribute__((always_inline)) void load_state(const uint32_t state[8], __m128i *STATE0, __m128i *STATE1)
+{
+  __m128i TMP = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);  // CDAB
+  *STATE1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);  // EFGH
+  *STATE0 = _mm_alignr_epi8(TMP, *STATE1, 8);  // ABEF
+  *STATE1 = _mm_blend_epi16(*STATE1, TMP, 0xF0);  // CDGH
+}
+
+// ABEF/CDGH to words in order: DCBA and HGFE, which are also the first two message vectors of a 32-byte input.
+TARGET static inline __attribute__((always_inline)) void state_words(__m128i STATE0, __m128i STATE1, __m128i *DCBA, __m128i *HGFE)
+{
+  __m128i TMP = _mm_shuffle_epi32(STATE0, 0x1B);  // FEBA
+  STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);  // DCHG
+  *DCBA = _mm_blend_epi16(TMP, STATE1, 0xF0);
+  *HGFE = _mm_alignr_epi8(STATE1, TMP, 8);
+}
+
+TARGET static void transform_shani(uint32_t state[8], const uint8_t *blocks, size_t nblocks)
+{
+  const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i STATE0, STATE1, W[4];
+
+  load_state(state, &STATE0, &STATE1);
+  for (; nblocks; nblocks--, blocks += 64)
+  {
+    __m128i ABEF_SAVE = STATE0, CDGH_SAVE = STATE1;
+    for (int i = 0; i < 4; i++) W[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 16 * i)), MASK);
+#pragma GCC unroll 16
+    for (int i = 0; i < 16; i++) rounds4(i, &STATE0, &STATE1, W);
+    STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+    STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+  }
+
+  __m128i DCBA, HGFE;
+  state_words(STATE0, STATE1, &DCBA, &HGFE);
+  _mm_storeu_si128((__m128i *)&state[0], DCBA);
+  _mm_storeu_si128((__m128i *)&state[4], HGFE);
+}
+
+/*
+  Hash chains, h <- SHA-256(h). A 32-byte message is one block whose second half is constant padding, and its first
+  half is the previous digest's words in the order state_words() produces, so a step never leaves the registers:
+  rebuild the message from the state, restart from the IV, run the 64 rounds. One chain is bound by the latency of
+  sha256rnds2; two independent chains interleaved keep the unit busy while each waits on its own result.
+*/
+
+TARGET static void chain_shani_x1(uint32_t state[8], uint64_t steps)
+{
+  const __m128i PAD0 = _mm_set_epi32(0, 0, 0, (int)0x80000000), PAD1 = _mm_set_epi32(256, 0, 0, 0);
+  __m128i IV0, IV1, STATE0, STATE1, W[4];
+  load_state(libsha256_IV, &IV0, &IV1);
+  load_state(state, &STATE0, &STATE1);
+  for (; steps; steps--)
+  {
+    state_words(STATE0, STATE1, &W[0], &W[1]);
+    W[2] = PAD0, W[3] = PAD1;
+    STATE0 = IV0, STATE1 = IV1;
+#pragma GCC unroll 16
+    for (int i = 0; i < 16; i++) rounds4(i, &STATE0, &STATE1, W);
+    STATE0 = _mm_add_epi32(STATE0, IV0);
+    STATE1 = _mm_add_epi32(STATE1, IV1);
+  }
+  state_words(STATE0, STATE1, &W[0], &W[1]);
+  _mm_storeu_si128((__m128i *)&state[0], W[0]);
+  _mm_storeu_si128((__m128i *)&state[4], W[1]);
+}
+
+TARGET static void chain_shani_x2(uint32_t a[8], uint32_t b[8], uint64_t steps)
+{
+  const __m128i PAD0 = _mm_set_epi32(0, 0, 0, (int)0x80000000), PAD1 = _mm_set_epi32(256, 0, 0, 0);
+  __m128i IV0, IV1, A0, A1, B0, B1, WA[4], WB[4];
+  load_state(libsha256_IV, &IV0, &IV1);
+  load_state(a, &A0, &A1);
+  load_state(b, &B0, &B1);
+  for (; steps; steps--)
+  {
+    state_words(A0, A1, &WA[0], &WA[1]);
+    state_words(B0, B1, &WB[0], &WB[1]);
+    WA[2] = WB[2] = PAD0, WA[3] = WB[3] = PAD1;
+    A0 = B0 = IV0, A1 = B1 = IV1;
+#pragma GCC unroll 16
+    for (int i = 0; i < 16; i++)
+    {
+      rounds4(i, &A0, &A1, WA);
+      rounds4(i, &B0, &B1, WB);
+    }
+    A0 = _mm_add_epi32(A0, IV0), A1 = _mm_add_epi32(A1, IV1);
+    B0 = _mm_add_epi32(B0, IV0), B1 = _mm_add_epi32(B1, IV1);
+  }
+  state_words(A0, A1, &WA[0], &WA[1]);
+  state_words(B0, B1, &WB[0], &WB[1]);
+  _mm_storeu_si128((__m128i *)&a[0], WA[0]);
+  _mm_storeu_si128((__m128i *)&a[4], WA[1]);
+  _mm_storeu_si128((__m128i *)&b[0], WB[0]);
+  _mm_storeu_si128((__m128i *)&b[4], WB[1]);
+}
+
+static void chain_shani(uint32_t (*states)[8], size_t n, uint64_t steps)
+{
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) chain_shani_x2(states[i], states[i + 1], steps);
+  if (i < n)
+    chain_shani_x1(states[i], steps);
+}
+
+static int supported(void)
+{
+  unsigned a, b, c, d;
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("sse4.1") || !__builtin_cpu_supports("ssse3"))
+    return 0;
+  return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b >> 29 & 1);
+}
+
+static const libsha256_backend shani = {LIBSHA256_BACKEND_ABI, "shani", 50, 1, supported, transform_shani, NULL};
+
+void libsha256_register_shani(void)
+{
+  libsha256_register_builtin(&shani);
+  libsha256_register_chain(&shani, chain_shani);
+}
@@ -0,0 +1,32 @@
+#ifndef LIBSHA256_INTERNAL_H
+#define LIBSHA256_INTERNAL_H
+
+#include <stdint.h>
+
+#include "libsha256.h"
+
+extern const uint32_t libsha256_K[64];
+extern const uint32_t libsha256_IV[8];
+
+// Portable single-stream compression; backends without a faster one use it directly.
+void libsha256_transform_scalar(uint32_t state[8], const uint8_t *blocks, size_t nblocks);
+
+// Registration hooks of the built-in backends, called once by the registry; each hands its descriptors to
+// libsha256_register_builtin(), which skips the locking of the public entry point and is therefore never exported.
+int libsha256_register_builtin(const libsha256_backend *backend);
+void libsha256_register_scalar(void);
+void libsha256_register_avx2(void);
+void libsha256_register_avx512(void);
+void libsha256_register_shani(void);
+
+// Optional kernel behind libsha256_chain() for a built-in backend: advances states[0..n) (n <= 16, digest words in
+// order) by `steps` links each. Backends without one go through their transform with a padded block per step.
+typedef void (*libsha256_chain_fn)(uint32_t (*states)[8], size_t n, uint64_t steps);
+void libsha256_register_chain(const libsha256_backend *backend, libsha256_chain_fn chain);
+
+static inline uint32_t libsha256_load_be32(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+#endif
@@ -0,0 +1,429 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+/*
+  Core: backend registry, streaming context, one-shot and batch hashing.
+
+  Built-in backends are registered from an explicit list rather than from constructors, so they survive being
+  linked out of the static archive. The active backend is a single pointer read with relaxed atomics; switching it
+  is safe while other threads hash, they pick up the new one on their next call.
+
+  While the choice is automatic, batches are ranked separately. SHA-NI is the fastest single stream, but it has one
+  lane, and a 16-lane AVX-512 kernel outruns it by about 1.25x once messages are a few blocks long. It still loses by
+  about 15% on messages of one block or less, and an 8-lane AVX2 kernel only reaches about half the SHA-NI rate. So
+  when the active backend is single-lane and one with at least WIDE_LANES lanes is supported, batches whose messages
+  average WIDE_MIN_BYTES or more go to that wide backend. A backend pinned by name handles batches too.
+*/
+
+#define MAX_BACKENDS 16
+#define MAX_LANES 16
+#define WIDE_LANES 16
+#define WIDE_MIN_BYTES 256
+
+const uint32_t libsha256_K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be,
+  0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa,
+  0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85,
+  0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+  0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+const uint32_t libsha256_IV[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+static const libsha256_backend *backends[MAX_BACKENDS];
+static libsha256_chain_fn chains[MAX_BACKENDS];
+static size_t num_backends;
+static const libsha256_backend *active;
+static const libsha256_backend *wide;  // batch backend for long messages, or NULL
+static int pinned;  // set_backend() or SHA256_BACKEND chose explicitly
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const libsha256_backend *find(const char *name)
+{
+  for (size_t i = 0; i < num_backends; i++)
+    if (!strcmp(backends[i]->name, name))
+      return backends[i];
+  return NULL;
+}
+
+static int usable(const libsha256_backend *b)
+{
+  return !b->supported || b->supported();
+}
+
+// Automatic choice: the highest-priority backend, and the widest one for long batches if the former is single-lane.
+static void rank(void)
+{
+  const libsha256_backend *best = NULL, *widest = NULL;
+  for (size_t i = 0; i < num_backends; i++)
+  {
+    const libsha256_backend *b = backends[i];
+    if (!usable(b))
+      continue;
+    if (!best || b->priority > best->priority)
+      best = b;
+    if (!widest || b->lanes > widest->lanes || (b->lanes == widest->lanes && b->priority > widest->priority))
+      widest = b;
+  }
+  __atomic_store_n(&active, best, __ATOMIC_RELEASE);
+  __atomic_store_n(&wide, best && best->lanes == 1 && widest->lanes >= WIDE_LANES ? widest : NULL, __ATOMIC_RELEASE);
+}
+
+static void pin(const libsha256_backend *b)
+{
+  __atomic_store_n(&active, b, __ATOMIC_RELEASE);
+  __atomic_store_n(&wide, NULL, __ATOMIC_RELEASE);
+  pinned = 1;
+}
+
+static int add(const libsha256_backend *b)
+{
+  if (b->abi != LIBSHA256_BACKEND_ABI || !b->name || !b->transform || b->lanes == 0 || b->lanes > MAX_LANES ||
+      (b->lanes > 1 && !b->transform_lanes))
+    return -1;
+  if (find(b->name) || num_backends == MAX_BACKENDS)
+    return -1;
+  backends[num_backends++] = b;
+  if (!pinned)
+    rank();
+  return 0;
+}
+
+static void init(void)
+{
+  libsha256_register_scalar();
+  libsha256_register_avx2();
+  libsha256_register_avx512();
+  libsha256_register_shani();
+
+  const char *env = getenv("SHA256_BACKEND");
+  if (env && *env && strcmp(env, "auto"))
+  {
+    const libsha256_backend *b = find(env);
+    if (b && usable(b))
+      pin(b);
+  }
+}
+
+static const libsha256_backend *backend(void)
+{
+  pthread_once(&once, init);
+  return __atomic_load_n(&active, __ATOMIC_ACQUIRE);
+}
+
+int libsha256_register_backend(const libsha256_backend *b)
+{
+  pthread_once(&once, init);
+  pthread_mutex_lock(&registry_lock);
+  int r = add(b);
+  pthread_mutex_unlock(&registry_lock);
+  return r;
+}
+
+// Built-in backends register through here while init() runs, before the registry is visible to anyone else.
+int libsha256_register_builtin(const libsha256_backend *b)
+{
+  return add(b);
+}
+
+void libsha256_register_chain(const libsha256_backend *b, libsha256_chain_fn chain)
+{
+  pthread_mutex_lock(&registry_lock);
+  for (size_t i = 0; i < num_backends; i++)
+    if (backends[i] == b)
+      chains[i] = chain;
+  pthread_mutex_unlock(&registry_lock);
+}
+
+static libsha256_chain_fn chain_kernel(const libsha256_backend *b)
+{
+  libsha256_chain_fn chain = NULL;
+  pthread_mutex_lock(&registry_lock);
+  for (size_t i = 0; i < num_backends && !chain; i++)
+    if (backends[i] == b)
+      chain = chains[i];
+  pthread_mutex_unlock(&registry_lock);
+  return chain;
+}
+
+int libsha256_set_backend(const char *name)
+{
+  pthread_once(&once, init);
+  pthread_mutex_lock(&registry_lock);
+  int r = -1;
+  if (!strcmp(name, "auto"))
+  {
+    pinned = 0;
+    rank();
+    r = 0;
+  }
+  else
+  {
+    const libsha256_backend *b = find(name);
+    if (b && usable(b))
+    {
+      pin(b);
+      r = 0;
+    }
+  }
+  pthread_mutex_unlock(&registry_lock);
+  return r;
+}
+
+const char *libsha256_backend_name(void)
+{
+  return backend()->name;
+}
+
+size_t libsha256_backend_lanes(void)
+{
+  return backend()->lanes;
+}
+
+size_t libsha256_batch_lanes(void)
+{
+  const libsha256_backend *b = backend(), *w = __atomic_load_n(&wide, __ATOMIC_ACQUIRE);
+  return w ? w->lanes : b->lanes;
+}
+
+const char *libsha256_backend_at(size_t i)
+{
+  pthread_once(&once, init);
+  pthread_mutex_lock(&registry_lock);
+  const char *name = NULL;
+  for (size_t j = 0; j < num_backends && !name; j++)
+    if (usable(backends[j]))
+    {
+      if (i == 0)
+        name = backends[j]->name;
+      else
+        i--;
+    }
+  pthread_mutex_unlock(&registry_lock);
+  return name;
+}
+
+int libsha256_version(void)
+{
+  return LIBSHA256_VERSION_MAJOR * 100 + LIBSHA256_VERSION_MINOR;
+}
+
+void libsha256_transform(uint32_t state[8], const void *blocks, size_t nblocks)
+{
+  backend()->transform(state, (const uint8_t *)blocks, nblocks);
+}
+
+void libsha256_init(libsha256_ctx *ctx)
+{
+  memcpy(ctx->state, libsha256_IV, sizeof(ctx->state));
+  ctx->length = 0;
+  ctx->buffer_len = 0;
+}
+
+void libsha256_init_from(libsha256_ctx *ctx, const libsha256_midstate *mid)
+{
+  memcpy(ctx->state, mid->state, sizeof(ctx->state));
+  ctx->length = mid->length;
+  ctx->buffer_len = 0;
+}
+
+void libsha256_update(libsha256_ctx *ctx, const void *data, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  const libsha256_backend *b = backend();
+  ctx->length += len;
+  if (ctx->buffer_len)
+  {
+    size_t take = LIBSHA256_BLOCK_SIZE - ctx->buffer_len;
+    if (take > len)
+      take = len;
+    memcpy(ctx->buffer + ctx->buffer_len, p, take);
+    ctx->buffer_len += take;
+    p += take;
+    len -= take;
+    if (ctx->buffer_len < LIBSHA256_BLOCK_SIZE)
+      return;
+    b->transform(ctx->state, ctx->buffer, 1);
+    ctx->buffer_len = 0;
+  }
+  if (len >= LIBSHA256_BLOCK_SIZE)
+  {
+    size_t n = len / LIBSHA256_BLOCK_SIZE;
+    b->transform(ctx->state, p, n);
+    p += n * LIBSHA256_BLOCK_SIZE;
+    len -= n * LIBSHA256_BLOCK_SIZE;
+  }
+  memcpy(ctx->buffer, p, len);
+  ctx->buffer_len = len;
+}
+
+// Writes the padded final block(s) for a message of total_len bytes whose last partial block is tail; returns 1 or 2.
+static size_t pad_tail(uint8_t out[128], const uint8_t *tail, size_t tail_len, uint64_t total_len)
+{
+  size_t blocks = tail_len < 56 ? 1 : 2;
+  memcpy(out, tail, tail_len);
+  out[tail_len] = 0x80;
+  memset(out + tail_len + 1, 0, blocks * 64 - tail_len - 9);
+  uint64_t bits = total_len * 8;
+  for (int i = 0; i < 8; i++)
+    out[blocks * 64 - 1 - i] = (uint8_t)(bits >> (8 * i));
+  return blocks;
+}
+
+static void store_digest(const uint32_t state[8], uint8_t digest[32])
+{
+  for (int i = 0; i < 8; i++)
+  {
+    digest[4 * i] = (uint8_t)(state[i] >> 24);
+    digest[4 * i + 1] = (uint8_t)(state[i] >> 16);
+    digest[4 * i + 2] = (uint8_t)(state[i] >> 8);
+    digest[4 * i + 3] = (uint8_t)state[i];
+  }
+}
+
+void libsha256_final(libsha256_ctx *ctx, uint8_t digest[LIBSHA256_DIGEST_SIZE])
+{
+  uint8_t last[128];
+  size_t blocks = pad_tail(last, ctx->buffer, ctx->buffer_len, ctx->length);
+  backend()->transform(ctx->state, last, blocks);
+  store_digest(ctx->state, digest);
+  libsha256_init(ctx);
+}
+
+void libsha256(const void *data, size_t len, uint8_t digest[LIBSHA256_DIGEST_SIZE])
+{
+  const uint8_t *p = (const uint8_t *)data;
+  const libsha256_backend *b = backend();
+  uint32_t state[8];
+  uint8_t last[128];
+  size_t full = len / LIBSHA256_BLOCK_SIZE;
+
+  memcpy(state, libsha256_IV, sizeof(state));
+  if (full)
+    b->transform(state, p, full);
+  size_t blocks = pad_tail(last, p + full * LIBSHA256_BLOCK_SIZE, len % LIBSHA256_BLOCK_SIZE, len);
+  b->transform(state, last, blocks);
+  store_digest(state, digest);
+}
+
+void libsha256_batch(const void *const *msgs, const size_t *lens, size_t n, uint8_t (*digests)[LIBSHA256_DIGEST_SIZE])
+{
+  libsha256_batch_from(NULL, msgs, lens, n, digests);
+}
+
+void libsha256_batch_from(const libsha256_midstate *const *starts, const void *const *msgs, const size_t *lens, size_t n,
+                          uint8_t (*digests)[LIBSHA256_DIGEST_SIZE])
+{
+  const libsha256_backend *b = backend(), *w = __atomic_load_n(&wide, __ATOMIC_ACQUIRE);
+  if (w && n > 1)
+  {
+    size_t bytes = 0;
+    for (size_t i = 0; i < n; i++) bytes += lens[i];
+    if (bytes >= n * WIDE_MIN_BYTES)
+      b = w;
+  }
+  if (b->lanes == 1)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      if (starts && starts[i])
+      {
+        libsha256_ctx ctx;
+        libsha256_init_from(&ctx, starts[i]);
+        libsha256_update(&ctx, msgs[i], lens[i]);
+        libsha256_final(&ctx, digests[i]);
+      }
+      else
+        libsha256(msgs[i], lens[i], digests[i]);
+    }
+    return;
+  }
+
+  // Full blocks of every lane in one pass, then the 1-2 padded tail blocks in a second, so short messages stay
+  // vectorised too. Lanes past the end of the batch get zero blocks and are ignored.
+  uint32_t states[MAX_LANES][8];
+  uint8_t tails[MAX_LANES][128];
+  const uint8_t *data[MAX_LANES];
+  size_t nblocks[MAX_LANES];
+  uint64_t prefix[MAX_LANES];
+  for (size_t base = 0; base < n; base += b->lanes)
+  {
+    size_t count = n - base < b->lanes ? n - base : b->lanes;
+    for (size_t i = 0; i < b->lanes; i++)
+    {
+      const libsha256_midstate *start = i < count && starts ? starts[base + i] : NULL;
+      memcpy(states[i], start ? start->state : libsha256_IV, sizeof(states[i]));
+      prefix[i] = start ? start->length : 0;
+      data[i] = i < count ? (const uint8_t *)msgs[base + i] : tails[0];
+      nblocks[i] = i < count ? lens[base + i] / LIBSHA256_BLOCK_SIZE : 0;
+    }
+    b->transform_lanes(states, data, nblocks);
+
+    for (size_t i = 0; i < b->lanes; i++)
+    {
+      if (i < count)
+      {
+        size_t len = lens[base + i];
+        nblocks[i] = pad_tail(tails[i], data[i] + len / LIBSHA256_BLOCK_SIZE * LIBSHA256_BLOCK_SIZE, len % LIBSHA256_BLOCK_SIZE,
+                              prefix[i] + len);
+      }
+      data[i] = tails[i];
+    }
+    b->transform_lanes(states, data, nblocks);
+
+    for (size_t i = 0; i < count; i++)
+      store_digest(states[i], digests[base + i]);
+  }
+}
+
+// Generic chain steps: each lane's block is its digest followed by the fixed padding of a 32-byte message.
+static void chain_blocks(const libsha256_backend *b, uint32_t (*states)[8], size_t count, uint64_t steps)
+{
+  uint8_t blocks[MAX_LANES][LIBSHA256_BLOCK_SIZE];
+  const uint8_t *data[MAX_LANES];
+  size_t nblocks[MAX_LANES];
+  for (size_t i = 0; i < b->lanes; i++)
+  {
+    memset(blocks[i], 0, sizeof(blocks[i]));
+    blocks[i][32] = 0x80;
+    blocks[i][62] = 0x01;  // 256 bits
+    data[i] = blocks[i];
+    nblocks[i] = i < count;
+  }
+  for (; steps; steps--)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      store_digest(states[i], blocks[i]);
+      memcpy(states[i], libsha256_IV, sizeof(states[i]));
+    }
+    if (count == 1)
+      b->transform(states[0], blocks[0], 1);  // a lone chain gains nothing from the lane kernel
+    else
+      b->transform_lanes(states, data, nblocks);
+  }
+}
+
+void libsha256_chain(uint8_t (*digests)[LIBSHA256_DIGEST_SIZE], size_t n, uint64_t steps)
+{
+  const libsha256_backend *b = backend();
+  libsha256_chain_fn kernel = chain_kernel(b);
+  size_t group = kernel ? MAX_LANES : b->lanes;
+  uint32_t states[MAX_LANES][8];
+  for (size_t base = 0; base < n; base += group)
+  {
+    size_t count = n - base < group ? n - base : group;
+    for (size_t i = 0; i < count; i++)
+      for (int j = 0; j < 8; j++) states[i][j] = libsha256_load_be32(digests[base + i] + 4 * j);
+    if (kernel)
+      kernel(states, count, steps);
+    else
+      chain_blocks(b, states, count, steps);
+    for (size_t i = 0; i < count; i++)
+      store_digest(states[i], digests[base + i]);
+  }
+}
@@ -0,0 +1,255 @@
+#ifndef SHA256_ASYNC_H
+#define SHA256_ASYNC_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+
+/*
+  Awaitable hashing for coroutine code (C++20).
+
+    std::array<uint8_t, 32> digest = co_await async_hash(bytes);
+
+  The coroutine suspends and its request goes to a HashExecutor. Short messages queue for a batcher thread, which
+  hashes them through libsha256_batch() as wide as the active backend. A partial batch waits at most max_wait_us for
+  more requests. Messages of stream_min bytes or more go to a pool of streaming workers instead, so they do not hold
+  a batch back. The coroutine is resumed on the executor thread that hashed it, so anything it does next until its
+  following co_await runs there too.
+
+  Backpressure: at most max_pending requests are queued for hashing. Further submitters stay suspended in a held list
+  (counted as throttled) and are admitted in order as queued requests complete. The caller's buffer must stay valid
+  until the co_await returns.
+*/
+
+struct AsyncHashOptions
+{
+  unsigned max_wait_us = 50;
+  size_t max_pending = 4096;
+  size_t stream_min = 4096;
+  unsigned stream_workers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+};
+
+class HashExecutor
+{
+  using Clock = std::chrono::steady_clock;
+
+  struct Request
+  {
+    const uint8_t *data;
+    size_t len;
+    uint8_t *digest;
+    std::coroutine_handle<> handle;
+    Clock::time_point arrival;
+  };
+
+public:
+  struct Stats
+  {
+    uint64_t batches = 0;
+    uint64_t batched = 0;   // messages hashed in batches
+    uint64_t streamed = 0;  // messages hashed by streaming workers
+    uint64_t timeouts = 0;  // partial batches flushed by max_wait_us
+    uint64_t throttled = 0; // submissions held back by max_pending
+  };
+
+  class Awaitable
+  {
+  public:
+    Awaitable(HashExecutor &ex, std::span<const uint8_t> data) : ex(ex), data(data) {}
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) { ex.submit({data.data(), data.size(), digest.data(), h, Clock::now()}); }
+    std::array<uint8_t, 32> await_resume() const noexcept { return digest; }
+
+  private:
+    HashExecutor &ex;
+    std::span<const uint8_t> data;
+    std::array<uint8_t, 32> digest;
+  };
+
+  explicit HashExecutor(AsyncHashOptions opt = {}) : opt(opt)
+  {
+    batcher = std::thread([this]() { batch_loop(); });
+    for (unsigned i = 0; i < std::max(1u, opt.stream_workers); i++) streamers.emplace_back([this]() { stream_loop(); });
+  }
+
+  // Finishes every request already submitted, including held ones, before returning.
+  ~HashExecutor()
+  {
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      stopping = true;
+    }
+    batch_cv.notify_all();
+    stream_cv.notify_all();
+    batcher.join();
+    for (auto &t : streamers) t.join();
+  }
+
+  HashExecutor(const HashExecutor &) = delete;
+  HashExecutor &operator=(const HashExecutor &) = delete;
+
+  static HashExecutor &shared()
+  {
+    static HashExecutor ex;
+    return ex;
+  }
+
+  Awaitable hash(std::span<const uint8_t> data) { return Awaitable(*this, data); }
+
+  Stats stats() const
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    return counters;
+  }
+
+  size_t batch_width() const { return std::min<size_t>(16, std::max<size_t>(8, libsha256_batch_lanes())); }
+
+private:
+  void submit(const Request &r)
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    if (queued >= opt.max_pending || !held.empty())
+    {
+      held.push_back(r);
+      counters.throttled++;
+      return;
+    }
+    enqueue(r);
+  }
+
+  // Called with mu held. The batcher is only woken when it has a timer to start or a full batch to hash.
+  void enqueue(const Request &r)
+  {
+    queued++;
+    if (r.len >= opt.stream_min)
+    {
+      longs.push_back(r);
+      stream_cv.notify_one();
+      return;
+    }
+    shorts.push_back(r);
+    if (shorts.size() == 1 || shorts.size() == batch_width())
+      batch_cv.notify_one();
+  }
+
+  // Called with mu held once n queued requests have been hashed.
+  void release(size_t n)
+  {
+    queued -= n;
+    while (!held.empty() && queued < opt.max_pending)
+    {
+      Request r = held.front();
+      held.pop_front();
+      r.arrival = Clock::now();
+      enqueue(r);
+    }
+  }
+
+  bool drained() const { return shorts.empty() && longs.empty() && held.empty(); }
+
+  void batch_loop()
+  {
+    const void *msgs[16];
+    size_t lens[16];
+    uint8_t digests[16][32];
+    Request taken[16];
+    std::unique_lock<std::mutex> lk(mu);
+    while (true)
+    {
+      if (shorts.empty())
+      {
+        if (stopping && drained())
+          return;
+        batch_cv.wait_for(lk, std::chrono::milliseconds(stopping ? 1 : 100));
+        continue;
+      }
+      size_t width = batch_width();
+      if (shorts.size() < width && !stopping)
+      {
+        auto deadline = shorts.front().arrival + std::chrono::microseconds(opt.max_wait_us);
+        if (Clock::now() < deadline)
+        {
+          batch_cv.wait_until(lk, deadline);
+          continue;
+        }
+        counters.timeouts++;
+      }
+
+      size_t n = std::min(width, shorts.size());
+      for (size_t i = 0; i < n; i++)
+      {
+        taken[i] = shorts.front();
+        shorts.pop_front();
+        msgs[i] = taken[i].data;
+        lens[i] = taken[i].len;
+      }
+      counters.batches++;
+      counters.batched += n;
+      lk.unlock();
+
+      libsha256_batch(msgs, lens, n, digests);
+      for (size_t i = 0; i < n; i++) memcpy(taken[i].digest, digests[i], 32);
+      lk.lock();
+      release(n);
+      lk.unlock();
+      // Resumed coroutines may submit again straight away; those requests join the next batch.
+      for (size_t i = 0; i < n; i++) taken[i].handle.resume();
+      lk.lock();
+    }
+  }
+
+  void stream_loop()
+  {
+    std::unique_lock<std::mutex> lk(mu);
+    while (true)
+    {
+      if (longs.empty())
+      {
+        if (stopping && drained())
+          return;
+        stream_cv.wait_for(lk, std::chrono::milliseconds(stopping ? 1 : 100));
+        continue;
+      }
+      Request r = longs.front();
+      longs.pop_front();
+      counters.streamed++;
+      lk.unlock();
+
+      libsha256(r.data, r.len, r.digest);
+      lk.lock();
+      release(1);
+      lk.unlock();
+      r.handle.resume();
+      lk.lock();
+    }
+  }
+
+  AsyncHashOptions opt;
+  mutable std::mutex mu;
+  std::condition_variable batch_cv, stream_cv;
+  std::deque<Request> shorts, longs, held;
+  size_t queued = 0;
+  bool stopping = false;
+  Stats counters;
+  std::thread batcher;
+  std::vector<std::thread> streamers;
+};
+
+inline HashExecutor::Awaitable async_hash(std::span<const uint8_t> data, HashExecutor &ex = HashExecutor::shared())
+{
+  return ex.hash(data);
+}
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef SHA256_CHAIN_H
+#define SHA256_CHAIN_H
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+
+/*
+  SHA-256 hash chains with checkpoints, for timestamping and audit trails.
+
+  A chain of length L starts at h_0 and links h_{i+1} = SHA-256(h_i). generate() walks it on one core, which is
+  pure latency: every step waits on the one before. It records h_0, every interval-th link and h_L, and each link
+  costs one compression via libsha256_chain(), which keeps the state in registers on the shani backend.
+
+  The checkpoints split the chain into independent segments, so verify() recomputes all of them at once: each
+  thread takes a share of the segments and libsha256_chain() advances them side by side across SIMD lanes (or two
+  interleaved SHA-NI streams), then every segment's end is compared with the next checkpoint.
+
+  Saved chains are text: a "sha256-chain 1 LENGTH INTERVAL" line, then one hex checkpoint per line.
+*/
+
+class HashChain
+{
+public:
+  using Digest = std::array<uint8_t, LIBSHA256_DIGEST_SIZE>;
+
+  uint64_t length = 0;
+  uint64_t interval = 0;
+  std::vector<Digest> checkpoints;  // h_0, h_interval, h_2*interval, ..., then h_length if it is not one already
+
+  // verify() results other than a segment index.
+  static constexpr int64_t LINKED = -1;
+  static constexpr int64_t MALFORMED = -2;  // the checkpoint count does not match length and interval
+
+  static HashChain generate(const Digest &start, uint64_t length, uint64_t interval)
+  {
+    HashChain chain;
+    chain.length = length;
+    chain.interval = std::max<uint64_t>(1, interval);
+    chain.checkpoints.push_back(start);
+    Digest h = start;
+    for (uint64_t done = 0; done < length;)
+    {
+      uint64_t steps = std::min(chain.interval, length - done);
+      libsha256_chain(reinterpret_cast<uint8_t(*)[LIBSHA256_DIGEST_SIZE]>(h.data()), 1, steps);
+      chain.checkpoints.push_back(h);
+      done += steps;
+    }
+    return chain;
+  }
+
+  const Digest &head() const { return checkpoints.back(); }
+
+  size_t segments() const { return checkpoints.empty() ? 0 : checkpoints.size() - 1; }
+
+  uint64_t segment_steps(size_t k) const { return std::min(interval, length - k * interval); }
+
+  // Index of the first segment whose end does not match the next checkpoint, LINKED if the whole chain links up, or
+  // MALFORMED.
+  int64_t verify(unsigned threads) const
+  {
+    if (!interval || checkpoints.size() != expected_checkpoints())
+      return MALFORMED;
+    size_t n = segments(), full = length / interval;  // segment n - 1 may be short
+    std::vector<Digest> ends(checkpoints.begin(), checkpoints.begin() + n);
+
+    threads = std::max(1u, std::min<unsigned>(threads, std::max<size_t>(1, full / 16)));
+    size_t per = (full + threads - 1) / threads;
+    std::vector<std::thread> pool;
+    for (size_t start = 0; start < full; start += per)
+    {
+      size_t count = std::min(per, full - start);
+      auto run = [this, &ends, start, count]()
+      { libsha256_chain(reinterpret_cast<uint8_t(*)[LIBSHA256_DIGEST_SIZE]>(ends[start].data()), count, interval); };
+      if (start + per >= full)
+        run();  // the last share runs on the calling thread
+      else
+        pool.emplace_back(run);
+    }
+    if (full < n)
+      libsha256_chain(reinterpret_cast<uint8_t(*)[LIBSHA256_DIGEST_SIZE]>(ends[full].data()), 1, segment_steps(full));
+    for (auto &t : pool) t.join();
+
+    for (size_t k = 0; k < n; k++)
+      if (ends[k] != checkpoints[k + 1])
+        return k;
+    return LINKED;
+  }
+
+  bool save(const std::string &path) const
+  {
+    FILE *f = path == "-" ? stdout : fopen(path.c_str(), "w");
+    if (!f)
+      return false;
+    fprintf(f, "sha256-chain 1 %" PRIu64 " %" PRIu64 "\n", length, interval);
+    for (const Digest &d : checkpoints)
+    {
+      for (uint8_t b : d) fprintf(f, "%02x", b);
+      fputc('\n', f);
+    }
+    bool ok = !ferror(f);
+    return (f == stdout ? fflush(f) == 0 : fclose(f) == 0) && ok;
+  }
+
+  // Reads a saved chain; false if the file is missing or malformed. Whether it links up is verify()'s business.
+  bool load(const std::string &path)
+  {
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f)
+      return false;
+    int version = 0;
+    bool ok = fscanf(f, "sha256-chain %d %" SCNu64 " %" SCNu64, &version, &length, &interval) == 3 && version == 1 && interval;
+    checkpoints.clear();
+    char hex[65];
+    while (ok && fscanf(f, "%64s", hex) == 1)
+    {
+      Digest d;
+      for (int i = 0; i < 32 && ok; i++)
+      {
+        unsigned v;
+        ok = strspn(hex, "0123456789abcdefABCDEF") == 64 && sscanf(hex + 2 * i, "%2x", &v) == 1;
+        d[i] = v;
+      }
+      checkpoints.push_back(d);
+    }
+    fclose(f);
+    return ok && checkpoints.size() == expected_checkpoints();
+  }
+
+private:
+  size_t expected_checkpoints() const { return 1 + length / interval + (length % interval != 0); }
+};
+
+#endif
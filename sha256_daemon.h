@@ -0,0 +1,221 @@
+#ifndef SHA256_DAEMON_H
+#define SHA256_DAEMON_H
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+/*
+  Client side of the local hashing daemon (SHA256_daemon.cpp).
+
+  A client creates a memfd holding a DaemonRing, seals its size, passes the descriptor to the daemon over a UNIX
+  socket once (SCM_RIGHTS), and from then on exchanges only doorbell bytes with it. Requests live in the ring's slots: the client
+  writes the message and its length, marks the slot SUBMITTED and rings the doorbell; the daemon adds the slot to its
+  next batch, writes the digest back into the slot and marks it DONE. A client that has nothing else to do sleeps on
+  the slot's state word with a shared futex, and the daemon only wakes slots whose owner is actually asleep.
+
+  Slot states: FREE -> SUBMITTED (client) -> [WAITING (client, about to sleep)] -> DONE (daemon) -> FREE (client).
+
+  The daemon never writes to the socket, so a client asleep on a slot wakes every WAIT_CHECK_MS and polls it: a hangup
+  or end of file means the daemon exited (or was restarted and no longer knows the ring), and wait() gives up.
+*/
+
+static const uint32_t RING_MAGIC = 0x53484431;  // "SHD1"
+static const uint32_t RING_SLOTS = 64;
+static const uint32_t SLOT_MSG_MAX = 960;
+static const int WAIT_CHECK_MS = 100;
+
+enum SlotState : uint32_t
+{
+  SLOT_FREE,
+  SLOT_SUBMITTED,
+  SLOT_WAITING,
+  SLOT_DONE,
+};
+
+struct alignas(64) DaemonSlot
+{
+  std::atomic<uint32_t> state;
+  uint32_t len;
+  uint8_t digest[32];
+  uint8_t data[SLOT_MSG_MAX];
+};
+
+struct DaemonRing
+{
+  uint32_t magic;
+  uint32_t slots;
+  alignas(64) DaemonSlot slot[RING_SLOTS];
+};
+
+inline std::string daemon_socket_path()
+{
+  if (const char *path = getenv("SHA256_DAEMON_SOCKET"))
+    return path;
+  const char *dir = getenv("XDG_RUNTIME_DIR");
+  return std::string(dir ? dir : "/tmp") + "/sha256d.sock";
+}
+
+// Sleeps while *word == expected, for at most timeout_ms if it is positive.
+inline void futex_wait(std::atomic<uint32_t> *word, uint32_t expected, int timeout_ms = 0)
+{
+  timespec ts = {timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000};
+  syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, expected, timeout_ms > 0 ? &ts : nullptr, nullptr, 0);
+}
+
+inline void futex_wake(std::atomic<uint32_t> *word)
+{
+  syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+inline int unix_socket(const std::string &path, sockaddr_un &addr)
+{
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path))
+    return -1;
+  memcpy(addr.sun_path, path.c_str(), path.size());
+  return socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+}
+
+class HashClient
+{
+public:
+  HashClient() = default;
+  HashClient(const HashClient &) = delete;
+  HashClient &operator=(const HashClient &) = delete;
+  ~HashClient() { close_all(); }
+
+  bool connect(const std::string &path = daemon_socket_path())
+  {
+    sockaddr_un addr;
+    fd = unix_socket(path, addr);
+    if (fd < 0 || ::connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+      return close_all(), false;
+
+    // Sealed against resizing, so the daemon can map it without a later ftruncate() turning its accesses into SIGBUS.
+    int mem = memfd_create("sha256-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (mem < 0 || ftruncate(mem, sizeof(DaemonRing)) != 0 || fcntl(mem, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0)
+    {
+      if (mem >= 0)
+        close(mem);
+      return close_all(), false;
+    }
+    void *p = mmap(nullptr, sizeof(DaemonRing), PROT_READ | PROT_WRITE, MAP_SHARED, mem, 0);
+    if (p == MAP_FAILED)
+    {
+      close(mem);
+      return close_all(), false;
+    }
+    ring = (DaemonRing *)p;
+    ring->magic = RING_MAGIC;
+    ring->slots = RING_SLOTS;
+
+    // The ring descriptor rides along with the first byte; nothing but doorbells follows.
+    char byte = 'R';
+    iovec iov = {&byte, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cm), &mem, sizeof(int));
+    bool sent = sendmsg(fd, &msg, MSG_NOSIGNAL) == 1;
+    close(mem);
+    if (!sent)
+      return close_all(), false;
+    return true;
+  }
+
+  // Queues a message in the next slot; returns the slot, or -1 if it is still in use or the message is too long.
+  int submit(const void *data, size_t len)
+  {
+    uint32_t s = next % RING_SLOTS;
+    DaemonSlot &slot = ring->slot[s];
+    if (len > SLOT_MSG_MAX || slot.state.load(std::memory_order_acquire) != SLOT_FREE)
+      return -1;
+    memcpy(slot.data, data, len);
+    slot.len = len;
+    slot.state.store(SLOT_SUBMITTED, std::memory_order_release);
+    next++;
+    return s;
+  }
+
+  // Tells the daemon that slots were submitted since the last doorbell.
+  bool doorbell()
+  {
+    char byte = 'D';
+    return send(fd, &byte, 1, MSG_NOSIGNAL) == 1;
+  }
+
+  // Blocks until slot s is done, copies its digest out and frees the slot. Returns false, and closes the connection,
+  // if the daemon goes away first.
+  bool wait(int s, uint8_t digest[32], int spins = 2000)
+  {
+    if (!ring || s < 0)
+      return false;
+    DaemonSlot &slot = ring->slot[s];
+    for (int i = 0; i < spins && slot.state.load(std::memory_order_acquire) != SLOT_DONE; i++) __builtin_ia32_pause();
+    uint32_t expected = SLOT_SUBMITTED;
+    if (slot.state.compare_exchange_strong(expected, SLOT_WAITING, std::memory_order_acq_rel))
+      expected = SLOT_WAITING;
+    while (expected == SLOT_WAITING)
+    {
+      futex_wait(&slot.state, SLOT_WAITING, WAIT_CHECK_MS);
+      expected = slot.state.load(std::memory_order_acquire);
+      if (expected == SLOT_WAITING && !daemon_alive())
+        return close_all(), false;
+    }
+    memcpy(digest, slot.digest, 32);
+    slot.state.store(SLOT_FREE, std::memory_order_release);
+    return true;
+  }
+
+  bool hash(const void *data, size_t len, uint8_t digest[32])
+  {
+    int s = submit(data, len);
+    if (s < 0 || !doorbell())
+      return false;
+    return wait(s, digest);
+  }
+
+private:
+  bool daemon_alive()
+  {
+    pollfd p = {fd, POLLIN | POLLRDHUP, 0};
+    return poll(&p, 1, 0) == 0;
+  }
+
+  void close_all()
+  {
+    if (ring)
+      munmap(ring, sizeof(DaemonRing));
+    if (fd >= 0)
+      close(fd);
+    ring = nullptr;
+    fd = -1;
+  }
+
+  int fd = -1;
+  DaemonRing *ring = nullptr;
+  uint32_t next = 0;
+};
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef SHA256_DELTA_H
+#define SHA256_DELTA_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "libsha256.h"
+
+/*
+  rsync-style block signatures and deltas, with SHA-256 as the strong hash.
+
+  A signature splits the old file into fixed-size blocks and keeps, for each full block, a 32-bit rolling checksum
+  and its SHA-256. The blocks are hashed a backend's worth of lanes per libsha256_batch() call, straight from the
+  input, with no per-block context or allocation.
+
+  A delta scans the new file with the rolling checksum. Most offsets are rejected by a bitmap of the weak checksums;
+  the rest look up the index and become candidates. Candidates are not strong-hashed one at a time: the scan assumes
+  each one matches, jumps past its block as a confirmed match would, and keeps going until it has a batch of them,
+  which it hashes in one call. Weak hits between similar files are nearly always real, so the assumption usually
+  holds and the ops are exactly those of a one-candidate-at-a-time scan. When a candidate fails, the candidates after
+  it are dropped and the scan resumes one byte past it, which is again what the sequential scan would have done.
+
+  A trailing partial block of the old file is not indexed, so it always travels as a literal.
+*/
+
+// rsync's weak checksum: two 16-bit sums, rolled one byte at a time.
+struct RollingChecksum
+{
+  uint32_t a = 0, b = 0;
+  size_t n = 0;
+
+  void init(const uint8_t *p, size_t len)
+  {
+    a = b = 0;
+    n = len;
+    for (size_t i = 0; i < len; i++)
+    {
+      a += p[i];
+      b += a;
+    }
+  }
+
+  void roll(uint8_t out, uint8_t in)
+  {
+    a += in - out;
+    b += a - (uint32_t)n * out;
+  }
+
+  uint32_t value() const { return (a & 0xffff) | (b << 16); }
+};
+
+struct BlockSignature
+{
+  size_t block = 0;
+  uint64_t file_size = 0;
+  std::vector<uint32_t> weak;  // one per full block
+  std::vector<uint8_t> strong; // 32 bytes per full block
+
+  size_t blocks() const { return weak.size(); }
+  const uint8_t *digest(size_t i) const { return &strong[i * LIBSHA256_DIGEST_SIZE]; }
+};
+
+struct DeltaOp
+{
+  enum Kind : uint8_t
+  {
+    COPY,    // offset is in the old file
+    LITERAL  // offset is in the new file
+  };
+  Kind kind;
+  uint64_t offset;
+  uint64_t length;
+};
+
+struct DeltaStats
+{
+  uint64_t weak_hits = 0;     // offsets whose checksum was in the index
+  uint64_t strong_hashes = 0; // candidate blocks hashed
+  uint64_t false_hits = 0;    // hashed candidates that matched no block
+  uint64_t wasted = 0;        // hashed candidates discarded after an earlier false hit
+  uint64_t batches = 0;
+  uint64_t copied = 0;
+  uint64_t literal = 0;
+};
+
+inline size_t delta_batch_width()
+{
+  return std::max<size_t>(8, libsha256_batch_lanes());
+}
+
+inline BlockSignature make_signature(const uint8_t *data, size_t len, size_t block, size_t width = delta_batch_width())
+{
+  BlockSignature sig;
+  sig.block = block ? block : 1;
+  sig.file_size = len;
+  size_t n = len / sig.block;
+  sig.weak.resize(n);
+  sig.strong.resize(n * LIBSHA256_DIGEST_SIZE);
+
+  std::vector<const void *> msgs(width);
+  std::vector<size_t> lens(width, sig.block);
+  for (size_t i = 0; i < n; i += width)
+  {
+    size_t k = std::min(width, n - i);
+    for (size_t j = 0; j < k; j++)
+    {
+      const uint8_t *p = data + (i + j) * sig.block;
+      RollingChecksum r;
+      r.init(p, sig.block);
+      sig.weak[i + j] = r.value();
+      msgs[j] = p;
+    }
+    libsha256_batch(msgs.data(), lens.data(), k, reinterpret_cast<uint8_t(*)[32]>(&sig.strong[i * LIBSHA256_DIGEST_SIZE]));
+  }
+  return sig;
+}
+
+class BlockIndex
+{
+public:
+  explicit BlockIndex(const BlockSignature &sig) : sig(sig), filter(FILTER_BITS / 64)
+  {
+    for (size_t i = 0; i < sig.blocks(); i++)
+    {
+      uint32_t w = sig.weak[i];
+      filter[bucket(w) / 64] |= 1ULL << (bucket(w) % 64);
+      blocks[w].push_back((uint32_t)i);
+    }
+  }
+
+  const std::vector<uint32_t> *find(uint32_t weak) const
+  {
+    if (!(filter[bucket(weak) / 64] >> (bucket(weak) % 64) & 1))
+      return nullptr;
+    auto it = blocks.find(weak);
+    return it == blocks.end() ? nullptr : &it->second;
+  }
+
+  const BlockSignature &sig;
+
+private:
+  static constexpr uint32_t FILTER_BITS = 1u << 20;
+
+  static uint32_t bucket(uint32_t weak) { return (weak * 0x9e3779b1u) >> 12; }
+
+  std::vector<uint64_t> filter;
+  std::unordered_map<uint32_t, std::vector<uint32_t>> blocks;
+};
+
+class DeltaBuilder
+{
+public:
+  DeltaBuilder(const BlockIndex &index, const uint8_t *data, size_t len, size_t width)
+      : index(index), data(data), len(len), block(index.sig.block), width(std::max<size_t>(1, width))
+  {
+  }
+
+  std::vector<DeltaOp> run(DeltaStats &stats)
+  {
+    std::vector<DeltaOp> ops;
+    out = &ops;
+    st = &stats;
+    emitted = 0;
+    if (len >= block && index.sig.blocks())
+      scan();
+    literal(len);
+    return ops;
+  }
+
+private:
+  static constexpr size_t NPOS = ~(size_t)0;
+
+  struct Candidate
+  {
+    size_t pos;
+    const std::vector<uint32_t> *blocks;
+  };
+
+  void scan()
+  {
+    size_t pos = 0;
+    RollingChecksum r;
+    r.init(data, block);
+    for (;;)
+    {
+      const std::vector<uint32_t> *hit = index.find(r.value());
+      if (hit)
+      {
+        // Assume the candidate matches and look for the next one right after its block.
+        st->weak_hits++;
+        pending.push_back({pos, hit});
+        pos += block;
+      }
+      bool end = hit ? pos + block > len : pos + block >= len;
+      size_t resume = NPOS;
+      if (!pending.empty() && (pending.size() == width || end))
+        resume = resolve();
+      if (resume != NPOS)
+        pos = resume;  // a candidate failed, so everything scanned after it assumed a match that was not there
+      else if (end)
+        return;
+      else if (!hit)
+      {
+        r.roll(data[pos], data[pos + block]);
+        pos++;
+        continue;
+      }
+      if (pos + block > len)
+        return;
+      r.init(data + pos, block);
+    }
+  }
+
+  // Strong-hashes the pending candidates and emits ops for them in order. Returns NPOS if every one matched, or the
+  // offset after the first that did not, where the scan has to resume.
+  size_t resolve()
+  {
+    size_t k = pending.size();
+    msgs.resize(k);
+    lens.assign(k, block);
+    digests.resize(k * LIBSHA256_DIGEST_SIZE);
+    for (size_t i = 0; i < k; i++) msgs[i] = data + pending[i].pos;
+    libsha256_batch(msgs.data(), lens.data(), k, reinterpret_cast<uint8_t(*)[32]>(digests.data()));
+    st->strong_hashes += k;
+    st->batches++;
+
+    size_t resume = NPOS;
+    for (size_t i = 0; i < k; i++)
+    {
+      const Candidate &c = pending[i];
+      long m = match(c, &digests[i * LIBSHA256_DIGEST_SIZE]);
+      if (m < 0)
+      {
+        st->false_hits++;
+        st->wasted += k - i - 1;
+        resume = c.pos + 1;
+        break;
+      }
+      literal(c.pos);
+      copy((uint64_t)m * block);
+    }
+    pending.clear();
+    return resume;
+  }
+
+  // Block whose strong hash matches, preferring the one after the last copy so that runs merge into one op.
+  long match(const Candidate &c, const uint8_t *digest) const
+  {
+    long found = -1;
+    for (uint32_t b : *c.blocks)
+      if (!memcmp(index.sig.digest(b), digest, LIBSHA256_DIGEST_SIZE))
+      {
+        if (!out->empty() && out->back().kind == DeltaOp::COPY && out->back().offset + out->back().length == (uint64_t)b * block)
+          return b;
+        if (found < 0)
+          found = b;
+      }
+    return found;
+  }
+
+  void literal(size_t end)
+  {
+    if (end > emitted)
+    {
+      out->push_back({DeltaOp::LITERAL, emitted, end - emitted});
+      st->literal += end - emitted;
+    }
+    emitted = end;
+  }
+
+  void copy(uint64_t offset)
+  {
+    emitted += block;
+    st->copied += block;
+    if (!out->empty() && out->back().kind == DeltaOp::COPY && out->back().offset + out->back().length == offset)
+      out->back().length += block;
+    else
+      out->push_back({DeltaOp::COPY, offset, block});
+  }
+
+  const BlockIndex &index;
+  const uint8_t *data;
+  size_t len, block, width;
+
+  std::vector<DeltaOp> *out = nullptr;
+  DeltaStats *st = nullptr;
+  size_t emitted = 0;  // new-file bytes covered by ops so far
+  std::vector<Candidate> pending;
+  std::vector<const void *> msgs;
+  std::vector<size_t> lens;
+  std::vector<uint8_t> digests;
+};
+
+inline std::vector<DeltaOp> make_delta(const BlockIndex &index, const uint8_t *data, size_t len, DeltaStats &stats,
+                                         size_t width = delta_batch_width())
+{
+  return DeltaBuilder(index, data, len, width).run(stats);
+}
+
+// Rebuilds the new file from the old one and the delta; literal ops read from `literals`, the new file's bytes.
+inline std::vector<uint8_t> apply_delta(const uint8_t *old_data, const uint8_t *literals, const std::vector<DeltaOp> &ops)
+{
+  std::vector<uint8_t> out;
+  for (const DeltaOp &op : ops)
+  {
+    const uint8_t *src = (op.kind == DeltaOp::COPY ? old_data : literals) + op.offset;
+    out.insert(out.end(), src, src + op.length);
+  }
+  return out;
+}
+
+#endif
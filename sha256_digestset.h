@@ -0,0 +1,291 @@
+#ifndef SHA256_DIGESTSET_H
+#define SHA256_DIGESTSET_H
+
+#include <fcntl.h>
+#include <immintrin.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+  Immutable set of SHA-256 digests in one file, used straight from a read-only mapping.
+
+  Layout (little-endian, every section 64-byte aligned):
+
+    "S256SET1"              8-byte magic
+    u64 count               distinct digests
+    u32 bucket_bits         buckets = 2^bucket_bits, by the digest's leading bits
+    u32 reserved            0
+    u64 bloom_blocks        32-byte Bloom blocks
+    u64 bloom_offset, index_offset, digests_offset
+    ...                     padding to 64 bytes
+    bloom[bloom_blocks]     split-block Bloom filter, 8 x u32 words per block
+    index[buckets + 1]      u64: first digest of each bucket, then count
+    digests[count]          32 bytes each, sorted bytewise
+
+  Digests are uniformly random, so their own bits serve as the hash functions: bytes 0-7 pick the bucket, bytes 8-15
+  the Bloom block and bytes 16-19 the bit set in each of the block's eight words (the Parquet/Impala split-block
+  scheme, one cache line or less per probe). A miss is usually rejected by the Bloom block alone; anything that passes
+  looks up its bucket, about four digests, and compares them 32 bytes at a time with AVX2 where the CPU has it.
+
+  Opening a set is an mmap() plus a header check, so a file of any size is usable at once; pages fault in as probes
+  touch them. contains_batch() takes digests in the layout libsha256_batch() writes and runs them through the stages
+  a group at a time, prefetching each stage's line for the whole group before using any, so the DRAM misses of one
+  group overlap instead of queueing behind each other.
+*/
+
+class DigestSet
+{
+public:
+  static constexpr char MAGIC[8] = {'S', '2', '5', '6', 'S', 'E', 'T', '1'};
+  static constexpr size_t HEADER = 64;
+  static constexpr unsigned BLOOM_BITS_PER_DIGEST = 16;  // about 0.05% false positives
+  static constexpr unsigned DIGESTS_PER_BUCKET = 4;
+
+  DigestSet() = default;
+  DigestSet(const DigestSet &) = delete;
+  DigestSet &operator=(const DigestSet &) = delete;
+  ~DigestSet() { close(); }
+
+  // Writes a set holding digests (any order, duplicates allowed) to path. Sorts the vector in place.
+  static bool build(std::vector<std::array<uint8_t, 32>> &digests, const std::string &path)
+  {
+    std::sort(digests.begin(), digests.end());
+    digests.erase(std::unique(digests.begin(), digests.end()), digests.end());
+    uint64_t count = digests.size();
+
+    unsigned bucket_bits = 0;
+    while ((count >> bucket_bits) > DIGESTS_PER_BUCKET) bucket_bits++;
+    uint64_t buckets = 1ULL << bucket_bits;
+    uint64_t bloom_blocks = std::max<uint64_t>(1, count * BLOOM_BITS_PER_DIGEST / 256);
+
+    std::vector<uint32_t> bloom(bloom_blocks * 8);
+    std::vector<uint64_t> index(buckets + 1);
+    for (uint64_t i = 0; i < count; i++)
+    {
+      const uint8_t *d = digests[i].data();
+      uint32_t *block = &bloom[block_of(d, bloom_blocks) * 8];
+      uint32_t key = le32(d + 16);
+      for (int w = 0; w < 8; w++) block[w] |= 1u << ((key * SALT[w]) >> 27);
+      index[bucket_of(d, bucket_bits) + 1]++;
+    }
+    for (uint64_t b = 0; b < buckets; b++) index[b + 1] += index[b];
+
+    uint8_t header[HEADER] = {};
+    uint64_t bloom_offset = HEADER, index_offset = align(bloom_offset + bloom.size() * 4),
+             digests_offset = align(index_offset + index.size() * 8);
+    memcpy(header, MAGIC, 8);
+    memcpy(header + 8, &count, 8);
+    memcpy(header + 16, &bucket_bits, 4);
+    memcpy(header + 24, &bloom_blocks, 8);
+    memcpy(header + 32, &bloom_offset, 8);
+    memcpy(header + 40, &index_offset, 8);
+    memcpy(header + 48, &digests_offset, 8);
+
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f)
+      return false;
+    static const uint8_t zeros[64] = {};
+    bool ok = fwrite(header, 1, HEADER, f) == HEADER && fwrite(bloom.data(), 4, bloom.size(), f) == bloom.size() &&
+              fwrite(zeros, 1, index_offset - (bloom_offset + bloom.size() * 4), f) == index_offset - (bloom_offset + bloom.size() * 4) &&
+              fwrite(index.data(), 8, index.size(), f) == index.size() &&
+              fwrite(zeros, 1, digests_offset - (index_offset + index.size() * 8), f) == digests_offset - (index_offset + index.size() * 8) &&
+              (count == 0 || fwrite(digests.data(), 32, count, f) == count);
+    return fclose(f) == 0 && ok;
+  }
+
+  // Maps the set at path; false (with errno or EINVAL) if it cannot be opened or is not a well-formed set.
+  bool open(const std::string &path)
+  {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0)
+      return false;
+    bool stat_failed = fstat(fd, &st) != 0;
+    if (stat_failed || (size_t)st.st_size < HEADER)
+    {
+      int err = stat_failed ? errno : EINVAL;
+      ::close(fd);
+      errno = err;
+      return false;
+    }
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+      return false;
+    base = static_cast<const uint8_t *>(p);
+    size = st.st_size;
+
+    uint64_t bloom_offset, index_offset, digests_offset;
+    memcpy(&count, base + 8, 8);
+    memcpy(&bucket_bits, base + 16, 4);
+    memcpy(&bloom_blocks, base + 24, 8);
+    memcpy(&bloom_offset, base + 32, 8);
+    memcpy(&index_offset, base + 40, 8);
+    memcpy(&digests_offset, base + 48, 8);
+    uint64_t buckets = 1ULL << std::min(bucket_bits, 63u);
+    // Sections must be in order and inside the file; sizes are compared by division so no header value can overflow.
+    bool valid = !memcmp(base, MAGIC, 8) && bucket_bits < 48 && bloom_blocks && bloom_offset >= HEADER && bloom_offset % 64 == 0 &&
+                 index_offset % 64 == 0 && digests_offset % 64 == 0 && bloom_offset <= index_offset && index_offset <= digests_offset &&
+                 digests_offset <= size && bloom_blocks <= (index_offset - bloom_offset) / 32 &&
+                 buckets + 1 <= (digests_offset - index_offset) / 8 && (size - digests_offset) % 32 == 0 &&
+                 count == (size - digests_offset) / 32;
+    if (valid)
+    {
+      bloom = reinterpret_cast<const uint32_t *>(base + bloom_offset);
+      index = reinterpret_cast<const uint64_t *>(base + index_offset);
+      digests = base + digests_offset;
+      // Every lookup trusts its bucket's bounds, so all of them are checked once here.
+      valid = index[0] == 0 && index[buckets] == count;
+      for (uint64_t b = 0; b < buckets && valid; b++) valid = index[b] <= index[b + 1];
+    }
+    if (!valid)
+    {
+      close();
+      errno = EINVAL;
+      return false;
+    }
+    return true;
+  }
+
+  void close()
+  {
+    if (base)
+      munmap(const_cast<uint8_t *>(base), size);
+    base = nullptr;
+    size = 0;
+    count = 0;
+  }
+
+  uint64_t digests_count() const { return count; }
+  size_t bytes() const { return size; }
+
+  // Bloom filter alone: false means absent, true means probably present.
+  bool may_contain(const uint8_t digest[32]) const { return bloom_test(digest); }
+
+  bool contains(const uint8_t digest[32]) const
+  {
+    if (!bloom_test(digest))
+      return false;
+    uint64_t b = bucket_of(digest, bucket_bits);
+    return bucket_find(digest, index[b], index[b + 1]);
+  }
+
+  // found[i] = contains(digests[i]), with the memory accesses of a group of lookups overlapped.
+  void contains_batch(const uint8_t (*query)[32], size_t n, bool *found) const
+  {
+    for (size_t g = 0; g < n; g += GROUP)
+    {
+      size_t k = std::min(GROUP, n - g);
+      const uint8_t (*q)[32] = query + g;
+      uint64_t bucket[GROUP];
+
+      for (size_t i = 0; i < k; i++) __builtin_prefetch(bloom + block_of(q[i], bloom_blocks) * 8);
+      for (size_t i = 0; i < k; i++)
+      {
+        found[g + i] = bloom_test(q[i]);
+        bucket[i] = bucket_of(q[i], bucket_bits);
+        if (found[g + i])
+          __builtin_prefetch(index + bucket[i]);
+      }
+      for (size_t i = 0; i < k; i++)
+        if (found[g + i])
+          __builtin_prefetch(digests + index[bucket[i]] * 32);
+      for (size_t i = 0; i < k; i++)
+        if (found[g + i])
+          found[g + i] = bucket_find(q[i], index[bucket[i]], index[bucket[i] + 1]);
+    }
+  }
+
+private:
+  static constexpr size_t GROUP = 16;
+  static constexpr uint32_t SALT[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                       0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+  static uint64_t align(uint64_t v) { return (v + 63) / 64 * 64; }
+
+  static uint32_t le32(const uint8_t *p)
+  {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+  }
+
+  static uint64_t bucket_of(const uint8_t *d, unsigned bits)
+  {
+    uint64_t v;
+    memcpy(&v, d, 8);
+    return bits ? __builtin_bswap64(v) >> (64 - bits) : 0;  // leading bits, so buckets follow the sort order
+  }
+
+  static uint64_t block_of(const uint8_t *d, uint64_t blocks)
+  {
+    uint64_t v;
+    memcpy(&v, d + 8, 8);
+    return (uint64_t)(((unsigned __int128)v * blocks) >> 64);
+  }
+
+  bool bloom_test(const uint8_t *d) const
+  {
+    const uint32_t *block = bloom + block_of(d, bloom_blocks) * 8;
+    uint32_t key = le32(d + 16);
+    if (avx2)
+      return bloom_test_avx2(block, key);
+    for (int w = 0; w < 8; w++)
+      if (!(block[w] >> ((key * SALT[w]) >> 27) & 1))
+        return false;
+    return true;
+  }
+
+  __attribute__((target("avx2"))) static bool bloom_test_avx2(const uint32_t *block, uint32_t key)
+  {
+    __m256i salt = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(SALT));
+    __m256i shift = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(key), salt), 27);
+    __m256i mask = _mm256_sllv_epi32(_mm256_set1_epi32(1), shift);
+    return _mm256_testc_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(block)), mask);
+  }
+
+  bool bucket_find(const uint8_t *d, uint64_t begin, uint64_t end) const
+  {
+    if (avx2)
+      return bucket_find_avx2(d, digests + begin * 32, end - begin);
+    for (uint64_t i = begin; i < end; i++)
+      if (!memcmp(digests + i * 32, d, 32))
+        return true;
+    return false;
+  }
+
+  __attribute__((target("avx2"))) static bool bucket_find_avx2(const uint8_t *d, const uint8_t *entries, uint64_t n)
+  {
+    __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(d));
+    for (uint64_t i = 0; i < n; i++)
+    {
+      __m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(entries + i * 32));
+      if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(q, e)) == -1)
+        return true;
+    }
+    return false;
+  }
+
+  const uint8_t *base = nullptr;
+  size_t size = 0;
+  uint64_t count = 0;
+  unsigned bucket_bits = 0;
+  uint64_t bloom_blocks = 0;
+  const uint32_t *bloom = nullptr;
+  const uint64_t *index = nullptr;
+  const uint8_t *digests = nullptr;
+  bool avx2 = __builtin_cpu_supports("avx2");
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef SHA256_DRBG_H
+#define SHA256_DRBG_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+
+/*
+  Counter-mode SHA-256 keystream for reproducible test data.
+
+  The stream for a seed is the concatenation of 32-byte blocks
+
+    block[i] = SHA-256(K || le64(i)),   K = SHA-256(seed) || 32 zero bytes
+
+  K is exactly one compression block, so the state after it is computed once and every output block costs a single
+  compression: the counter, padding and length. Blocks are independent, so libsha256_batch_from() advances a lane's
+  worth of counters per kernel call and writes the digests straight into the caller's buffer, and any byte range of
+  the stream can be generated on its own. Splitting a range across threads therefore yields the same bytes as
+  generating it in one go, on any backend.
+
+  This is a generator for load and test data, not a vetted cryptographic DRBG: it has no reseeding, no prediction
+  resistance and no health tests.
+*/
+
+class CounterDrbg
+{
+public:
+  static constexpr size_t BLOCK = LIBSHA256_DIGEST_SIZE;
+
+  CounterDrbg(const void *seed, size_t len)
+  {
+    uint8_t key[LIBSHA256_BLOCK_SIZE] = {};
+    libsha256(seed, len, key);
+    libsha256_ctx ctx;
+    libsha256_init(&ctx);
+    memcpy(mid.state, ctx.state, sizeof(mid.state));
+    libsha256_transform(mid.state, key, 1);
+    mid.length = LIBSHA256_BLOCK_SIZE;
+  }
+
+  explicit CounterDrbg(uint64_t seed) : CounterDrbg(le64(seed).data(), 8) {}
+
+  // Bytes [offset, offset + len) of the stream.
+  void generate(uint64_t offset, void *out, size_t len) const
+  {
+    if (!len)
+      return;
+    uint8_t *p = static_cast<uint8_t *>(out);
+    uint64_t counter = offset / BLOCK;
+    size_t skip = offset % BLOCK;
+    if (skip || len < BLOCK)
+    {
+      // Leading partial block.
+      uint8_t block[BLOCK];
+      blocks(counter++, 1, block);
+      size_t n = std::min(len, BLOCK - skip);
+      memcpy(p, block + skip, n);
+      p += n;
+      len -= n;
+    }
+    size_t whole = len / BLOCK;
+    blocks(counter, whole, p);
+    counter += whole;
+    p += whole * BLOCK;
+    len -= whole * BLOCK;
+    if (len)
+    {
+      uint8_t block[BLOCK];
+      blocks(counter, 1, block);
+      memcpy(p, block, len);
+    }
+  }
+
+  // Same bytes as generate(), with the range split into one block-aligned piece per thread.
+  void generate_parallel(uint64_t offset, void *out, size_t len, unsigned threads) const
+  {
+    threads = std::max(1u, threads);
+    size_t per = (len / threads + BLOCK - 1) / BLOCK * BLOCK;
+    if (threads == 1 || per == 0)
+      return generate(offset, out, len);
+
+    std::vector<std::thread> pool;
+    for (size_t start = 0; start < len; start += per)
+    {
+      size_t n = std::min(per, len - start);
+      pool.emplace_back([this, offset, out, start, n]() { generate(offset + start, static_cast<uint8_t *>(out) + start, n); });
+    }
+    for (auto &t : pool) t.join();
+  }
+
+  // Sequential reads that continue where the last one stopped.
+  void read(void *out, size_t len)
+  {
+    generate(position, out, len);
+    position += len;
+  }
+
+  uint64_t position = 0;
+
+private:
+  static constexpr size_t CHUNK = 256;  // counters per libsha256_batch_from() call
+
+  static std::vector<uint8_t> le64(uint64_t v)
+  {
+    std::vector<uint8_t> b(8);
+    for (int i = 0; i < 8; i++) b[i] = v >> (8 * i);
+    return b;
+  }
+
+  // n whole blocks starting at counter, written to out.
+  void blocks(uint64_t counter, size_t n, uint8_t *out) const
+  {
+    uint8_t counters[CHUNK][8];
+    const void *msgs[CHUNK];
+    const libsha256_midstate *starts[CHUNK];
+    size_t lens[CHUNK];
+    for (size_t i = 0; i < CHUNK; i++)
+    {
+      msgs[i] = counters[i];
+      starts[i] = &mid;
+      lens[i] = 8;
+    }
+    for (size_t done = 0; done < n; done += CHUNK)
+    {
+      size_t k = std::min(CHUNK, n - done);
+      for (size_t i = 0; i < k; i++)
+      {
+        uint64_t c = counter + done + i;
+        for (int j = 0; j < 8; j++) counters[i][j] = c >> (8 * j);
+      }
+      libsha256_batch_from(starts, msgs, lens, k, reinterpret_cast<uint8_t(*)[BLOCK]>(out + done * BLOCK));
+    }
+  }
+
+  libsha256_midstate mid;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef SHA256_MIDSTATE_H
+#define SHA256_MIDSTATE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "libsha256.h"
+
+/*
+  Bounded LRU cache of prefix midstates, for message families that share a long header (protocol headers,
+  domain-separation tags, record envelopes).
+
+  Only the 64-byte-aligned part of a prefix can be cached: the state after its full blocks. A message is hashed by
+  resuming from that state and absorbing the rest of the message, so every hit saves prefix_len / 64 compressions.
+
+  Entries are keyed either by content or by a caller-supplied ID. Content keys use a fast 64-bit fingerprint of the
+  prefix bytes, and a hit is confirmed by comparing against a stored copy, so a fingerprint collision costs a miss
+  and never a wrong digest; both are far cheaper than the compressions they replace. ID keys skip the copy and the
+  comparison: the caller promises that an ID always names the same prefix.
+
+  hash() and batch() are safe to call from several threads; misses compress outside the lock.
+*/
+
+class MidstateCache
+{
+public:
+  struct Stats
+  {
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+    uint64_t blocks_saved = 0;     // compressions skipped thanks to hits
+    uint64_t blocks_computed = 0;  // prefix compressions done on misses
+    size_t entries = 0;
+
+    double hit_rate() const { return lookups ? (double)hits / lookups : 0; }
+  };
+
+  static constexpr uint64_t NO_ID = ~0ULL;
+
+  explicit MidstateCache(size_t capacity = 1024) : capacity(capacity ? capacity : 1) {}
+
+  // Midstate after the full blocks of prefix[0, prefix_len), from the cache or computed and inserted.
+  libsha256_midstate midstate(const void *prefix, size_t prefix_len, uint64_t id = NO_ID)
+  {
+    size_t aligned = prefix_len / LIBSHA256_BLOCK_SIZE * LIBSHA256_BLOCK_SIZE;
+    libsha256_ctx ctx;
+    libsha256_init(&ctx);
+    libsha256_midstate mid = {};
+    memcpy(mid.state, ctx.state, sizeof(mid.state));
+    if (!aligned)
+      return mid;
+
+    bool by_id = id != NO_ID;
+    Key key = {by_id ? id : fingerprint((const uint8_t *)prefix, aligned), aligned, by_id};
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      counters.lookups++;
+      auto it = index.find(key);
+      if (it != index.end() && (by_id || !memcmp(it->second->bytes.data(), prefix, aligned)))
+      {
+        lru.splice(lru.begin(), lru, it->second);
+        counters.hits++;
+        counters.blocks_saved += aligned / LIBSHA256_BLOCK_SIZE;
+        return it->second->mid;
+      }
+    }
+
+    libsha256_transform(mid.state, prefix, aligned / LIBSHA256_BLOCK_SIZE);
+    mid.length = aligned;
+
+    std::lock_guard<std::mutex> lk(mu);
+    counters.blocks_computed += aligned / LIBSHA256_BLOCK_SIZE;
+    auto it = index.find(key);
+    if (it != index.end())
+    {
+      // Another thread got there first, or a content fingerprint collided; the newest prefix wins.
+      lru.erase(it->second);
+      index.erase(it);
+    }
+    lru.push_front({key, mid, {}});
+    if (!by_id)
+      lru.front().bytes.assign((const uint8_t *)prefix, (const uint8_t *)prefix + aligned);
+    index[key] = lru.begin();
+    while (lru.size() > capacity)
+    {
+      index.erase(lru.back().key);
+      lru.pop_back();
+    }
+    return mid;
+  }
+
+  // Digest of msg, whose first prefix_len bytes are a (possibly) shared prefix.
+  void hash(const void *msg, size_t len, size_t prefix_len, uint8_t digest[32], uint64_t id = NO_ID)
+  {
+    libsha256_midstate mid = midstate(msg, std::min(prefix_len, len), id);
+    libsha256_ctx ctx;
+    libsha256_init_from(&ctx, &mid);
+    libsha256_update(&ctx, (const uint8_t *)msg + mid.length, len - mid.length);
+    libsha256_final(&ctx, digest);
+  }
+
+  // Batch form of hash(): message i shares its first prefix_lens[i] bytes; ids may be null for content keys.
+  void batch(const void *const *msgs, const size_t *lens, const size_t *prefix_lens, size_t n, uint8_t (*digests)[32],
+             const uint64_t *ids = nullptr)
+  {
+    std::vector<libsha256_midstate> mids(n);
+    std::vector<const libsha256_midstate *> starts(n);
+    std::vector<const void *> rest(n);
+    std::vector<size_t> rest_lens(n);
+    for (size_t i = 0; i < n; i++)
+    {
+      mids[i] = midstate(msgs[i], std::min(prefix_lens[i], lens[i]), ids ? ids[i] : NO_ID);
+      starts[i] = &mids[i];
+      rest[i] = (const uint8_t *)msgs[i] + mids[i].length;
+      rest_lens[i] = lens[i] - mids[i].length;
+    }
+    libsha256_batch_from(starts.data(), rest.data(), rest_lens.data(), n, digests);
+  }
+
+  Stats stats() const
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    Stats s = counters;
+    s.entries = lru.size();
+    return s;
+  }
+
+  void reset_stats()
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    counters = Stats();
+  }
+
+private:
+  struct Key
+  {
+    uint64_t value;  // fingerprint or caller ID
+    uint64_t len;
+    bool by_id;
+
+    bool operator==(const Key &o) const { return value == o.value && len == o.len && by_id == o.by_id; }
+  };
+
+  struct KeyHash
+  {
+    size_t operator()(const Key &k) const { return k.value ^ (k.len * 0x9e3779b97f4a7c15ULL) ^ k.by_id; }
+  };
+
+  struct Entry
+  {
+    Key key;
+    libsha256_midstate mid;
+    std::vector<uint8_t> bytes;  // the prefix itself, for content keys
+  };
+
+  static uint64_t rotl(uint64_t x, int r) { return x << r | x >> (64 - r); }
+
+  // Four independent multiply-xor streams over 8-byte words, so the multiply latency overlaps; len is a multiple of 64.
+  static uint64_t fingerprint(const uint8_t *p, size_t len)
+  {
+    const uint64_t M = 0x9e3779b97f4a7c15ULL;
+    uint64_t h[4] = {len, M, ~len, ~M};
+    for (size_t i = 0; i < len; i += 32)
+      for (int j = 0; j < 4; j++)
+      {
+        uint64_t w;
+        memcpy(&w, p + i + 8 * j, 8);
+        h[j] = (h[j] ^ w) * M;
+        h[j] ^= h[j] >> 29;
+      }
+    uint64_t r = h[0] ^ rotl(h[1], 17) ^ rotl(h[2], 31) ^ rotl(h[3], 47);
+    r ^= r >> 32;
+    return r * M;
+  }
+
+  size_t capacity;
+  mutable std::mutex mu;
+  std::list<Entry> lru;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+  Stats counters;
+};
+
+#endif
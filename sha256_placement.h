@@ -0,0 +1,262 @@
+#ifndef SHA256_PLACEMENT_H
+#define SHA256_PLACEMENT_H
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+/*
+  Worker placement for the parallel hashing front ends.
+
+  The topology (logical CPU -> physical core, package, NUMA node) comes from /sys, so no libnuma is needed. Policies:
+
+    none     leave threads to the scheduler (the old behaviour)
+    compact  fill both hardware threads of a core before moving to the next core
+    scatter  one worker per physical core, alternating packages, before any core gets a second worker
+    numa     worker i is bound to every CPU of node i % nodes, so the scheduler can still balance inside a node
+    auto     scatter for the AVX2/AVX-512/SHA-NI backends (two threads on one core fight over the same units),
+             compact for scalar code (which gains from SMT)
+
+  Memory follows the first touch: alloc_local() maps and faults the pages from the calling thread, so a worker that
+  is already placed gets its chunk buffers on its own node.
+*/
+
+enum class Placement
+{
+  None,
+  Compact,
+  Scatter,
+  Numa,
+  Auto,
+};
+
+inline const char *placement_name(Placement p)
+{
+  static const char *names[] = {"none", "compact", "scatter", "numa", "auto"};
+  return names[(int)p];
+}
+
+inline Placement parse_placement(const std::string &name)
+{
+  for (int p = 0; p <= (int)Placement::Auto; p++)
+    if (name == placement_name((Placement)p))
+      return (Placement)p;
+  return Placement::None;
+}
+
+struct CpuInfo
+{
+  int cpu;
+  int package;
+  int core;     // Dense index of the physical core across the machine
+  int sibling;  // 0 for the first hardware thread of its core, 1 for the second, ...
+  int node;
+};
+
+// Parses a /sys cpulist such as "0-3,8-11".
+inline std::vector<int> parse_cpulist(const std::string &list)
+{
+  std::vector<int> cpus;
+  const char *p = list.c_str();
+  while (*p)
+  {
+    char *end;
+    long lo = strtol(p, &end, 10), hi = lo;
+    if (end == p)
+      break;
+    if (*end == '-')
+      hi = strtol(end + 1, &end, 10);
+    for (long c = lo; c <= hi; c++) cpus.push_back((int)c);
+    p = *end == ',' ? end + 1 : end;
+  }
+  return cpus;
+}
+
+class Topology
+{
+public:
+  static const Topology &get()
+  {
+    static const Topology topology;
+    return topology;
+  }
+
+  std::vector<CpuInfo> cpus;
+  int num_cores = 0;
+  int num_nodes = 1;
+
+  std::vector<int> node_cpus(int node) const
+  {
+    std::vector<int> out;
+    for (const auto &c : cpus)
+      if (c.node == node)
+        out.push_back(c.cpu);
+    return out;
+  }
+
+private:
+  Topology()
+  {
+    std::map<int, int> cpu_node;
+    if (DIR *dir = opendir("/sys/devices/system/node"))
+    {
+      while (dirent *ent = readdir(dir))
+      {
+        if (strncmp(ent->d_name, "node", 4) != 0 || !isdigit((unsigned char)ent->d_name[4]))
+          continue;
+        int node = atoi(ent->d_name + 4);
+        std::ifstream in(std::string("/sys/devices/system/node/") + ent->d_name + "/cpulist");
+        std::string list;
+        std::getline(in, list);
+        for (int cpu : parse_cpulist(list)) cpu_node[cpu] = node;
+        num_nodes = std::max(num_nodes, node + 1);
+      }
+      closedir(dir);
+    }
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    std::map<std::pair<int, std::string>, int> core_index;
+    std::map<int, int> seen_per_core;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+      if (!CPU_ISSET(cpu, &allowed))
+        continue;
+      std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+      std::ifstream pkg_in(base + "physical_package_id"), sib_in(base + "thread_siblings_list");
+      int package = 0;
+      std::string siblings = std::to_string(cpu);
+      pkg_in >> package;
+      if (sib_in)
+        std::getline(sib_in, siblings);
+
+      auto key = std::make_pair(package, siblings);
+      if (!core_index.count(key))
+        core_index[key] = num_cores++;
+      int core = core_index[key];
+      cpus.push_back({cpu, package, core, seen_per_core[core]++, cpu_node.count(cpu) ? cpu_node[cpu] : 0});
+    }
+    if (cpus.empty())
+      cpus.push_back({0, 0, 0, 0, 0}), num_cores = 1;
+  }
+};
+
+// Order in which workers are handed logical CPUs under a per-CPU policy.
+inline std::vector<int> placement_order(Placement p)
+{
+  std::vector<CpuInfo> cpus = Topology::get().cpus;
+  if (p == Placement::Compact)
+    std::sort(cpus.begin(), cpus.end(),
+              [](const CpuInfo &a, const CpuInfo &b) { return std::tie(a.package, a.core, a.sibling) < std::tie(b.package, b.core, b.sibling); });
+  else
+  {
+    // Rank each core within its package so consecutive workers alternate packages.
+    std::map<int, int> next_rank;
+    std::map<int, int> rank;
+    for (const auto &c : cpus)
+      if (!rank.count(c.core))
+        rank[c.core] = next_rank[c.package]++;
+    std::sort(cpus.begin(), cpus.end(),
+              [&](const CpuInfo &a, const CpuInfo &b)
+              { return std::make_tuple(a.sibling, rank[a.core], a.package) < std::make_tuple(b.sibling, rank[b.core], b.package); });
+  }
+  std::vector<int> order;
+  for (const auto &c : cpus) order.push_back(c.cpu);
+  return order;
+}
+
+// libsha256 backends built on plain integer code, which gains from SMT; the others saturate a per-core vector or SHA unit.
+inline bool scalar_backend(const std::string &backend)
+{
+  return backend == "scalar" || backend == "interleaved";
+}
+
+inline Placement resolve_placement(Placement p, const std::string &backend)
+{
+  if (p == Placement::Auto)
+    return scalar_backend(backend) ? Placement::Compact : Placement::Scatter;
+  return p;
+}
+
+// How many workers a policy wants when asked for `requested`; auto caps vector backends at one per physical core.
+inline unsigned placement_workers(Placement p, const std::string &backend, unsigned requested)
+{
+  if (p == Placement::Auto && !scalar_backend(backend))
+    return std::max(1u, std::min(requested, (unsigned)Topology::get().num_cores));
+  return std::max(1u, requested);
+}
+
+// CPUs worker i may run on; empty means no restriction.
+inline std::vector<int> placement_cpus(Placement p, const std::string &backend, unsigned i)
+{
+  p = resolve_placement(p, backend);
+  if (p == Placement::None)
+    return {};
+  const Topology &topo = Topology::get();
+  if (p == Placement::Numa)
+  {
+    std::vector<int> cpus = topo.node_cpus(i % topo.num_nodes);
+    return cpus.empty() ? topo.node_cpus(0) : cpus;
+  }
+  static const std::vector<int> compact = placement_order(Placement::Compact);
+  static const std::vector<int> scatter = placement_order(Placement::Scatter);
+  const std::vector<int> &order = p == Placement::Compact ? compact : scatter;
+  return {order[i % order.size()]};
+}
+
+inline void pin_current_thread(const std::vector<int> &cpus)
+{
+  if (cpus.empty())
+    return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+inline void place_current_thread(Placement p, const std::string &backend, unsigned i)
+{
+  pin_current_thread(placement_cpus(p, backend, i));
+}
+
+inline int current_node()
+{
+  int cpu = sched_getcpu();
+  for (const auto &c : Topology::get().cpus)
+    if (c.cpu == cpu)
+      return c.node;
+  return 0;
+}
+
+// Maps and pre-faults `bytes` from the calling thread, so the pages land on the node it runs on.
+inline void *alloc_local(size_t bytes)
+{
+  void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return nullptr;
+  long page = sysconf(_SC_PAGESIZE);
+  for (size_t off = 0; off < bytes; off += page) static_cast<volatile char *>(p)[off] = 0;
+  return p;
+}
+
+inline void free_local(void *p, size_t bytes)
+{
+  if (p)
+    munmap(p, bytes);
+}
+
+#endif
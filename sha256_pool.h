@@ -0,0 +1,351 @@
+#ifndef SHA256_POOL_H
+#define SHA256_POOL_H
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <utility>
+
+/*
+  Aligned buffer pool for batch input/output and chunk buffers.
+
+  Buffers come in power-of-two size classes from 64 bytes to 4 MiB, carved from 2 MiB-aligned slabs, so every buffer
+  up to 2 MiB is aligned to its own size class and the 4 MiB class to 2 MiB (always at least a cache line, which covers
+  AVX2 and AVX-512 aligned loads). Slabs are
+  pre-faulted when they are mapped, so the hashing loop never takes a first-touch fault. With hugepages enabled a
+  slab is first requested as an explicit 2 MiB hugepage (MAP_HUGETLB); if the system has none reserved it falls back
+  to a normal mapping advised with MADV_HUGEPAGE, which transparent hugepages can back.
+
+  Freed buffers go on the calling thread's free list and allocation pops from it, so the common path takes no lock.
+  Each per-thread list is capped; a free past the cap spills half of it to the shared list, so a consumer thread that
+  frees what a producer allocated hands the buffers back instead of hoarding them. Only carving a new slab, spilling,
+  refilling from the shared list or adopting the lists of a thread that has exited takes the pool mutex.
+*/
+
+class BufferPool
+{
+public:
+  static constexpr size_t MIN_CLASS = 64;
+  static constexpr size_t MAX_CLASS = 4 << 20;
+  static constexpr size_t SLAB = 2 << 20;
+  static constexpr size_t RUN = 64 << 10;
+  static constexpr int NUM_CLASSES = 17;  // 64 B .. 4 MiB
+  static constexpr size_t CACHE_BYTES = 4 << 20;  // per thread and class, but at least two buffers
+
+  struct Stats
+  {
+    size_t slabs = 0;
+    size_t bytes = 0;
+    size_t hugetlb_slabs = 0;  // backed by explicit 2 MiB pages
+    size_t thp_slabs = 0;      // advised for transparent hugepages
+  };
+
+  static BufferPool &get()
+  {
+    static BufferPool pool;
+    return pool;
+  }
+
+  // Takes effect for slabs mapped afterwards; call before the first allocation.
+  void set_hugepages(bool on) { hugepages = on; }
+
+  void *alloc(size_t bytes)
+  {
+    int c = size_class(bytes);
+    if (c < 0)
+      return nullptr;
+    ThreadCache &tc = cache();
+    if (!tc.free[c])
+      refill(c);
+    Node *n = tc.free[c];
+    if (n)
+    {
+      tc.free[c] = n->next;
+      tc.count[c]--;
+    }
+    return n;
+  }
+
+  void free(void *p, size_t bytes)
+  {
+    int c = size_class(bytes);
+    if (!p || c < 0)
+      return;
+    ThreadCache &tc = cache();
+    Node *n = static_cast<Node *>(p);
+    n->next = tc.free[c];
+    tc.free[c] = n;
+    if (++tc.count[c] > cache_limit(c))
+      spill(tc, c);
+  }
+
+  Stats stats()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return totals;
+  }
+
+  static int size_class(size_t bytes)
+  {
+    if (bytes > MAX_CLASS)
+      return -1;
+    int c = 0;
+    for (size_t s = MIN_CLASS; s < bytes; s <<= 1) c++;
+    return c;
+  }
+  static size_t class_size(int c) { return MIN_CLASS << c; }
+  static size_t cache_limit(int c) { return std::max<size_t>(2, CACHE_BYTES / class_size(c)); }
+
+private:
+  struct Node
+  {
+    Node *next;
+  };
+
+  struct ThreadCache
+  {
+    Node *free[NUM_CLASSES] = {};
+    size_t count[NUM_CLASSES] = {};
+    ~ThreadCache() { BufferPool::get().adopt(free); }
+  };
+
+  BufferPool() = default;
+
+  static ThreadCache &cache()
+  {
+    thread_local ThreadCache tc;
+    return tc;
+  }
+
+  // Hands the free lists of an exiting thread to the pool so the next refill can reuse them.
+  void adopt(Node *lists[NUM_CLASSES])
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int c = 0; c < NUM_CLASSES; c++)
+      while (Node *n = lists[c])
+      {
+        lists[c] = n->next;
+        n->next = spare[c];
+        spare[c] = n;
+      }
+  }
+
+  // Keeps the first half of an over-full list and moves the rest to the shared list.
+  void spill(ThreadCache &tc, int c)
+  {
+    size_t keep = cache_limit(c) / 2;
+    Node *last = tc.free[c];
+    for (size_t i = 1; i < keep; i++) last = last->next;
+    Node *first = last->next, *tail = first;
+    while (tail->next) tail = tail->next;
+    last->next = nullptr;
+    tc.count[c] = keep;
+    std::lock_guard<std::mutex> lock(mutex);
+    tail->next = spare[c];
+    spare[c] = first;
+  }
+
+  // Takes up to a list's worth of spare buffers; failing that, small classes take a 64 KiB run from the shared slab being
+  // carved and larger ones get slabs of their own.
+  void refill(int c)
+  {
+    size_t size = class_size(c);
+    ThreadCache &tc = cache();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (spare[c])
+    {
+      Node *last = spare[c];
+      size_t n = 1;
+      for (; n < cache_limit(c) && last->next; n++) last = last->next;
+      tc.free[c] = spare[c];
+      tc.count[c] = n;
+      spare[c] = last->next;
+      last->next = nullptr;
+      return;
+    }
+    uint8_t *base;
+    size_t bytes;
+    if (size <= RUN)
+    {
+      if (bump_left < RUN)
+      {
+        bump = map_slab(SLAB);
+        bump_left = bump ? SLAB : 0;
+      }
+      if (!bump)
+        return;
+      base = bump, bytes = RUN;
+      bump += RUN, bump_left -= RUN;
+    }
+    else
+    {
+      bytes = std::max(SLAB, size);
+      base = map_slab(bytes);
+      if (!base)
+        return;
+    }
+    for (size_t off = bytes; off >= size; off -= size)
+    {
+      Node *n = reinterpret_cast<Node *>(base + off - size);
+      n->next = tc.free[c];
+      tc.free[c] = n;
+      tc.count[c]++;
+    }
+  }
+
+  // Called with the mutex held. Slabs are never unmapped; the pool only grows to the peak working set.
+  uint8_t *map_slab(size_t bytes)
+  {
+    void *p = MAP_FAILED;
+    if (hugepages)
+    {
+      p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+      if (p != MAP_FAILED)
+        totals.hugetlb_slabs++;
+    }
+    if (p == MAP_FAILED)
+    {
+      // Over-map by one slab so the start can be rounded up to a 2 MiB boundary, which THP needs.
+      void *raw = mmap(nullptr, bytes + SLAB, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (raw == MAP_FAILED)
+        return nullptr;
+      uintptr_t start = ((uintptr_t)raw + SLAB - 1) & ~(uintptr_t)(SLAB - 1);
+      if (start > (uintptr_t)raw)
+        munmap(raw, start - (uintptr_t)raw);
+      uintptr_t end = (uintptr_t)raw + bytes + SLAB;
+      if (end > start + bytes)
+        munmap((void *)(start + bytes), end - start - bytes);
+      p = (void *)start;
+      if (hugepages && madvise(p, bytes, MADV_HUGEPAGE) == 0)
+        totals.thp_slabs++;
+      long page = sysconf(_SC_PAGESIZE);
+      for (size_t off = 0; off < bytes; off += page) static_cast<volatile uint8_t *>(p)[off] = 0;
+    }
+    totals.slabs++;
+    totals.bytes += bytes;
+    return static_cast<uint8_t *>(p);
+  }
+
+  std::mutex mutex;
+  Node *spare[NUM_CLASSES] = {};  // spilled and orphaned buffers
+  uint8_t *bump = nullptr;
+  size_t bump_left = 0;
+  Stats totals;
+  bool hugepages = false;
+};
+
+// Owning handle for one pool buffer; movable, not copyable.
+class PoolBuffer
+{
+public:
+  PoolBuffer() = default;
+  explicit PoolBuffer(size_t bytes) : ptr(static_cast<uint8_t *>(BufferPool::get().alloc(bytes))), len(ptr ? bytes : 0) {}
+  PoolBuffer(PoolBuffer &&o) noexcept : ptr(std::exchange(o.ptr, nullptr)), len(std::exchange(o.len, 0)) {}
+  PoolBuffer &operator=(PoolBuffer &&o) noexcept
+  {
+    std::swap(ptr, o.ptr);
+    std::swap(len, o.len);
+    return *this;
+  }
+  PoolBuffer(const PoolBuffer &) = delete;
+  PoolBuffer &operator=(const PoolBuffer &) = delete;
+  ~PoolBuffer() { BufferPool::get().free(ptr, len); }
+
+  uint8_t *data() const { return ptr; }
+  size_t size() const { return len; }
+
+private:
+  uint8_t *ptr = nullptr;
+  size_t len = 0;
+};
+
+/*
+  Page-fault and dTLB-miss counts for a stretch of the run, including threads started inside it. The counters come
+  from perf_event_open; where that is not allowed the fault count falls back to getrusage() and the TLB count is
+  reported as unavailable.
+*/
+class MemoryCounters
+{
+public:
+  MemoryCounters()
+  {
+    faults_fd = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+    tlb_fd = open_counter(PERF_TYPE_HW_CACHE,
+                          PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  }
+  ~MemoryCounters()
+  {
+    if (faults_fd >= 0)
+      close(faults_fd);
+    if (tlb_fd >= 0)
+      close(tlb_fd);
+  }
+
+  void start()
+  {
+    for (int fd : {faults_fd, tlb_fd})
+      if (fd >= 0)
+      {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    rusage_start = rusage_faults();
+  }
+
+  void stop()
+  {
+    for (int fd : {faults_fd, tlb_fd})
+      if (fd >= 0)
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    page_faults = faults_fd >= 0 ? read_counter(faults_fd) : rusage_faults() - rusage_start;
+    dtlb_misses = tlb_fd >= 0 ? read_counter(tlb_fd) : 0;
+  }
+
+  bool have_tlb() const { return tlb_fd >= 0; }
+
+  uint64_t page_faults = 0;
+  uint64_t dtlb_misses = 0;
+
+private:
+  static int open_counter(uint32_t type, uint64_t config)
+  {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+
+  static uint64_t read_counter(int fd)
+  {
+    uint64_t value = 0;
+    return read(fd, &value, sizeof(value)) == sizeof(value) ? value : 0;
+  }
+
+  static uint64_t rusage_faults()
+  {
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_minflt + ru.ru_majflt;
+  }
+
+  int faults_fd = -1;
+  int tlb_fd = -1;
+  uint64_t rusage_start = 0;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef SHA256_PROFILE_H
+#define SHA256_PROFILE_H
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_placement.h"
+
+/*
+  Per-host tuning profile written by SHA256_autotune and read by the hashing front ends at startup.
+
+  The file is plain key=value lines. It lives at $SHA256_PROFILE, or ~/.sha256_profile.<hostname> so hosts sharing a
+  home directory keep separate profiles. Any key that is missing keeps the built-in default below, so with no profile
+  every front end behaves as before.
+*/
+
+struct HashProfile
+{
+  unsigned threads = std::thread::hardware_concurrency();
+  bool smt = true;               // false: one worker per physical core, pinned to its first sibling
+  std::string backend = "auto";    // libsha256 backend name; "auto" keeps the library's own choice
+  unsigned batch = 1;              // batch kernel calls per unit of scheduled work
+  size_t chunk = 1 << 20;          // bytes read per streaming update()
+  std::string placement = "none";  // see sha256_placement.h
+  bool hugepages = false;          // back pool buffers with 2 MiB pages (sha256_pool.h)
+};
+
+inline std::string host_name()
+{
+  char name[256] = "localhost";
+  gethostname(name, sizeof(name) - 1);
+  return name;
+}
+
+inline std::string profile_path()
+{
+  if (const char *path = getenv("SHA256_PROFILE"))
+    return path;
+  const char *home = getenv("HOME");
+  return std::string(home ? home : ".") + "/.sha256_profile." + host_name();
+}
+
+inline HashProfile load_profile(const std::string &path = profile_path())
+{
+  HashProfile p;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line))
+  {
+    size_t eq = line.find('=');
+    if (line.empty() || line[0] == '#' || eq == std::string::npos)
+      continue;
+    std::string key = line.substr(0, eq), value = line.substr(eq + 1);
+    if (key == "threads")
+      p.threads = std::max(1, atoi(value.c_str()));
+    else if (key == "smt")
+      p.smt = value != "0";
+    else if (key == "backend")
+      p.backend = value;
+    else if (key == "batch")
+      p.batch = std::max(1, atoi(value.c_str()));
+    else if (key == "hugepages")
+      p.hugepages = value != "0";
+    else if (key == "placement")
+      p.placement = value;
+    else if (key == "chunk")
+      p.chunk = std::max(4096ULL, strtoull(value.c_str(), nullptr, 10));
+  }
+  if (p.threads == 0)
+    p.threads = 1;
+  return p;
+}
+
+inline bool save_profile(const HashProfile &p, const std::string &comment, const std::string &path = profile_path())
+{
+  std::ofstream out(path);
+  out << "# " << comment << "\n";
+  out << "host=" << host_name() << "\n";
+  out << "threads=" << p.threads << "\n";
+  out << "smt=" << (p.smt ? 1 : 0) << "\n";
+  out << "backend=" << p.backend << "\n";
+  out << "batch=" << p.batch << "\n";
+  out << "chunk=" << p.chunk << "\n";
+  out << "placement=" << p.placement << "\n";
+  out << "hugepages=" << (p.hugepages ? 1 : 0) << "\n";
+  return bool(out);
+}
+
+// Placement policy for the profile; smt=0 without an explicit policy means one worker per core.
+inline Placement profile_placement(const HashProfile &p)
+{
+  Placement policy = parse_placement(p.placement);
+  return policy == Placement::None && !p.smt ? Placement::Scatter : policy;
+}
+
+inline unsigned profile_workers(const HashProfile &p, const std::string &backend)
+{
+  return placement_workers(profile_placement(p), backend, p.threads);
+}
+
+/*
+  Selects the profile's libsha256 backend and returns the one in effect. SHA256_BACKEND in the environment overrides
+  the profile; a backend this CPU cannot run (a profile copied from another host) falls back to the automatic choice.
+*/
+inline std::string apply_profile_backend(const HashProfile &p)
+{
+  if (!getenv("SHA256_BACKEND") && p.backend != "auto" && libsha256_set_backend(p.backend.c_str()) != 0)
+    fprintf(stderr, "profile: backend %s is not available here, using %s\n", p.backend.c_str(), libsha256_backend_name());
+  return libsha256_backend_name();
+}
+
+// Places worker i of a front end whose kernel is `backend` (a libsha256 backend name).
+inline void apply_profile_placement(const HashProfile &p, unsigned i, const std::string &backend)
+{
+  place_current_thread(profile_placement(p), backend, i);
+}
+
+#endif
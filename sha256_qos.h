@@ -0,0 +1,323 @@
+#ifndef SHA256_QOS_H
+#define SHA256_QOS_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+#include "sha256_telemetry.h"
+
+/*
+  Hashing scheduler with a latency class and capped bulk classes sharing one set of worker threads.
+
+  Latency requests (tokens, short keys) queue for SIMD batches: a batch goes out as soon as it is a full backend
+  width, or when its oldest request has waited max_wait_us. Bulk jobs (whole files) are never hashed in one go; a
+  worker takes one chunk of a job at a time and checks the latency queue before every chunk, so a short request waits
+  for at most one chunk, not one file. reserved_workers of the workers never take bulk chunks at all; at least one
+  worker is always left for bulk, so reserved_workers is capped at workers - 1.
+
+  Each bulk class may carry a throughput cap, a token bucket refilled at the capped rate (bursts of up to four
+  chunks). A class that is out of tokens is skipped until it has some again; other classes and the latency queue
+  carry on. Chunks of one job are hashed in order, one at a time; different jobs run in parallel. Classes with work
+  are served round-robin.
+
+  Completions run on the worker that finished the request and should be quick. Every request, latency or bulk, is
+  recorded in Telemetry once, when it completes, with its submit-to-digest latency, so an exporter shows both classes
+  per backend and size class. Chunk progress is counted in Stats only.
+*/
+
+struct QosOptions
+{
+  unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+  unsigned reserved_workers = 0;  // serve only the latency class; at most workers - 1
+  unsigned max_wait_us = 20;      // oldest latency request's wait before a partial batch is flushed
+  size_t chunk = 256 << 10;       // bulk preemption granularity
+};
+
+class QosScheduler
+{
+  using Clock = std::chrono::steady_clock;
+
+public:
+  using Done = std::function<void(const uint8_t digest[32])>;
+
+  struct Stats
+  {
+    uint64_t batches = 0;
+    uint64_t batched = 0;        // latency requests hashed
+    uint64_t deadline_flushes = 0;  // partial batches flushed by max_wait_us
+    uint64_t chunks = 0;
+    uint64_t bulk_bytes = 0;
+    uint64_t bulk_jobs = 0;      // bulk jobs finished
+    uint64_t throttled = 0;      // times a class with work was skipped for lack of tokens
+  };
+
+  explicit QosScheduler(QosOptions opt = {}) : opt(opt), backend(Telemetry::backend_index(libsha256_backend_name()))
+  {
+    this->opt.workers = std::max(1u, opt.workers);
+    this->opt.reserved_workers = std::min(opt.reserved_workers, this->opt.workers - 1);
+    this->opt.chunk = std::max<size_t>(LIBSHA256_BLOCK_SIZE, opt.chunk / LIBSHA256_BLOCK_SIZE * LIBSHA256_BLOCK_SIZE);
+    for (unsigned i = 0; i < this->opt.workers; i++) workers.emplace_back([this, i]() { work(i); });
+  }
+
+  // Finishes every request already submitted before returning.
+  ~QosScheduler()
+  {
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      stopping = true;
+    }
+    cv.notify_all();
+    for (auto &t : workers) t.join();
+  }
+
+  QosScheduler(const QosScheduler &) = delete;
+  QosScheduler &operator=(const QosScheduler &) = delete;
+
+  // A bulk class; max_bytes_per_s 0 leaves it uncapped. Returns its id for hash_bulk().
+  int add_bulk_class(const std::string &name, double max_bytes_per_s = 0)
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    classes.push_back(std::make_unique<BulkClass>());
+    classes.back()->name = name;
+    set_cap_locked(*classes.back(), max_bytes_per_s);
+    return classes.size() - 1;
+  }
+
+  // False if cls is not a class add_bulk_class() returned.
+  bool set_bulk_cap(int cls, double max_bytes_per_s)
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    if (cls < 0 || (size_t)cls >= classes.size())
+      return false;
+    set_cap_locked(*classes[cls], max_bytes_per_s);
+    return true;
+  }
+
+  // Latency class. data must stay valid until done runs.
+  void hash(const void *data, size_t len, Done done)
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    latency.push_back({static_cast<const uint8_t *>(data), len, std::move(done), Clock::now()});
+    Telemetry::get().set_queue_depth(latency.size());
+    // Wake a worker to start the deadline timer, or to hash a batch that just filled up.
+    if (latency.size() == 1 || latency.size() == batch_width())
+      cv.notify_one();
+  }
+
+  // Bulk class cls. data must stay valid until done runs. False, and done is never called, if cls is not a class
+  // add_bulk_class() returned.
+  bool hash_bulk(int cls, const void *data, size_t len, Done done)
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    if (cls < 0 || (size_t)cls >= classes.size())
+      return false;
+    auto job = std::make_shared<BulkJob>();
+    job->data = static_cast<const uint8_t *>(data);
+    job->len = len;
+    job->done = std::move(done);
+    job->arrival = Clock::now();
+    libsha256_init(&job->ctx);
+    classes[cls]->jobs.push_back(std::move(job));
+    cv.notify_one();
+    return true;
+  }
+
+  Stats stats() const
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    return counters;
+  }
+
+  size_t batch_width() const { return std::min<size_t>(16, std::max<size_t>(8, libsha256_batch_lanes())); }
+
+private:
+  struct Request
+  {
+    const uint8_t *data;
+    size_t len;
+    Done done;
+    Clock::time_point arrival;
+  };
+
+  struct BulkJob
+  {
+    const uint8_t *data;
+    size_t len;
+    size_t offset = 0;
+    bool busy = false;  // a worker is hashing its next chunk
+    libsha256_ctx ctx;
+    Done done;
+    Clock::time_point arrival;
+  };
+
+  struct BulkClass
+  {
+    std::string name;
+    double rate = 0;  // bytes per second, 0 = uncapped
+    double tokens = 0, burst = 0;
+    Clock::time_point refilled = Clock::now();
+    std::deque<std::shared_ptr<BulkJob>> jobs;
+  };
+
+  // Called with mu held.
+  void set_cap_locked(BulkClass &c, double bytes_per_s)
+  {
+    c.rate = std::max(0.0, bytes_per_s);
+    c.burst = 4.0 * opt.chunk;
+    c.tokens = std::min(c.tokens, c.burst);
+    c.refilled = Clock::now();
+  }
+
+  // Called with mu held. Picks the next bulk job to advance, charging its class; sets wake to when a capped class
+  // with work gets tokens again, if nothing can run now.
+  std::shared_ptr<BulkJob> pick_bulk(Clock::time_point now, Clock::time_point &wake)
+  {
+    for (size_t k = 0; k < classes.size(); k++)
+    {
+      BulkClass &c = *classes[(next_class + k) % classes.size()];
+      auto it = std::find_if(c.jobs.begin(), c.jobs.end(), [](const std::shared_ptr<BulkJob> &j) { return !j->busy; });
+      if (it == c.jobs.end())
+        continue;
+      if (c.rate > 0)
+      {
+        c.tokens = std::min(c.burst, c.tokens + c.rate * std::chrono::duration<double>(now - c.refilled).count());
+        c.refilled = now;
+        if (c.tokens <= 0)
+        {
+          counters.throttled++;
+          wake = std::min(wake, now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-c.tokens / c.rate)));
+          continue;
+        }
+        c.tokens -= std::min(opt.chunk, (*it)->len - (*it)->offset);
+      }
+      next_class = (next_class + k + 1) % classes.size();
+      (*it)->busy = true;
+      return *it;
+    }
+    return nullptr;
+  }
+
+  bool drained() const
+  {
+    if (!latency.empty())
+      return false;
+    for (const auto &c : classes)
+      if (!c->jobs.empty())
+        return false;
+    return true;
+  }
+
+  void work(unsigned index)
+  {
+    bool reserved = index < opt.reserved_workers;
+    std::unique_lock<std::mutex> lk(mu);
+    while (true)
+    {
+      Clock::time_point now = Clock::now(), wake = now + std::chrono::milliseconds(100);
+      if (!latency.empty())
+      {
+        Clock::time_point due = latency.front().arrival + std::chrono::microseconds(opt.max_wait_us);
+        if (latency.size() >= batch_width() || now >= due || stopping)
+        {
+          run_batch(lk, now >= due && latency.size() < batch_width());
+          continue;
+        }
+        wake = due;
+      }
+      if (!reserved)
+        if (std::shared_ptr<BulkJob> job = pick_bulk(now, wake))
+        {
+          run_chunk(lk, *job);
+          continue;
+        }
+      if (stopping && drained())
+        return;
+      cv.wait_until(lk, wake);
+    }
+  }
+
+  // Called with lk held; hashes up to one batch of the latency queue.
+  void run_batch(std::unique_lock<std::mutex> &lk, bool deadline)
+  {
+    const void *msgs[16];
+    size_t lens[16];
+    uint8_t digests[16][32];
+    Request taken[16];
+    size_t n = std::min(batch_width(), latency.size());
+    for (size_t i = 0; i < n; i++)
+    {
+      taken[i] = std::move(latency.front());
+      latency.pop_front();
+      msgs[i] = taken[i].data;
+      lens[i] = taken[i].len;
+    }
+    counters.batches++;
+    counters.batched += n;
+    counters.deadline_flushes += deadline;
+    Telemetry::get().set_queue_depth(latency.size());
+    lk.unlock();
+
+    libsha256_batch(msgs, lens, n, digests);
+    Clock::time_point done = Clock::now();
+    for (size_t i = 0; i < n; i++)
+    {
+      Telemetry::get().record(backend, lens[i], std::chrono::duration_cast<std::chrono::nanoseconds>(done - taken[i].arrival).count());
+      taken[i].done(digests[i]);
+    }
+    lk.lock();
+  }
+
+  // Called with lk held; hashes the job's next chunk, and finishes the job if that was its last.
+  void run_chunk(std::unique_lock<std::mutex> &lk, BulkJob &job)
+  {
+    size_t n = std::min(opt.chunk, job.len - job.offset);
+    lk.unlock();
+
+    libsha256_update(&job.ctx, job.data + job.offset, n);
+    bool last = job.offset + n == job.len;
+    uint8_t digest[32];
+    if (last)
+    {
+      libsha256_final(&job.ctx, digest);
+      Telemetry::get().record(backend, job.len, std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - job.arrival).count());
+      job.done(digest);
+    }
+
+    lk.lock();
+    job.offset += n;
+    job.busy = false;
+    counters.chunks++;
+    counters.bulk_bytes += n;
+    if (last)
+    {
+      counters.bulk_jobs++;
+      for (auto &c : classes)
+        c->jobs.erase(std::remove_if(c->jobs.begin(), c->jobs.end(), [&](const std::shared_ptr<BulkJob> &j) { return j.get() == &job; }),
+                      c->jobs.end());
+    }
+  }
+
+  QosOptions opt;
+  int backend;
+  mutable std::mutex mu;
+  std::condition_variable cv;
+  std::deque<Request> latency;
+  std::vector<std::unique_ptr<BulkClass>> classes;
+  size_t next_class = 0;
+  bool stopping = false;
+  Stats counters;
+  std::vector<std::thread> workers;
+};
+
+#endif
@@ -0,0 +1,516 @@
+#ifndef SHA256_TELEMETRY_H
+#define SHA256_TELEMETRY_H
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libsha256.h"
+
+/*
+  Live metrics for long-running hashing services.
+
+  Hashing threads call Telemetry::get().record() once per message (or add() once per batch of equal-sized ones).
+  Each thread owns a shard of counters and latency histograms, keyed by backend and message-size class, and is its
+  only writer: recording is a few relaxed loads and stores to memory no other core writes, with no lock and no
+  atomic read-modify-write. The shard is registered under the mutex the first time a thread records, and readers
+  sum every shard.
+
+  Histograms are HDR-style log-linear: eight sub-buckets per power of two, so any recorded latency from 1 ns to
+  about 18 minutes lands in a bucket within 12.5% of it, in 305 counters.
+
+  TelemetryExporter runs one thread that, every interval, sums the shards, diffs them against the previous sum and
+  reads /proc/stat (and cpufreq and thermal_throttle where the kernel has them) for per-core utilization. Rates and
+  latency quantiles therefore describe the last interval, while the counters are totals. The thread also serves
+  GET /metrics (Prometheus text format) and GET /metrics.json on a loopback port and can append each interval's JSON
+  to a file, one object per line.
+*/
+
+class LatencyHistogram
+{
+public:
+  static constexpr int SUB_BITS = 3;
+  static constexpr int MAX_EXP = 40;  // 2^40 ns, about 18 minutes; longer latencies are clamped
+  static constexpr int BUCKETS = ((MAX_EXP - SUB_BITS + 1) << SUB_BITS) + 1;  // the last one holds everything clamped
+
+  static int bucket_of(uint64_t v)
+  {
+    if (v < (1u << SUB_BITS))
+      return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    if (e >= MAX_EXP)
+      return BUCKETS - 1;
+    return ((e - SUB_BITS + 1) << SUB_BITS) | (int)((v >> (e - SUB_BITS)) & ((1u << SUB_BITS) - 1));
+  }
+
+  // Smallest value that falls in bucket b.
+  static uint64_t bucket_floor(int b)
+  {
+    if (b < (1 << SUB_BITS))
+      return b;
+    int e = (b >> SUB_BITS) + SUB_BITS - 1;
+    return (uint64_t)((1 << SUB_BITS) | (b & ((1 << SUB_BITS) - 1))) << (e - SUB_BITS);
+  }
+
+  // Value reported for bucket b: the middle of its range.
+  static double bucket_value(int b) { return b + 1 < BUCKETS ? (bucket_floor(b) + bucket_floor(b + 1) - 1) / 2.0 : bucket_floor(b); }
+
+  // Value at quantile q (0..1) of counts, or 0 if there are none.
+  static double quantile(const uint64_t *counts, double q)
+  {
+    uint64_t total = 0;
+    for (int b = 0; b < BUCKETS; b++) total += counts[b];
+    if (!total)
+      return 0;
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)(q * total + 0.5)), seen = 0;
+    for (int b = 0; b < BUCKETS; b++)
+      if ((seen += counts[b]) >= rank)
+        return bucket_value(b);
+    return bucket_value(BUCKETS - 1);
+  }
+};
+
+class Telemetry
+{
+public:
+  static constexpr int MAX_BACKENDS = 8;
+  static constexpr int SIZE_CLASSES = 6;
+  static constexpr size_t SIZE_LIMIT[SIZE_CLASSES] = {64, 256, 1024, 4096, 65536, SIZE_MAX};
+  static constexpr const char *SIZE_NAME[SIZE_CLASSES] = {"64", "256", "1K", "4K", "64K", "large"};
+
+  struct Series
+  {
+    uint64_t hashes = 0, bytes = 0, latency_sum_ns = 0;
+    uint64_t latency[LatencyHistogram::BUCKETS] = {};
+  };
+
+  // Sum of every shard; series[backend][size class].
+  struct Totals
+  {
+    Series series[MAX_BACKENDS][SIZE_CLASSES];
+  };
+
+  static Telemetry &get()
+  {
+    static Telemetry telemetry;
+    return telemetry;
+  }
+
+  // Index of a libsha256 backend name, for record() and add(); resolve it once, not per message.
+  static int backend_index(const char *name)
+  {
+    for (int i = 0; i < MAX_BACKENDS - 1; i++)
+    {
+      const char *b = libsha256_backend_at(i);
+      if (!b)
+        break;
+      if (!strcmp(b, name))
+        return i;
+    }
+    return MAX_BACKENDS - 1;
+  }
+
+  static const char *backend_name(int i)
+  {
+    const char *b = i < MAX_BACKENDS - 1 ? libsha256_backend_at(i) : nullptr;
+    return b ? b : "other";
+  }
+
+  static int size_class(size_t len)
+  {
+    int c = 0;
+    while (len > SIZE_LIMIT[c]) c++;
+    return c;
+  }
+
+  // One message of len bytes, hashed by backend, latency_ns after it was submitted.
+  void record(int backend, size_t len, uint64_t latency_ns)
+  {
+    Cell &c = shard().cell[backend][size_class(len)];
+    bump(c.hashes, 1);
+    bump(c.bytes, len);
+    bump(c.latency_sum_ns, latency_ns);
+    bump(c.latency[LatencyHistogram::bucket_of(latency_ns)], 1);
+  }
+
+  // n messages of len bytes each, with no latency to report.
+  void add(int backend, size_t len, uint64_t n)
+  {
+    Cell &c = shard().cell[backend][size_class(len)];
+    bump(c.hashes, n);
+    bump(c.bytes, len * n);
+  }
+
+  // Messages waiting to be hashed, as the service last reported it.
+  void set_queue_depth(int64_t n) { queue_depth.store(n, std::memory_order_relaxed); }
+  int64_t get_queue_depth() const { return queue_depth.load(std::memory_order_relaxed); }
+
+  void totals(Totals &out)
+  {
+    out = Totals();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &s : shards)
+      for (int b = 0; b < MAX_BACKENDS; b++)
+        for (int c = 0; c < SIZE_CLASSES; c++)
+        {
+          const Cell &from = s->cell[b][c];
+          Series &to = out.series[b][c];
+          if (!from.hashes.load(std::memory_order_relaxed))
+            continue;
+          to.hashes += from.hashes.load(std::memory_order_relaxed);
+          to.bytes += from.bytes.load(std::memory_order_relaxed);
+          to.latency_sum_ns += from.latency_sum_ns.load(std::memory_order_relaxed);
+          for (int i = 0; i < LatencyHistogram::BUCKETS; i++) to.latency[i] += from.latency[i].load(std::memory_order_relaxed);
+        }
+  }
+
+private:
+  struct Cell
+  {
+    std::atomic<uint64_t> hashes{0}, bytes{0}, latency_sum_ns{0};
+    std::atomic<uint64_t> latency[LatencyHistogram::BUCKETS] = {};
+  };
+
+  struct alignas(64) Shard
+  {
+    Cell cell[MAX_BACKENDS][SIZE_CLASSES];
+  };
+
+  Telemetry() = default;
+
+  // Single writer per shard, so a plain load and store suffice; readers may see a count one update behind.
+  static void bump(std::atomic<uint64_t> &v, uint64_t n) { v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+  // Shards outlive their threads, so totals keep counting what finished threads did.
+  Shard &shard()
+  {
+    thread_local Shard *mine = nullptr;
+    if (!mine)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      shards.emplace_back(new Shard());
+      mine = shards.back().get();
+    }
+    return *mine;
+  }
+
+  std::mutex mutex;
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::atomic<int64_t> queue_depth{0};
+};
+
+class TelemetryExporter
+{
+public:
+  // port 0 serves no HTTP; an empty json_path writes no file.
+  TelemetryExporter(unsigned port, const std::string &json_path, double interval_s)
+      : port(port), json_path(json_path), interval_ns(std::max(0.05, interval_s) * 1e9)
+  {
+  }
+
+  TelemetryExporter(const TelemetryExporter &) = delete;
+  TelemetryExporter &operator=(const TelemetryExporter &) = delete;
+  ~TelemetryExporter() { stop(); }
+
+  bool start()
+  {
+    if (port)
+    {
+      listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (listen_fd < 0)
+        return false;
+      int one = 1;
+      setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      sockaddr_in addr = {};
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(port);
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 16) != 0)
+        return false;
+    }
+    if (!json_path.empty() && !(json_file = fopen(json_path.c_str(), "a")))
+      return false;
+    sample();
+    worker = std::thread([this]() { loop(); });
+    return true;
+  }
+
+  void stop()
+  {
+    if (worker.joinable())
+    {
+      stopping = true;
+      worker.join();
+    }
+    if (listen_fd >= 0)
+      close(listen_fd);
+    if (json_file)
+      fclose(json_file);
+    listen_fd = -1;
+    json_file = nullptr;
+  }
+
+  std::string prometheus()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return prometheus_text;
+  }
+
+  std::string json()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return json_text;
+  }
+
+private:
+  struct Cpu
+  {
+    uint64_t busy = 0, total = 0;
+    double utilization = 0, mhz = -1;
+    long long throttle = -1;
+  };
+
+  static uint64_t now_ns()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void loop()
+  {
+    uint64_t next = last_sample + interval_ns;
+    while (!stopping.load(std::memory_order_relaxed))
+    {
+      uint64_t t = now_ns();
+      if (t >= next)
+      {
+        sample();
+        next += interval_ns * std::max<uint64_t>(1, (t - next) / interval_ns + 1);
+        continue;
+      }
+      // Wake at the next sample, and at least every 100 ms to notice stop().
+      int timeout_ms = std::min<uint64_t>(100, (next - t + 999999) / 1000000);
+      pollfd pfd = {listen_fd, POLLIN, 0};
+      if (listen_fd >= 0 ? poll(&pfd, 1, timeout_ms) > 0 : (usleep(timeout_ms * 1000), false))
+        serve();
+    }
+  }
+
+  void serve()
+  {
+    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0)
+      return;
+    // One short request per connection; anything slow or malformed is dropped rather than waited for.
+    timeval tv = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char req[1024];
+    ssize_t n = recv(fd, req, sizeof(req) - 1, 0);
+    req[std::max<ssize_t>(n, 0)] = 0;
+    std::string body, type = "text/plain; version=0.0.4";
+    const char *status = "200 OK";
+    if (!strncmp(req, "GET /metrics ", 13))
+      body = prometheus();
+    else if (!strncmp(req, "GET /metrics.json ", 18))
+      body = json(), type = "application/json";
+    else
+      status = "404 Not Found", body = "try /metrics or /metrics.json\n";
+    std::string reply = std::string("HTTP/1.0 ") + status + "\r\nContent-Type: " + type + "\r\nContent-Length: " + std::to_string(body.size()) +
+                        "\r\nConnection: close\r\n\r\n" + body;
+    for (size_t off = 0; off < reply.size();)
+    {
+      ssize_t w = send(fd, reply.data() + off, reply.size() - off, MSG_NOSIGNAL);
+      if (w <= 0)
+        break;
+      off += w;
+    }
+    close(fd);
+  }
+
+  void read_cpus()
+  {
+    FILE *f = fopen("/proc/stat", "r");
+    if (!f)
+      return;
+    char line[512];
+    while (fgets(line, sizeof(line), f))
+    {
+      unsigned id;
+      unsigned long long v[8] = {};
+      if (strncmp(line, "cpu", 3) || line[3] == ' ' || sscanf(line + 3, "%u %llu %llu %llu %llu %llu %llu %llu %llu", &id, &v[0], &v[1], &v[2], &v[3], &v[4],
+                                                 &v[5], &v[6], &v[7]) < 5)
+        continue;
+      if (id >= cpus.size())
+        cpus.resize(id + 1);
+      Cpu &c = cpus[id];
+      uint64_t total = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7], busy = total - v[3] - v[4];  // minus idle, iowait
+      c.utilization = total > c.total ? (double)(busy - c.busy) / (total - c.total) : 0;
+      c.busy = busy;
+      c.total = total;
+      long long khz = read_number("/sys/devices/system/cpu/cpu" + std::to_string(id) + "/cpufreq/scaling_cur_freq");
+      c.mhz = khz < 0 ? -1 : khz / 1e3;
+      c.throttle = read_number("/sys/devices/system/cpu/cpu" + std::to_string(id) + "/thermal_throttle/core_throttle_count");
+    }
+    fclose(f);
+  }
+
+  // A sysfs integer, or -1 if the file does not exist.
+  static long long read_number(const std::string &path)
+  {
+    FILE *f = fopen(path.c_str(), "r");
+    long long v = -1;
+    if (f)
+    {
+      if (fscanf(f, "%lld", &v) != 1)
+        v = -1;
+      fclose(f);
+    }
+    return v;
+  }
+
+  void sample()
+  {
+    uint64_t t = now_ns();
+    std::unique_ptr<Telemetry::Totals> cur(new Telemetry::Totals);
+    Telemetry::get().totals(*cur);
+    read_cpus();
+    double secs = last ? (t - last_sample) / 1e9 : 0;
+    int64_t depth = Telemetry::get().get_queue_depth();
+
+    uint64_t hashes = 0, bytes = 0, d_hashes = 0, d_bytes = 0;
+    std::string prom, series_json;
+    prom += "# HELP sha256_hashes_total Messages hashed.\n# TYPE sha256_hashes_total counter\n";
+    std::string bytes_prom = "# HELP sha256_bytes_total Message bytes hashed.\n# TYPE sha256_bytes_total counter\n";
+    std::string latency_prom =
+        "# HELP sha256_latency_seconds Submit-to-digest latency; quantiles over the last interval.\n# TYPE sha256_latency_seconds summary\n";
+    uint64_t window[LatencyHistogram::BUCKETS];
+    for (int b = 0; b < Telemetry::MAX_BACKENDS; b++)
+      for (int c = 0; c < Telemetry::SIZE_CLASSES; c++)
+      {
+        const Telemetry::Series &s = cur->series[b][c];
+        if (!s.hashes)
+          continue;
+        const Telemetry::Series *p = last ? &last->series[b][c] : nullptr;
+        uint64_t dh = s.hashes - (p ? p->hashes : 0), db = s.bytes - (p ? p->bytes : 0);
+        for (int i = 0; i < LatencyHistogram::BUCKETS; i++) window[i] = s.latency[i] - (p ? p->latency[i] : 0);
+        double q50 = LatencyHistogram::quantile(window, 0.5), q99 = LatencyHistogram::quantile(window, 0.99),
+               q999 = LatencyHistogram::quantile(window, 0.999);
+        hashes += s.hashes, bytes += s.bytes, d_hashes += dh, d_bytes += db;
+
+        char labels[96], buf[1024];  // room for five copies of the longest labels and the numbers
+        snprintf(labels, sizeof(labels), "backend=\"%s\",size=\"%s\"", Telemetry::backend_name(b), Telemetry::SIZE_NAME[c]);
+        snprintf(buf, sizeof(buf), "sha256_hashes_total{%s} %llu\n", labels, (unsigned long long)s.hashes);
+        prom += buf;
+        snprintf(buf, sizeof(buf), "sha256_bytes_total{%s} %llu\n", labels, (unsigned long long)s.bytes);
+        bytes_prom += buf;
+        uint64_t timed = 0;
+        for (int i = 0; i < LatencyHistogram::BUCKETS; i++) timed += s.latency[i];
+        if (timed)
+        {
+          snprintf(buf, sizeof(buf),
+                   "sha256_latency_seconds{%s,quantile=\"0.5\"} %.9f\nsha256_latency_seconds{%s,quantile=\"0.99\"} %.9f\n"
+                   "sha256_latency_seconds{%s,quantile=\"0.999\"} %.9f\nsha256_latency_seconds_sum{%s} %.9f\n"
+                   "sha256_latency_seconds_count{%s} %llu\n",
+                   labels, q50 / 1e9, labels, q99 / 1e9, labels, q999 / 1e9, labels, s.latency_sum_ns / 1e9, labels, (unsigned long long)timed);
+          latency_prom += buf;
+        }
+        snprintf(buf, sizeof(buf),
+                 "%s{\"backend\":\"%s\",\"size\":\"%s\",\"hashes\":%llu,\"bytes\":%llu,\"hash_rate\":%.1f,\"p50_us\":%.3f,\"p99_us\":%.3f,"
+                 "\"p999_us\":%.3f}",
+                 series_json.empty() ? "" : ",", Telemetry::backend_name(b), Telemetry::SIZE_NAME[c], (unsigned long long)s.hashes,
+                 (unsigned long long)s.bytes, secs ? dh / secs : 0, q50 / 1e3, q99 / 1e3, q999 / 1e3);
+        series_json += buf;
+      }
+    prom += bytes_prom + latency_prom;
+
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "# HELP sha256_hash_rate Messages hashed per second over the last interval.\n# TYPE sha256_hash_rate gauge\n"
+             "sha256_hash_rate %.1f\n"
+             "# HELP sha256_byte_rate Bytes hashed per second over the last interval.\n# TYPE sha256_byte_rate gauge\n"
+             "sha256_byte_rate %.1f\n"
+             "# HELP sha256_queue_depth Messages waiting to be hashed.\n# TYPE sha256_queue_depth gauge\nsha256_queue_depth %lld\n"
+             "# HELP sha256_cpu_utilization Busy fraction of each CPU over the last interval.\n# TYPE sha256_cpu_utilization gauge\n",
+             secs ? d_hashes / secs : 0, secs ? d_bytes / secs : 0, (long long)depth);
+    prom += buf;
+    std::string mhz_prom, throttle_prom, cpu_json;
+    for (size_t i = 0; i < cpus.size(); i++)
+    {
+      const Cpu &c = cpus[i];
+      if (!c.total)
+        continue;
+      snprintf(buf, sizeof(buf), "sha256_cpu_utilization{cpu=\"%zu\"} %.4f\n", i, c.utilization);
+      prom += buf;
+      snprintf(buf, sizeof(buf), "%s{\"cpu\":%zu,\"utilization\":%.4f", cpu_json.empty() ? "" : ",", i, c.utilization);
+      cpu_json += buf;
+      if (c.mhz >= 0)
+      {
+        snprintf(buf, sizeof(buf), "sha256_cpu_mhz{cpu=\"%zu\"} %.0f\n", i, c.mhz);
+        mhz_prom += buf;
+        snprintf(buf, sizeof(buf), ",\"mhz\":%.0f", c.mhz);
+        cpu_json += buf;
+      }
+      if (c.throttle >= 0)
+      {
+        snprintf(buf, sizeof(buf), "sha256_cpu_throttle_events_total{cpu=\"%zu\"} %lld\n", i, c.throttle);
+        throttle_prom += buf;
+        snprintf(buf, sizeof(buf), ",\"throttle_events\":%lld", c.throttle);
+        cpu_json += buf;
+      }
+      cpu_json += "}";
+    }
+    if (!mhz_prom.empty())
+      prom += "# HELP sha256_cpu_mhz Current CPU clock.\n# TYPE sha256_cpu_mhz gauge\n" + mhz_prom;
+    if (!throttle_prom.empty())
+      prom += "# HELP sha256_cpu_throttle_events_total Thermal throttling events.\n# TYPE sha256_cpu_throttle_events_total counter\n" +
+              throttle_prom;
+
+    snprintf(buf, sizeof(buf),
+             "{\"time\":%.3f,\"interval_s\":%.3f,\"hashes\":%llu,\"bytes\":%llu,\"hash_rate\":%.1f,\"byte_rate\":%.1f,\"queue_depth\":%lld,",
+             std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count(), secs, (unsigned long long)hashes,
+             (unsigned long long)bytes, secs ? d_hashes / secs : 0, secs ? d_bytes / secs : 0, (long long)depth);
+    std::string js = buf + ("\"cpus\":[" + cpu_json + "],\"series\":[" + series_json + "]}\n");
+
+    if (json_file && last)
+    {
+      fputs(js.c_str(), json_file);
+      fflush(json_file);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      prometheus_text = std::move(prom);
+      json_text = std::move(js);
+    }
+    last = std::move(cur);
+    last_sample = t;
+  }
+
+  unsigned port;
+  std::string json_path;
+  uint64_t interval_ns;
+  int listen_fd = -1;
+  FILE *json_file = nullptr;
+  std::thread worker;
+  std::atomic<bool> stopping{false};
+
+  std::unique_ptr<Telemetry::Totals> last;
+  uint64_t last_sample = 0;
+  std::vector<Cpu> cpus;
+  std::mutex mutex;
+  std::string prometheus_text, json_text;
+};
+
+#endif
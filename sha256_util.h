@@ -0,0 +1,32 @@
+#ifndef SHA256_UTIL_H
+#define SHA256_UTIL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+  Helpers the command-line tools share: lowercase hex for digests, and steady-clock timing in seconds.
+*/
+
+inline std::string to_hex(const uint8_t *d, size_t n = 32)
+{
+  static const char *hex = "0123456789abcdef";
+  std::string s;
+  for (size_t i = 0; i < n; i++) s += hex[d[i] >> 4], s += hex[d[i] & 15];
+  return s;
+}
+
+// Steady-clock time in seconds; only differences mean anything.
+inline double now_s()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline double seconds_since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif